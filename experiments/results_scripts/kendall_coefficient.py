@@ -58,7 +58,7 @@ avg_simple_mcathroughput = 0
 avg_simple_uicathroughput = 0
 
 
-cost_options = ['latency', 'recipthroughput', 'codesize', 'sizeandlatency', 'kmeans']
+cost_options = ['latency', 'recipthroughput', 'codesize', 'sizeandlatency', 'kmeans', 'dynamic']
 
 avg_kendall_wl = dict()
 avg_spearman_wl = dict()
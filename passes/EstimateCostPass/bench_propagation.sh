@@ -0,0 +1,39 @@
+#!/bin/bash
+
+# Time Algorithm 2 with the loop nest propagation and with the original one (-wu-larus-legacy-propagation) on the
+# modules given, and check that both give the same frequencies. The original is quadratic in the number of loops of a
+# function: the modules of gcc's insn-*.c files (502.gcc_r in SPEC CPU 2017) show the difference best, e.g.
+#   clang -O1 -Xclang -disable-llvm-passes -emit-llvm -c insn-recog.c -o insn-recog.bc
+#   ./bench_propagation.sh insn-*.bc
+# Prints a CSV line per module: file,blocks,loop_nest_s,legacy_s,speedup,same.
+
+source ./get_plugin_path.sh
+llvm_dir=/usr/lib/llvm-15
+
+load_plugins=""
+for path in ${deps_path[@]}; do load_plugins+=" -load-pass-plugin ${path} "; done
+load_plugins+=" -load-pass-plugin ${plugin_path} "
+
+function run_frequencies {
+    local target=$1
+    local output=$2
+    shift 2
+    local start=$(date +%s.%N)
+    $llvm_dir/bin/opt ${load_plugins} -passes="EstimateCostPass" -disable-output $target --frequencies "$@" > $output
+    local end=$(date +%s.%N)
+    awk "BEGIN { printf \"%.3f\", $end - $start }"
+}
+
+nest_output=$(mktemp)
+legacy_output=$(mktemp)
+trap "rm -f $nest_output $legacy_output" EXIT
+
+echo "file,blocks,loop_nest_s,legacy_s,speedup,same"
+for target in "$@"; do
+    nest_s=$(run_frequencies $target $nest_output)
+    legacy_s=$(run_frequencies $target $legacy_output --wu-larus-legacy-propagation)
+    blocks=$(grep -c "BasicBlock:" $nest_output)
+    speedup=$(awk "BEGIN { printf \"%.1f\", $legacy_s / ($nest_s > 0 ? $nest_s : 0.001) }")
+    same=$(cmp -s $nest_output $legacy_output && echo yes || echo no)
+    echo "$target,$blocks,$nest_s,$legacy_s,$speedup,$same"
+done
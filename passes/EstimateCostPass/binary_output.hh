@@ -0,0 +1,230 @@
+/*
+  This file is distributed under the University of Illinois Open Source
+  License. See LICENSE for details.
+*/
+
+#pragma once
+
+// Columnar binary output, shared by EstimateCostPass, InstrumentationPass and the PAPI runtime (which doesn't link
+// LLVM, so this header only uses the standard library, and zlib when BINARY_OUTPUT_ZLIB is defined).
+//
+// Layout, little endian, every column's data aligned to 8 bytes so it can be mapped as an array (numpy.frombuffer):
+//   file:   "RTEB" | version u32 | kind u32 | table count u32
+//   table:  name char[16] | rows u64 | column count u32 | pad u32 | columns
+//   column: name char[16] | type u8 | compression u8 | pad u16 | width u32 | stored bytes u64 | raw bytes u64 |
+//           data | padding to 8 bytes
+// A column holds rows * width values (width > 1 for matrices, e.g. opcode counts), except for bytes columns. Strings
+// are a u64 column of end offsets <name> plus a bytes column <name>_data. Functions and blocks are identified by
+// their ordinals in the module and function, the IDs used by the instrumentation.
+// runtime-generalization/binary_output.py reads these files and converts them back to YAML.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef BINARY_OUTPUT_ZLIB
+#include <zlib.h>
+#endif
+
+namespace Binary_output {
+  constexpr char magic[4]{ 'R', 'T', 'E', 'B' };
+  constexpr uint32_t version{ 1 };
+  constexpr size_t name_size{ 16 };
+
+  enum class Kind : uint32_t { frequencies = 1, costs = 2, histograms = 3, runtime_data = 4, file_costs = 5 };
+  enum class Type : uint8_t { u32 = 0, u64 = 1, f64 = 2, bytes = 3 };
+  enum class Compression : uint8_t { none = 0, zlib = 1 };
+
+  template <typename T> constexpr Type type_of();
+  template <> constexpr Type type_of<uint32_t>() { return Type::u32; }
+  template <> constexpr Type type_of<uint64_t>() { return Type::u64; }
+  template <> constexpr Type type_of<double>() { return Type::f64; }
+
+  struct Column {
+    std::string name;
+    Type type;
+    uint32_t width;
+    std::vector<char> data;
+  };
+
+  struct Table {
+    std::string name;
+    uint64_t rows{ 0 };
+    std::vector<Column> columns{};
+
+    template <typename T> void add(const std::string &column, const std::vector<T> &values, uint32_t width = 1) {
+      std::vector<char> data(values.size() * sizeof(T));
+      if (!data.empty()) std::memcpy(data.data(), values.data(), data.size());
+      columns.push_back({ column, type_of<T>(), width, std::move(data) });
+    }
+
+    void add_strings(const std::string &column, const std::vector<std::string> &values) {
+      std::vector<uint64_t> ends{};
+      std::vector<char> data{};
+      for (const std::string &value : values) {
+        data.insert(data.end(), value.begin(), value.end());
+        ends.push_back(data.size());
+      }
+      add(column, ends);
+      columns.push_back({ column + "_data", Type::bytes, 1, std::move(data) });
+    }
+
+    const Column *find(const std::string &column) const {
+      for (const Column &col : columns)
+        if (col.name == column) return &col;
+      return nullptr;
+    }
+
+    template <typename T> std::vector<T> get(const std::string &column) const {
+      const Column *col{ find(column) };
+      if (!col || col->type != type_of<T>()) return {};
+      std::vector<T> values(col->data.size() / sizeof(T));
+      if (!values.empty()) std::memcpy(values.data(), col->data.data(), values.size() * sizeof(T));
+      return values;
+    }
+
+    std::vector<std::string> get_strings(const std::string &column) const {
+      std::vector<uint64_t> ends{ get<uint64_t>(column) };
+      const Column *data{ find(column + "_data") };
+      std::vector<std::string> values{};
+      uint64_t begin{ 0 };
+      for (uint64_t end : ends) {
+        if (!data || end < begin || end > data->data.size()) return {};
+        values.emplace_back(data->data.data() + begin, end - begin);
+        begin = end;
+      }
+      return values;
+    }
+  };
+
+  struct File {
+    Kind kind;
+    std::vector<Table> tables{};
+
+    const Table *find(const std::string &table) const {
+      for (const Table &tab : tables)
+        if (tab.name == table) return &tab;
+      return nullptr;
+    }
+  };
+
+  namespace detail {
+    template <typename T> void put(std::string &out, T value) { out.append(reinterpret_cast<const char *>(&value), sizeof(T)); }
+
+    inline void put_name(std::string &out, const std::string &name) {
+      char padded[name_size]{};
+      std::memcpy(padded, name.data(), std::min(name.size(), name_size));
+      out.append(padded, name_size);
+    }
+
+    inline void align(std::string &out) { out.append((8 - out.size() % 8) % 8, '\0'); }
+
+    template <typename T> bool get(const std::string &in, size_t &pos, T &value) {
+      if (pos + sizeof(T) > in.size()) return false;
+      std::memcpy(&value, in.data() + pos, sizeof(T));
+      pos += sizeof(T);
+      return true;
+    }
+  } // namespace detail
+
+  // Serialize <file>. Columns larger than a few KB are zlib compressed when <compress> is set and zlib is available.
+  inline std::string serialize(const File &file, bool compress = false)
+  {
+    std::string out{};
+    out.append(magic, sizeof(magic));
+    detail::put<uint32_t>(out, version);
+    detail::put<uint32_t>(out, static_cast<uint32_t>(file.kind));
+    detail::put<uint32_t>(out, file.tables.size());
+    for (const Table &table : file.tables) {
+      detail::put_name(out, table.name);
+      detail::put<uint64_t>(out, table.rows);
+      detail::put<uint32_t>(out, table.columns.size());
+      detail::put<uint32_t>(out, 0);
+      for (const Column &column : table.columns) {
+        const std::vector<char> *stored{ &column.data };
+        Compression compression{ Compression::none };
+#ifdef BINARY_OUTPUT_ZLIB
+        std::vector<char> compressed{};
+        if (compress && column.data.size() > 4096) {
+          uLongf size{ compressBound(column.data.size()) };
+          compressed.resize(size);
+          if (compress2(reinterpret_cast<Bytef *>(compressed.data()), &size,
+                        reinterpret_cast<const Bytef *>(column.data.data()), column.data.size(), Z_BEST_SPEED) == Z_OK
+              && size < column.data.size()) {
+            compressed.resize(size);
+            stored = &compressed;
+            compression = Compression::zlib;
+          }
+        }
+#endif
+        detail::put_name(out, column.name);
+        detail::put<uint8_t>(out, static_cast<uint8_t>(column.type));
+        detail::put<uint8_t>(out, static_cast<uint8_t>(compression));
+        detail::put<uint16_t>(out, 0);
+        detail::put<uint32_t>(out, column.width);
+        detail::put<uint64_t>(out, stored->size());
+        detail::put<uint64_t>(out, column.data.size());
+        out.append(stored->data(), stored->size());
+        detail::align(out);
+      }
+    }
+    return out;
+  }
+
+  // True if <path> names a binary output file (*.bin), for the tools whose output format follows the file name.
+  inline bool is_binary_path(const std::string &path) { return path.size() >= 4 && !path.compare(path.size() - 4, 4, ".bin"); }
+
+  // True if <data> starts like a binary output file.
+  inline bool is_binary(const std::string &data) { return data.size() >= sizeof(magic) && !data.compare(0, sizeof(magic), magic, sizeof(magic)); }
+
+  // Parse a serialized file. Returns false if it is not valid (or uses zlib and zlib is not available).
+  inline bool parse(const std::string &in, File &file)
+  {
+    size_t pos{ sizeof(magic) };
+    uint32_t file_version{}, kind{}, tables{};
+    if (!is_binary(in) || !detail::get(in, pos, file_version) || file_version != version || !detail::get(in, pos, kind)
+        || !detail::get(in, pos, tables))
+      return false;
+    file.kind = static_cast<Kind>(kind);
+    file.tables.clear();
+    for (uint32_t t = 0; t < tables; ++t) {
+      if (pos + name_size > in.size()) return false;
+      Table table{ std::string{ in.data() + pos, strnlen(in.data() + pos, name_size) } };
+      pos += name_size;
+      uint32_t columns{}, pad{};
+      if (!detail::get(in, pos, table.rows) || !detail::get(in, pos, columns) || !detail::get(in, pos, pad)) return false;
+      for (uint32_t c = 0; c < columns; ++c) {
+        if (pos + name_size > in.size()) return false;
+        Column column{ std::string{ in.data() + pos, strnlen(in.data() + pos, name_size) } };
+        pos += name_size;
+        uint8_t type{}, compression{};
+        uint16_t pad16{};
+        uint64_t stored{}, raw{};
+        if (!detail::get(in, pos, type) || !detail::get(in, pos, compression) || !detail::get(in, pos, pad16)
+            || !detail::get(in, pos, column.width) || !detail::get(in, pos, stored) || !detail::get(in, pos, raw)
+            || pos + stored > in.size())
+          return false;
+        column.type = static_cast<Type>(type);
+        if (compression == static_cast<uint8_t>(Compression::none)) {
+          column.data.assign(in.data() + pos, in.data() + pos + stored);
+        } else {
+#ifdef BINARY_OUTPUT_ZLIB
+          column.data.resize(raw);
+          uLongf size{ raw };
+          if (uncompress(reinterpret_cast<Bytef *>(column.data.data()), &size,
+                         reinterpret_cast<const Bytef *>(in.data() + pos), stored) != Z_OK || size != raw)
+            return false;
+#else
+          return false;
+#endif
+        }
+        pos += stored + (8 - (pos + stored) % 8) % 8;
+        table.columns.push_back(std::move(column));
+      }
+      file.tables.push_back(std::move(table));
+    }
+    return true;
+  }
+} // namespace Binary_output
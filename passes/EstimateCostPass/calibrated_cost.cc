@@ -0,0 +1,76 @@
+/*
+  This file is distributed under the University of Illinois Open Source
+  License. See LICENSE for details.
+*/
+
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/Support/LineIterator.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include "calibrated_cost.hh"
+
+namespace {
+
+// Type names independent of the pointer mode (typed or opaque), so the same table works for both.
+std::string type_key(llvm::Type *type)
+{
+  if (type->isPointerTy()) return "ptr";
+  if (auto *vector{ llvm::dyn_cast<llvm::FixedVectorType>(type) })
+    return "<" + std::to_string(vector->getNumElements()) + " x " + type_key(vector->getElementType()) + ">";
+  std::string name{};
+  llvm::raw_string_ostream stream{ name };
+  type->print(stream);
+  return stream.str();
+}
+
+} // namespace
+
+std::pair<std::string, std::string> opcode_cost_key(const llvm::Instruction &instr)
+{
+  llvm::Type *type{ instr.getType() };
+  if (auto *store{ llvm::dyn_cast<llvm::StoreInst>(&instr) }) type = store->getValueOperand()->getType();
+  else if (llvm::isa<llvm::CmpInst>(instr)) type = instr.getOperand(0)->getType();
+  return { instr.getOpcodeName(), type_key(type) };
+}
+
+/* Calibrated opcode costs.
+  The table replaces the TTI costs by cycles measured on the machine the programs are deployed on. Rows are keyed by
+  opcode and type; a "*" type matches the instructions of that opcode whose type has no row of its own.
+***********************************************************************************************************************/
+bool Calibrated_cost_table::load(llvm::StringRef path)
+{
+  auto buffer{ llvm::MemoryBuffer::getFile(path) };
+  if (!buffer) {
+    llvm::errs() << "Error: Unable to read calibrated costs [" << path << "]: " << buffer.getError().message() << '\n';
+    return false;
+  }
+  costs_.clear();
+  for (llvm::line_iterator line{ **buffer, true, '#' }; !line.is_at_eof(); ++line) {
+    llvm::SmallVector<llvm::StringRef, 4> fields{};
+    line->split(fields, ',');
+    Opcode_cost cost{};
+    if (fields.size() != 4 || fields[2].trim().getAsDouble(cost.latency) || fields[3].trim().getAsDouble(cost.throughput)) {
+      if (fields[0].trim() != "opcode") // Header.
+        llvm::errs() << "Invalid calibrated cost [" << *line << "] in [" << path << "]\n";
+      continue;
+    }
+    insert(fields[0].trim(), fields[1].trim(), cost);
+  }
+  return true;
+}
+
+void Calibrated_cost_table::insert(llvm::StringRef opcode, llvm::StringRef type, Opcode_cost cost)
+{
+  costs_[(opcode + "," + type).str()] = cost;
+}
+
+const Opcode_cost *Calibrated_cost_table::lookup(const llvm::Instruction &instr) const
+{
+  auto [opcode, type] = opcode_cost_key(instr);
+  auto found{ costs_.find(opcode + "," + type) };
+  if (found == costs_.end()) found = costs_.find(opcode + ",*");
+  if (found == costs_.end()) return nullptr;
+  return &found->second;
+}
@@ -0,0 +1,37 @@
+/*
+  This file is distributed under the University of Illinois Open Source
+  License. See LICENSE for details.
+*/
+
+#pragma once
+
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/IR/Instruction.h>
+
+#include <string>
+#include <utility>
+
+// Cycles measured for an opcode/type on the local machine.
+struct Opcode_cost {
+  double latency{ 0 };    // Of a chain of dependent instructions, per instruction.
+  double throughput{ 0 }; // Reciprocal throughput of independent instructions.
+};
+
+// Opcode name and type an instruction is calibrated by, e.g. ("fdiv", "double"). The type is the type of the result,
+// or of the compared or stored value for comparisons and stores.
+std::pair<std::string, std::string> opcode_cost_key(const llvm::Instruction &instr);
+
+struct Calibrated_cost_table {
+  // Read a CSV table of "opcode,type,latency,throughput" lines ('#' starts a comment), as written by
+  // calibration/opcode_calibration. Returns false (after reporting to errs()) if the file can't be read.
+  bool load(llvm::StringRef path);
+  // Cost of <instr>'s opcode for its type, or for any type ("*"), or nullptr if it was not calibrated.
+  const Opcode_cost *lookup(const llvm::Instruction &instr) const;
+  bool empty() const { return costs_.empty(); }
+
+private:
+  void insert(llvm::StringRef opcode, llvm::StringRef type, Opcode_cost cost);
+
+  llvm::StringMap<Opcode_cost> costs_; // "opcode,type" -> cost.
+};
@@ -0,0 +1,111 @@
+/*
+  This file is distributed under the University of Illinois Open Source
+  License. See LICENSE for details.
+*/
+
+// Calibrates the library call cost table read by EstimateCostPass (-libcall-costs) on the local machine.
+// Usage: libcall_calibration [output.csv]   (default: stdout)
+
+#include <x86intrin.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+using namespace std;
+
+namespace {
+  constexpr int repetitions{ 1000 };
+  constexpr size_t small_size{ 16 }, large_size{ 16 * 1024 };
+
+  // Keeps the compiler from optimizing the measured calls away.
+  volatile uint64_t sink{ 0 };
+  volatile double fsink{ 0 };
+
+  // Minimum cycles of <call>(size) over the repetitions, minus the cost of the timing itself.
+  double time_call(const function<void(size_t)> &call, size_t size)
+  {
+    static double overhead{ -1 };
+    auto measure = [](const function<void(size_t)> &fn, size_t n) {
+      uint64_t best{ numeric_limits<uint64_t>::max() };
+      for (int rep = 0; rep < repetitions; ++rep) {
+        unsigned aux{};
+        uint64_t start{ __rdtscp(&aux) };
+        fn(n);
+        uint64_t end{ __rdtscp(&aux) };
+        best = min(best, end - start);
+      }
+      return static_cast<double>(best);
+    };
+    if (overhead < 0) overhead = measure([](size_t) {}, 0);
+    return max(0.0, measure(call, size) - overhead);
+  }
+
+  struct Symbol {
+    const char *name;
+    int size_arg; // Index of the length argument, -1 if none.
+    function<void(size_t)> call; // Called with a size in bytes.
+    size_t unit_bytes{ 1 }; // Bytes per unit of the length argument.
+    int count_arg{ -1 }; // Index of an argument multiplying the length, -1 if none.
+  };
+} // namespace
+
+int main(int argc, char *argv[])
+{
+  vector<char> src(large_size + 1, 'a'), dst(large_size + 1, 'b'), str(large_size + 1, 'a');
+  vector<int> shuffled(large_size / sizeof(int)), keys(shuffled.size());
+  for (size_t i = 0; i < shuffled.size(); ++i) shuffled[i] = static_cast<int>((i * 2654435761u) % 1000003);
+  src[large_size] = dst[large_size] = str[large_size] = '\0';
+  auto by_value = [](const void *a, const void *b) { return *static_cast<const int *>(a) - *static_cast<const int *>(b); };
+
+  vector<Symbol> symbols{
+    { "memcpy", 2, [&](size_t n) { memcpy(dst.data(), src.data(), n); sink = dst[n / 2]; } },
+    { "memmove", 2, [&](size_t n) { memmove(dst.data(), src.data(), n); sink = dst[n / 2]; } },
+    { "memset", 2, [&](size_t n) { memset(dst.data(), 'c', n); sink = dst[n / 2]; } },
+    { "memcmp", 2, [&](size_t n) { sink = memcmp(dst.data(), dst.data() + 1, n); } },
+    { "malloc", 0, [&](size_t n) { void *p{ malloc(n) }; sink = reinterpret_cast<uintptr_t>(p); free(p); } },
+    // calloc's size is nmemb * size: timed with 8-byte members, as its per_unit is per byte of the product.
+    { "calloc", 1, [&](size_t n) { void *p{ calloc(n / 8, 8) }; sink = reinterpret_cast<uintptr_t>(p); free(p); },
+      1, 0 },
+    { "free", -1, [&](size_t) { void *p{ malloc(small_size) }; sink = reinterpret_cast<uintptr_t>(p); free(p); } },
+    // strlen and strcmp have no length argument: their per_unit is per character, applied to -libcall-unknown-size.
+    { "strlen", -1, [&](size_t n) { src[n] = '\0'; sink = strlen(src.data()); src[n] = 'a'; } },
+    { "strcmp", -1, [&](size_t n) { src[n] = str[n] = '\0'; sink = strcmp(src.data(), str.data()); src[n] = str[n] = 'a'; } },
+    { "qsort", 1, [&](size_t n) {
+        copy_n(shuffled.begin(), n / sizeof(int), keys.begin());
+        qsort(keys.data(), n / sizeof(int), sizeof(int), by_value);
+        sink = keys[0]; }, sizeof(int) },
+    { "sqrt", -1, [&](size_t) { fsink = sqrt(fsink + 2.0); } },
+    { "exp", -1, [&](size_t) { fsink = exp(fsink * 1e-9 + 0.5); } },
+    { "log", -1, [&](size_t) { fsink = log(fsink + 2.0); } },
+    { "pow", -1, [&](size_t) { fsink = pow(fsink + 1.5, 1.7); } },
+    { "sin", -1, [&](size_t) { fsink = sin(fsink + 0.5); } },
+    { "cos", -1, [&](size_t) { fsink = cos(fsink + 0.5); } },
+  };
+
+  ofstream file{};
+  if (argc > 1) file.open(argv[1]);
+  ostream &output{ argc > 1 ? file : cout };
+  output << "# Library call costs in cycles (rdtscp), calibrated by libcall_calibration\n"
+         << "symbol,base,per_unit,size_arg\n";
+  for (Symbol &symbol : symbols) {
+    // Two-point fit of base + per_unit * size. Operations that don't depend on the size (sqrt, free) get a per_unit
+    // close to 0.
+    double small{ time_call(symbol.call, small_size) };
+    double large{ time_call(symbol.call, large_size) };
+    double per_byte{ max(0.0, (large - small) / (large_size - small_size)) };
+    double base{ max(0.0, small - per_byte * small_size) };
+    double per_unit{ per_byte * symbol.unit_bytes };
+    output << symbol.name << ',' << base << ',' << per_unit << ',' << symbol.size_arg;
+    if (symbol.count_arg >= 0) output << '*' << symbol.count_arg;
+    output << '\n';
+  }
+  return 0;
+}
@@ -0,0 +1,308 @@
+/*
+  This file is distributed under the University of Illinois Open Source
+  License. See LICENSE for details.
+*/
+
+// Calibrates the opcode cost table read by EstimateCostPass (-calibrated-costs) on the local machine.
+// Usage: opcode_calibration [output.csv]   (default: stdout)
+//
+// Covers the scalar integer and floating point arithmetic, comparisons and selects, casts, loads, stores,
+// getelementptr, atomicrmw and fence. Not calibrated, so costed by the fallback cost kind (-fallback-cost-kind):
+// vector operations and types, control flow (br, switch, indirectbr, ret, phi), calls and invokes, alloca, cmpxchg,
+// bitcast, the aggregate and vector element operations (extractvalue, insertvalue, extractelement, insertelement,
+// shufflevector), va_arg and the exception handling instructions. EstimateCostPass warns of those it meets.
+
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/InlineAsm.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Verifier.h>
+#include <llvm/Support/Error.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <x86intrin.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../calibrated_cost.cc"
+
+using namespace std;
+using namespace llvm;
+
+namespace {
+  constexpr uint64_t iterations{ 1 << 20 };
+  constexpr int repetitions{ 5 };
+  constexpr unsigned env_slots{ 64 };
+  constexpr unsigned latency_steps{ 16 };          // One chain of 16 dependent steps per iteration.
+  constexpr unsigned throughput_streams{ 8 }, throughput_steps{ 2 }; // 8 independent chains of 2 steps.
+
+  // Kernel arguments: the iteration count and an environment holding the operand (slot 0), the initial value of the
+  // accumulators (slot 1) and room for the results and the stores of the store kernel (slots 2 and on).
+  using Kernel_fn = void (*)(uint64_t, uint64_t *);
+  using Type_fn = Type *(*)(LLVMContext &);
+
+  // A microkernel repeats <step> on accumulators of type <type>. A step is usually one instruction; when the result
+  // of an instruction can't feed itself (casts, comparisons), it is a round trip split evenly between its instructions.
+  struct Kernel {
+    string name;
+    Type_fn type;
+    uint64_t operand, initial; // Bits of the values stored in the environment.
+    function<Value *(IRBuilder<> &, Value *acc, Value *operand, Value *env, unsigned slot)> step;
+  };
+
+  // Pass <value> through an empty inline asm, so codegen can't reassociate, fold or hoist the steps of a chain (e.g.
+  // turn 16 dependent adds of the same operand into a multiply, or a round trip through a cast into nothing).
+  Value *opaque(IRBuilder<> &builder, Value *value)
+  {
+    Type *type{ value->getType() };
+    const char *constraints{ type->isFloatingPointTy() ? "=x,0" : "=r,0" };
+    return builder.CreateCall(InlineAsm::get(FunctionType::get(type, { type }, false), "", constraints, true), { value });
+  }
+
+  uint64_t bits(double value) { uint64_t raw; memcpy(&raw, &value, sizeof(raw)); return raw; }
+  uint64_t bits(float value) { uint32_t raw; memcpy(&raw, &value, sizeof(raw)); return raw; }
+
+  // Build kernel <name>: <streams> accumulators, each going through <steps> steps per iteration. Returns the keys of
+  // the instructions of one step.
+  vector<pair<string, string>> build_kernel(Module &module, const string &name, const Kernel *kernel, unsigned streams,
+                                            unsigned steps)
+  {
+    LLVMContext &context{ module.getContext() };
+    Type *i64{ Type::getInt64Ty(context) };
+    auto *fun_type{ FunctionType::get(Type::getVoidTy(context), { i64, PointerType::getUnqual(i64) }, false) };
+    Function *fun{ Function::Create(fun_type, Function::ExternalLinkage, name, module) };
+    Value *count{ fun->getArg(0) }, *env{ fun->getArg(1) };
+    BasicBlock *entry{ BasicBlock::Create(context, "entry", fun) };
+    BasicBlock *loop{ BasicBlock::Create(context, "loop", fun) };
+    BasicBlock *exit{ BasicBlock::Create(context, "exit", fun) };
+
+    IRBuilder<> builder{ entry };
+    Type *type{ kernel ? kernel->type(context) : i64 };
+    auto env_load = [&](unsigned slot) {
+      Value *address{ builder.CreateBitCast(builder.CreateConstGEP1_64(i64, env, slot), PointerType::getUnqual(type)) };
+      return builder.CreateLoad(type, address);
+    };
+    Value *operand{ env_load(0) }, *initial{ env_load(1) };
+    builder.CreateBr(loop);
+
+    builder.SetInsertPoint(loop);
+    PHINode *index{ builder.CreatePHI(i64, 2) };
+    index->addIncoming(builder.getInt64(0), entry);
+    vector<PHINode *> accs{};
+    vector<Value *> values{};
+    for (unsigned stream = 0; stream < streams; ++stream) {
+      accs.push_back(builder.CreatePHI(type, 2));
+      accs.back()->addIncoming(initial, entry);
+      values.push_back(accs.back());
+    }
+    vector<pair<string, string>> keys{};
+    for (unsigned step = 0; step < steps; ++step) {
+      for (unsigned stream = 0; stream < streams; ++stream) {
+        Instruction *before{ builder.GetInsertBlock()->empty() ? nullptr : &builder.GetInsertBlock()->back() };
+        values[stream] = opaque(builder, kernel->step(builder, values[stream], operand, env, 2 + stream * steps + step));
+        if (step || stream) continue;
+        for (auto it = before ? ++before->getIterator() : loop->begin(); it != loop->end(); ++it)
+          if (!isa<CallInst>(*it) && !isa<BitCastInst>(*it) && (!isa<GetElementPtrInst>(*it) || kernel->name == "getelementptr"))
+            keys.push_back(opcode_cost_key(*it));
+      }
+    }
+    Value *next{ builder.CreateAdd(index, builder.getInt64(1)) };
+    index->addIncoming(next, loop);
+    for (unsigned stream = 0; stream < streams; ++stream) accs[stream]->addIncoming(values[stream], loop);
+    builder.CreateCondBr(builder.CreateICmpULT(next, count), loop, exit);
+
+    builder.SetInsertPoint(exit);
+    for (unsigned stream = 0; stream < streams; ++stream) { // Keep the results alive.
+      Value *address{ builder.CreateConstGEP1_64(i64, env, 2 + stream) };
+      builder.CreateStore(values[stream], builder.CreateBitCast(address, PointerType::getUnqual(type)));
+    }
+    builder.CreateRetVoid();
+    return keys;
+  }
+
+  // Minimum cycles of a run of <kernel> over the repetitions.
+  double time_kernel(Kernel_fn kernel, uint64_t *env)
+  {
+    uint64_t best{ numeric_limits<uint64_t>::max() };
+    for (int rep = 0; rep < repetitions; ++rep) {
+      unsigned aux{};
+      uint64_t start{ __rdtscp(&aux) };
+      kernel(iterations, env);
+      uint64_t end{ __rdtscp(&aux) };
+      best = min(best, end - start);
+    }
+    return static_cast<double>(best);
+  }
+
+  template <typename Create>
+  Kernel binary(const string &name, Type_fn type, uint64_t operand, uint64_t initial, Create create)
+  {
+    return { name, type, operand, initial, [create](IRBuilder<> &builder, Value *acc, Value *op, Value *, unsigned) {
+      return create(builder, acc, op);
+    } };
+  }
+
+  vector<Kernel> kernels()
+  {
+    Type_fn i32{ [](LLVMContext &c) -> Type * { return Type::getInt32Ty(c); } };
+    Type_fn i64{ [](LLVMContext &c) -> Type * { return Type::getInt64Ty(c); } };
+    Type_fn f32{ [](LLVMContext &c) -> Type * { return Type::getFloatTy(c); } };
+    Type_fn f64{ [](LLVMContext &c) -> Type * { return Type::getDoubleTy(c); } };
+    Type_fn ptr{ [](LLVMContext &c) -> Type * { return Type::getInt8PtrTy(c); } };
+    vector<Kernel> result{};
+
+    // Operands are identities (or, for remainders, larger than the accumulator) so the chains keep their value.
+    struct Int_kernels { Type_fn type; uint64_t max; };
+    for (auto [type, max] : { Int_kernels{ i32, 0x7fffffff }, Int_kernels{ i64, 0x7fffffffffffffff } }) {
+      uint64_t initial{ 123456789 };
+      result.push_back(binary("add", type, 0, initial, [](auto &b, Value *x, Value *y) { return b.CreateAdd(x, y); }));
+      result.push_back(binary("sub", type, 0, initial, [](auto &b, Value *x, Value *y) { return b.CreateSub(x, y); }));
+      result.push_back(binary("mul", type, 1, initial, [](auto &b, Value *x, Value *y) { return b.CreateMul(x, y); }));
+      result.push_back(binary("udiv", type, 1, initial, [](auto &b, Value *x, Value *y) { return b.CreateUDiv(x, y); }));
+      result.push_back(binary("sdiv", type, 1, initial, [](auto &b, Value *x, Value *y) { return b.CreateSDiv(x, y); }));
+      result.push_back(binary("urem", type, max, initial, [](auto &b, Value *x, Value *y) { return b.CreateURem(x, y); }));
+      result.push_back(binary("srem", type, max, initial, [](auto &b, Value *x, Value *y) { return b.CreateSRem(x, y); }));
+      result.push_back(binary("shl", type, 0, initial, [](auto &b, Value *x, Value *y) { return b.CreateShl(x, y); }));
+      result.push_back(binary("lshr", type, 0, initial, [](auto &b, Value *x, Value *y) { return b.CreateLShr(x, y); }));
+      result.push_back(binary("ashr", type, 0, initial, [](auto &b, Value *x, Value *y) { return b.CreateAShr(x, y); }));
+      result.push_back(binary("and", type, ~uint64_t{ 0 }, initial, [](auto &b, Value *x, Value *y) { return b.CreateAnd(x, y); }));
+      result.push_back(binary("or", type, 0, initial, [](auto &b, Value *x, Value *y) { return b.CreateOr(x, y); }));
+      result.push_back(binary("xor", type, 0, initial, [](auto &b, Value *x, Value *y) { return b.CreateXor(x, y); }));
+      result.push_back(binary("icmp", type, max, initial, [](auto &b, Value *x, Value *y) {
+        return b.CreateSelect(b.CreateICmpSLT(x, y), x, y); }));
+      result.push_back(binary("freeze", type, 0, initial, [](auto &b, Value *x, Value *) {
+        return b.CreateFreeze(x); }));
+    }
+    struct Fp_kernels { Type_fn type; uint64_t one, zero, huge, initial; };
+    for (auto [type, one, zero, huge, initial] : { Fp_kernels{ f32, bits(1.0f), bits(0.0f), bits(1e30f), bits(1.5f) },
+                                                   Fp_kernels{ f64, bits(1.0), bits(0.0), bits(1e300), bits(1.5) } }) {
+      result.push_back(binary("fadd", type, zero, initial, [](auto &b, Value *x, Value *y) { return b.CreateFAdd(x, y); }));
+      result.push_back(binary("fsub", type, zero, initial, [](auto &b, Value *x, Value *y) { return b.CreateFSub(x, y); }));
+      result.push_back(binary("fmul", type, one, initial, [](auto &b, Value *x, Value *y) { return b.CreateFMul(x, y); }));
+      result.push_back(binary("fdiv", type, one, initial, [](auto &b, Value *x, Value *y) { return b.CreateFDiv(x, y); }));
+      result.push_back(binary("frem", type, huge, initial, [](auto &b, Value *x, Value *y) { return b.CreateFRem(x, y); }));
+      result.push_back(binary("fneg", type, zero, initial, [](auto &b, Value *x, Value *) { return b.CreateFNeg(x); }));
+      result.push_back(binary("fcmp", type, huge, initial, [](auto &b, Value *x, Value *y) {
+        return b.CreateSelect(b.CreateFCmpOLT(x, y), x, y); }));
+    }
+
+    // Round trips through the casts.
+    result.push_back(binary("trunc/zext", i64, 0, 123456789, [](auto &b, Value *x, Value *) {
+      return b.CreateZExt(opaque(b, b.CreateTrunc(x, b.getInt32Ty())), b.getInt64Ty()); }));
+    result.push_back(binary("trunc/sext", i64, 0, 123456789, [](auto &b, Value *x, Value *) {
+      return b.CreateSExt(opaque(b, b.CreateTrunc(x, b.getInt32Ty())), b.getInt64Ty()); }));
+    result.push_back(binary("fptosi/sitofp", f64, 0, bits(1e6), [](auto &b, Value *x, Value *) {
+      return b.CreateSIToFP(opaque(b, b.CreateFPToSI(x, b.getInt64Ty())), b.getDoubleTy()); }));
+    result.push_back(binary("fptoui/uitofp", f64, 0, bits(1e6), [](auto &b, Value *x, Value *) {
+      return b.CreateUIToFP(opaque(b, b.CreateFPToUI(x, b.getInt64Ty())), b.getDoubleTy()); }));
+    result.push_back(binary("fptosi/sitofp", f32, 0, bits(1e6f), [](auto &b, Value *x, Value *) {
+      return b.CreateSIToFP(opaque(b, b.CreateFPToSI(x, b.getInt32Ty())), b.getFloatTy()); }));
+    result.push_back(binary("fptoui/uitofp", f32, 0, bits(1e6f), [](auto &b, Value *x, Value *) {
+      return b.CreateUIToFP(opaque(b, b.CreateFPToUI(x, b.getInt32Ty())), b.getFloatTy()); }));
+    result.push_back(binary("fpext/fptrunc", f32, 0, bits(1.5f), [](auto &b, Value *x, Value *) {
+      return b.CreateFPTrunc(opaque(b, b.CreateFPExt(x, b.getDoubleTy())), b.getFloatTy()); }));
+    result.push_back(binary("ptrtoint/inttoptr", ptr, 0, 0, [](auto &b, Value *x, Value *) {
+      return b.CreateIntToPtr(opaque(b, b.CreatePtrToInt(x, b.getInt64Ty())), b.getInt8PtrTy()); }));
+
+    // Memory: loads chase a pointer to itself, stores write to distinct slots of the environment.
+    result.push_back({ "load", ptr, 0, 0, [](IRBuilder<> &b, Value *acc, Value *, Value *, unsigned) {
+      Type *ptr_type{ b.getInt8PtrTy() };
+      return b.CreateLoad(ptr_type, b.CreateBitCast(acc, PointerType::getUnqual(ptr_type))); } });
+    result.push_back({ "store", i64, 0, 0, [](IRBuilder<> &b, Value *acc, Value *, Value *env, unsigned slot) {
+      b.CreateStore(acc, b.CreateConstGEP1_64(b.getInt64Ty(), env, slot));
+      return acc; } });
+    result.push_back({ "getelementptr", ptr, 0, 0, [](IRBuilder<> &b, Value *acc, Value *, Value *, unsigned) {
+      return b.CreateGEP(b.getInt8Ty(), acc, b.getInt64(0)); } });
+
+    // Synchronization: atomic adds to distinct slots (the old value feeds the chain), and fences.
+    result.push_back({ "atomicrmw", i64, 0, 0, [](IRBuilder<> &b, Value *acc, Value *, Value *env, unsigned slot) {
+      return b.CreateAtomicRMW(AtomicRMWInst::Add, b.CreateConstGEP1_64(b.getInt64Ty(), env, slot), acc, Align{ 8 },
+                               AtomicOrdering::SequentiallyConsistent); } });
+    result.push_back({ "fence", i64, 0, 0, [](IRBuilder<> &b, Value *acc, Value *, Value *, unsigned) {
+      b.CreateFence(AtomicOrdering::SequentiallyConsistent);
+      return acc; } });
+    return result;
+  }
+} // namespace
+
+int main(int argc, char *argv[])
+{
+  InitializeNativeTarget();
+  InitializeNativeTargetAsmPrinter();
+
+  auto context{ make_unique<LLVMContext>() };
+  auto module{ make_unique<Module>("opcode_calibration", *context) };
+  vector<Kernel> all{ kernels() };
+  vector<vector<pair<string, string>>> keys{};
+  build_kernel(*module, "baseline", nullptr, 0, 0);
+  for (size_t k = 0; k < all.size(); ++k) {
+    keys.push_back(build_kernel(*module, "latency" + to_string(k), &all[k], 1, latency_steps));
+    build_kernel(*module, "throughput" + to_string(k), &all[k], throughput_streams, throughput_steps);
+  }
+  if (verifyModule(*module, &errs())) return 1;
+
+  auto jit{ orc::LLJITBuilder().create() };
+  if (!jit) {
+    errs() << "Error: Unable to create the JIT: " << toString(jit.takeError()) << '\n';
+    return 1;
+  }
+  // frem is lowered to calls to fmod/fmodf.
+  (*jit)->getMainJITDylib().addGenerator(cantFail(orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+    (*jit)->getDataLayout().getGlobalPrefix())));
+  if (auto error{ (*jit)->addIRModule(orc::ThreadSafeModule{ std::move(module), std::move(context) }) }) {
+    errs() << "Error: Unable to compile the kernels: " << toString(std::move(error)) << '\n';
+    return 1;
+  }
+  auto kernel_fn = [&](const string &name) {
+    return reinterpret_cast<Kernel_fn>(cantFail((*jit)->lookup(name)).getAddress());
+  };
+
+  vector<uint64_t> env(env_slots, 0);
+  double baseline{ time_kernel(kernel_fn("baseline"), env.data()) };
+  map<pair<string, string>, Opcode_cost> costs{};
+  for (size_t k = 0; k < all.size(); ++k) {
+    auto measure = [&](const string &name, unsigned ops) {
+      env[0] = all[k].operand;
+      env[1] = all[k].name == "load" ? reinterpret_cast<uint64_t>(&env[1]) : all[k].initial; // Points to itself.
+      double cycles{ time_kernel(kernel_fn(name), env.data()) - baseline };
+      return max(0.0, cycles / (iterations * ops * keys[k].size()));
+    };
+    double latency{ measure("latency" + to_string(k), latency_steps) };
+    double throughput{ measure("throughput" + to_string(k), throughput_streams * throughput_steps) };
+    for (auto &key : keys[k]) costs[key] = { latency, throughput };
+  }
+
+  // rdtscp counts reference cycles, which differ from core cycles when the core runs at another frequency. Scale them
+  // by the latency of a 64-bit add, a single core cycle on every x86 core.
+  auto add{ costs.find({ "add", "i64" }) };
+  double scale{ add != costs.end() && add->second.latency > 0 ? 1 / add->second.latency : 1 };
+  for (auto &[_, cost] : costs) {
+    cost.latency *= scale;
+    cost.throughput *= scale;
+  }
+
+  ofstream file{};
+  if (argc > 1) file.open(argv[1]);
+  ostream &output{ argc > 1 ? file : cout };
+  output << "# Opcode costs in core cycles, calibrated by opcode_calibration\n"
+         << "opcode,type,latency,throughput\n";
+  for (auto &[key, cost] : costs) {
+    // The latency of a pointer chase and the throughput of stores hold for any type loaded or stored.
+    bool any_type{ key.first == "load" || key.first == "store" };
+    output << key.first << ',' << (any_type ? "*" : key.second) << ',' << cost.latency << ',' << cost.throughput << '\n';
+  }
+  return 0;
+}
@@ -0,0 +1,241 @@
+/*
+  This file is distributed under the University of Illinois Open Source
+  License. See LICENSE for details.
+*/
+
+// Fits non-negative per-opcode cycle weights to measured block cycles, writing a table for EstimateCostPass
+// (-calibrated-costs). The inputs are the merged histogram + cycles YAML of runtime-generalization/merge_analysis.py.
+// Usage: opcode_fit [-folds N] [-lambdas L,...] [-o output.csv] merged.yaml...
+
+#include <llvm/IR/Instruction.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/LineIterator.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace llvm;
+
+cl::list<std::string> arg_inputs(cl::Positional, cl::OneOrMore, cl::desc("<merged yaml files>"));
+
+cl::opt<std::string> arg_output("o", cl::init("-"), cl::desc("Output cost table"), cl::value_desc("filename"));
+
+cl::opt<unsigned> arg_folds("folds", cl::init(5), cl::desc("Number of cross-validation folds"));
+
+cl::opt<std::string> arg_lambdas(
+  "lambdas",
+  cl::init("0,0.01,0.1,1,10"),
+  cl::desc("Ridge penalties tried by cross-validation, per training block"),
+  cl::value_desc("lambda,...")
+);
+
+cl::opt<unsigned> arg_iterations(
+  "iterations", cl::init(1000), cl::desc("Maximum coordinate descent sweeps of the NNLS solver"));
+
+namespace {
+  constexpr unsigned num_opcodes{ Instruction::OtherOpsEnd }; // Opcodes start at 1, column 0 stays empty.
+  constexpr unsigned batch_rows{ 256 };
+
+  // Normal equations of a fold: gram = X^T X, moment = X^T y.
+  struct Normal_equations {
+    vector<double> gram = vector<double>(num_opcodes * num_opcodes, 0);
+    vector<double> moment = vector<double>(num_opcodes, 0);
+    double squares{ 0 }; // y^T y.
+    size_t rows{ 0 };
+
+    Normal_equations &operator+=(const Normal_equations &other) {
+      for (size_t i = 0; i < gram.size(); ++i) gram[i] += other.gram[i];
+      for (size_t i = 0; i < moment.size(); ++i) moment[i] += other.moment[i];
+      squares += other.squares;
+      rows += other.rows;
+      return *this;
+    }
+  };
+
+  // Rows are buffered and added to the Gram matrix in batches: each entry of the (small) Gram matrix is then updated
+  // with a contiguous dot product over the batch instead of once per row.
+  struct Fold_accumulator {
+    Normal_equations equations{};
+    vector<double> batch = vector<double>(num_opcodes * batch_rows, 0); // Opcode major: batch[opcode * batch_rows + row].
+    vector<double> cycles = vector<double>(batch_rows, 0);
+    unsigned size{ 0 };
+
+    void add(const vector<double> &counts, double y) {
+      for (unsigned opcode = 0; opcode < num_opcodes; ++opcode) batch[opcode * batch_rows + size] = counts[opcode];
+      cycles[size++] = y;
+      if (size == batch_rows) flush();
+    }
+
+    void flush() {
+      for (unsigned i = 0; i < num_opcodes; ++i) {
+        const double *col_i{ &batch[i * batch_rows] };
+        double moment{ 0 };
+        for (unsigned row = 0; row < size; ++row) moment += col_i[row] * cycles[row];
+        equations.moment[i] += moment;
+        for (unsigned j = i; j < num_opcodes; ++j) {
+          const double *col_j{ &batch[j * batch_rows] };
+          double dot{ 0 };
+          for (unsigned row = 0; row < size; ++row) dot += col_i[row] * col_j[row];
+          equations.gram[i * num_opcodes + j] += dot;
+          if (j != i) equations.gram[j * num_opcodes + i] += dot;
+        }
+      }
+      for (unsigned row = 0; row < size; ++row) equations.squares += cycles[row] * cycles[row];
+      equations.rows += size;
+      size = 0;
+    }
+  };
+
+  /* Merged YAML reader.
+    The merged file is read line by line: a block's fields (Cycles, ID, OpCodes) come in any order, so a block is
+    complete when the next one starts. Blocks that never ran (0 cycles) are skipped, as in kmeans.py.
+  *********************************************************************************************************************/
+  bool read_blocks(StringRef path, vector<Fold_accumulator> &folds, size_t &blocks)
+  {
+    auto buffer{ MemoryBuffer::getFile(path) };
+    if (!buffer) {
+      errs() << "Error: Unable to read [" << path << "]: " << buffer.getError().message() << '\n';
+      return false;
+    }
+    vector<double> counts(num_opcodes, 0);
+    double cycles{ 0 };
+    bool in_block{ false }, in_opcodes{ false };
+    auto finish_block = [&]() {
+      if (in_block && cycles > 0) folds[blocks++ % folds.size()].add(counts, cycles);
+      fill(counts.begin(), counts.end(), 0);
+      cycles = 0;
+      in_block = in_opcodes = false;
+    };
+    for (line_iterator line{ **buffer, true }; !line.is_at_eof(); ++line) {
+      StringRef entry{ line->ltrim() };
+      bool item{ entry.consume_front("-") };
+      entry = entry.ltrim();
+      auto [key, value] = entry.split(':');
+      value = value.trim();
+      if (key == "BasicBlock" || key == "Function") {
+        finish_block();
+        in_block = key == "BasicBlock";
+      } else if (!in_block) {
+        continue;
+      } else if (key == "OpCodes") {
+        in_opcodes = true;
+      } else if (item && in_opcodes) {
+        unsigned opcode{ 0 };
+        double count{ 0 };
+        if (!key.trim().getAsInteger(10, opcode) && opcode < num_opcodes && !value.getAsDouble(count))
+          counts[opcode] += count;
+      } else {
+        in_opcodes = false;
+        if (key == "Cycles") value.getAsDouble(cycles);
+      }
+    }
+    finish_block();
+    return true;
+  }
+
+  // Non-negative ridge regression: minimize |Xw - y|^2 + lambda |w|^2 subject to w >= 0, solved on the normal
+  // equations by projected coordinate descent.
+  vector<double> solve_nnls(const Normal_equations &eq, double lambda)
+  {
+    vector<double> weights(num_opcodes, 0);
+    vector<double> gradient(eq.moment.size()); // (G + lambda I) w - b, kept up to date.
+    for (unsigned i = 0; i < num_opcodes; ++i) gradient[i] = -eq.moment[i];
+    for (unsigned sweep = 0; sweep < arg_iterations; ++sweep) {
+      double change{ 0 };
+      for (unsigned i = 0; i < num_opcodes; ++i) {
+        double diagonal{ eq.gram[i * num_opcodes + i] + lambda };
+        if (diagonal <= 0) continue; // Opcode never seen.
+        double updated{ max(0.0, weights[i] - gradient[i] / diagonal) };
+        double delta{ updated - weights[i] };
+        if (delta == 0) continue;
+        weights[i] = updated;
+        for (unsigned j = 0; j < num_opcodes; ++j) gradient[j] += delta * eq.gram[j * num_opcodes + i];
+        gradient[i] += delta * lambda;
+        change = max(change, fabs(delta) * diagonal);
+      }
+      if (change < 1e-9 * max(1.0, eq.squares)) break;
+    }
+    return weights;
+  }
+
+  // Sum of squared errors of <weights> on the rows of <eq>: y^T y - 2 w^T b + w^T G w.
+  double squared_error(const Normal_equations &eq, const vector<double> &weights)
+  {
+    double error{ eq.squares };
+    for (unsigned i = 0; i < num_opcodes; ++i) {
+      if (weights[i] == 0) continue;
+      double gw{ 0 };
+      for (unsigned j = 0; j < num_opcodes; ++j) gw += eq.gram[i * num_opcodes + j] * weights[j];
+      error += weights[i] * (gw - 2 * eq.moment[i]);
+    }
+    return max(0.0, error);
+  }
+} // namespace
+
+int main(int argc, char *argv[])
+{
+  cl::ParseCommandLineOptions(argc, argv, "Fit per-opcode cycle weights to measured block cycles\n");
+  vector<Fold_accumulator> folds(max(2u, arg_folds.getValue()));
+  size_t blocks{ 0 };
+  for (const string &input : arg_inputs)
+    if (!read_blocks(input, folds, blocks)) return 1;
+  Normal_equations all{};
+  for (Fold_accumulator &fold : folds) {
+    fold.flush();
+    all += fold.equations;
+  }
+  if (blocks < folds.size()) {
+    errs() << "Error: Only " << blocks << " blocks with cycles, need at least " << folds.size() << '\n';
+    return 1;
+  }
+
+  // Pick the penalty with the lowest cross-validated error. Training on all folds but one is the total minus that fold.
+  double best_lambda{ 0 }, best_rmse{ HUGE_VAL };
+  stringstream lambdas{ arg_lambdas };
+  string lambda_str{};
+  while (getline(lambdas, lambda_str, ',')) {
+    double lambda{ 0 };
+    if (StringRef{ lambda_str }.trim().getAsDouble(lambda) || lambda < 0) {
+      errs() << "Invalid lambda [" << lambda_str << "]\n";
+      continue;
+    }
+    double error{ 0 };
+    for (Fold_accumulator &fold : folds) {
+      Normal_equations training{ all };
+      for (size_t i = 0; i < training.gram.size(); ++i) training.gram[i] -= fold.equations.gram[i];
+      for (size_t i = 0; i < training.moment.size(); ++i) training.moment[i] -= fold.equations.moment[i];
+      training.squares -= fold.equations.squares;
+      training.rows -= fold.equations.rows;
+      error += squared_error(fold.equations, solve_nnls(training, lambda * training.rows));
+    }
+    double rmse{ sqrt(error / blocks) };
+    errs() << "lambda " << lambda << ": cross-validated RMSE " << rmse << " cycles\n";
+    if (rmse < best_rmse) {
+      best_rmse = rmse;
+      best_lambda = lambda;
+    }
+  }
+  vector<double> weights{ solve_nnls(all, best_lambda * all.rows) };
+  errs() << "Fitted " << blocks << " blocks with lambda " << best_lambda << ", training RMSE "
+         << sqrt(squared_error(all, weights) / blocks) << " cycles\n";
+
+  ofstream file{};
+  if (arg_output != "-") file.open(arg_output);
+  ostream &output{ arg_output != "-" ? file : cout };
+  output << "# Per-opcode cycle weights fitted by opcode_fit (lambda " << best_lambda << ", " << folds.size()
+         << "-fold RMSE " << best_rmse << ")\n"
+         << "opcode,type,latency,throughput\n";
+  for (unsigned opcode = 1; opcode < num_opcodes; ++opcode) {
+    if (all.gram[opcode * num_opcodes + opcode] == 0) continue; // Not in the data: leave it to the fallback kind.
+    output << Instruction::getOpcodeName(opcode) << ",*," << weights[opcode] << ',' << weights[opcode] << '\n';
+  }
+  return 0;
+}
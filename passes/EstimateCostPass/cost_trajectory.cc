@@ -0,0 +1,272 @@
+/*
+  This file is distributed under the University of Illinois Open Source
+  License. See LICENSE for details.
+*/
+
+#include <llvm/ADT/Hashing.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Analysis/CGSCCPassManager.h>
+#include <llvm/Analysis/LazyCallGraph.h>
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/MC/TargetRegistry.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Support/Format.h>
+
+#include <algorithm>
+#include <functional>
+
+#include "../WuLarus/A2.Block_edge_frequency/block_edge_frequency_pass.hh"
+#include "cost_trajectory.hh"
+
+namespace {
+  llvm::Module *unit_module(const llvm::Any &ir)
+  {
+    if (llvm::any_isa<const llvm::Module *>(ir))
+      return const_cast<llvm::Module *>(llvm::any_cast<const llvm::Module *>(ir));
+    if (llvm::any_isa<const llvm::Function *>(ir))
+      return const_cast<llvm::Function *>(llvm::any_cast<const llvm::Function *>(ir))->getParent();
+    if (llvm::any_isa<const llvm::Loop *>(ir))
+      return llvm::any_cast<const llvm::Loop *>(ir)->getHeader()->getParent()->getParent();
+    if (llvm::any_isa<const llvm::LazyCallGraph::SCC *>(ir))
+      return llvm::any_cast<const llvm::LazyCallGraph::SCC *>(ir)->begin()->getFunction().getParent();
+    return nullptr;
+  }
+
+  // Pass managers, adaptors and wrappers: the passes they run are reported on their own.
+  bool is_container(llvm::StringRef pass)
+  {
+    return llvm::isSpecialPass(pass, { "PassManager", "PassAdaptor", "AnalysisManagerProxy", "DevirtSCCRepeatedPass",
+                                       "ModuleInlinerWrapperPass" });
+  }
+
+  // Passes that don't transform the IR, which opt adds around the pipeline.
+  bool is_ignored(llvm::StringRef pass)
+  {
+    return pass == "VerifierPass" || pass == "PrintModulePass" || pass == "BitcodeWriterPass" || pass == "EstimateCostPass";
+  }
+} // namespace
+
+void Cost_trajectory::register_callbacks(llvm::PassInstrumentationCallbacks &callbacks)
+{
+  callbacks_ = &callbacks;
+  callbacks.registerBeforeNonSkippedPassCallback([this](llvm::StringRef pass, llvm::Any ir) { before_pass(pass, ir); });
+  callbacks.registerAfterPassCallback(
+    [this](llvm::StringRef pass, llvm::Any ir, const llvm::PreservedAnalyses &preserved) { after_pass(pass, &ir, preserved); });
+  callbacks.registerAfterPassInvalidatedCallback(
+    [this](llvm::StringRef pass, const llvm::PreservedAnalyses &preserved) { after_pass(pass, nullptr, preserved); });
+}
+
+/* Pass boundaries.
+  A row is written when a module level pass that isn't a pass manager ends (a module pass, or the adaptor running
+  function, loop or CGSCC passes on every function) inside no other such pass. It is named after the passes run in it.
+***********************************************************************************************************************/
+void Cost_trajectory::before_pass(llvm::StringRef pass, llvm::Any ir)
+{
+  if (!module_ && (module_ = unit_module(ir))) {
+    unsigned estimated{ update() };
+    cost_ = total_cost();
+    write_row("input", cost_, estimated);
+  }
+  bool boundary{ llvm::any_isa<const llvm::Module *>(ir) && !pass.contains("PassManager")
+                 && !pass.contains("AnalysisManagerProxy") };
+  if (boundary && std::find(boundaries_.begin(), boundaries_.end(), true) == boundaries_.end()) inner_passes_.clear();
+  boundaries_.push_back(boundary);
+}
+
+void Cost_trajectory::after_pass(llvm::StringRef pass, const llvm::Any *ir, const llvm::PreservedAnalyses &preserved)
+{
+  if (boundaries_.empty()) return;
+  bool boundary{ boundaries_.back() };
+  boundaries_.pop_back();
+  bool container{ is_container(pass) };
+  if (!preserved.areAllPreserved()) {
+    if (!ir) module_changed_ = true; // The unit is gone: a loop or an SCC deleted, or a function.
+    else if (llvm::any_isa<const llvm::Function *>(*ir))
+      changed_.insert(const_cast<llvm::Function *>(llvm::any_cast<const llvm::Function *>(*ir)));
+    else if (llvm::any_isa<const llvm::Loop *>(*ir))
+      changed_.insert(llvm::any_cast<const llvm::Loop *>(*ir)->getHeader()->getParent());
+    else if (llvm::any_isa<const llvm::LazyCallGraph::SCC *>(*ir))
+      for (llvm::LazyCallGraph::Node &node : *llvm::any_cast<const llvm::LazyCallGraph::SCC *>(*ir))
+        changed_.insert(&node.getFunction());
+    else if (!container) module_changed_ = true;
+  }
+  if (!container) {
+    llvm::StringRef name{ callbacks_->getPassNameForClassName(pass) };
+    std::string pass_name{ name.empty() ? pass.str() : name.str() };
+    if (std::find(inner_passes_.begin(), inner_passes_.end(), pass_name) == inner_passes_.end())
+      inner_passes_.push_back(pass_name);
+  }
+  if (!boundary || !module_ || is_ignored(pass)
+      || std::find(boundaries_.begin(), boundaries_.end(), true) != boundaries_.end())
+    return;
+  unsigned estimated{ update() };
+  double cost{ total_cost() };
+  write_row(inner_passes_.empty() ? pass.str() : llvm::join(inner_passes_, ","), cost, estimated);
+  cost_ = cost;
+}
+
+/* Estimates.
+***********************************************************************************************************************/
+// Estimate the functions changed since the last update, new functions included. Returns how many there were.
+unsigned Cost_trajectory::update()
+{
+  llvm::SmallPtrSet<llvm::Function *, 32> present{};
+  llvm::SmallPtrSet<llvm::Function *, 16> vanished{}; // Deleted, or replaced by a function allocated at their address.
+  std::vector<llvm::Function *> stale{};
+  for (llvm::Function &fun : *module_) {
+    if (fun.isDeclaration()) continue;
+    present.insert(&fun);
+    auto found{ costs_.find(&fun) };
+    if (found != costs_.end() && found->second.name != fun.getName()) vanished.insert(&fun);
+    if (found == costs_.end() || found->second.name != fun.getName() || changed_.count(&fun)
+        || (module_changed_ && found->second.fingerprint != fingerprint(fun)))
+      stale.push_back(&fun);
+  }
+  for (auto &[fun, _] : costs_)
+    if (!present.count(fun)) vanished.insert(fun);
+  for (llvm::Function *fun : vanished)
+    if (!present.count(fun)) costs_.erase(fun);
+  // The callers of a vanished function keep its pointer in their calls: estimate them again, whatever their
+  // fingerprint, so that the calls redirected elsewhere (mergefunc, the inliner) are followed.
+  if (!vanished.empty()) {
+    llvm::SmallPtrSet<llvm::Function *, 32> listed{ stale.begin(), stale.end() };
+    for (llvm::Function &fun : *module_) {
+      auto found{ costs_.find(&fun) };
+      if (found == costs_.end() || listed.count(&fun)) continue;
+      for (auto &[callee, _] : found->second.calls)
+        if (vanished.count(callee)) {
+          stale.push_back(&fun);
+          break;
+        }
+    }
+  }
+  changed_.clear();
+  module_changed_ = false;
+  if (stale.empty()) return 0;
+
+  // The functions' own analyses, fresh: the pipeline's managers aren't reachable from the callbacks.
+  if (!tm_) {
+    std::string error{};
+    if (const llvm::Target *target{ llvm::TargetRegistry::lookupTarget(module_->getTargetTriple(), error) })
+      tm_.reset(target->createTargetMachine(module_->getTargetTriple(), "", "", llvm::TargetOptions{}, llvm::None));
+  }
+  llvm::PassBuilder pb{ tm_.get() };
+  llvm::LoopAnalysisManager lam{};
+  llvm::FunctionAnalysisManager fam{};
+  llvm::CGSCCAnalysisManager cgam{};
+  llvm::ModuleAnalysisManager mam{};
+  fam.registerPass([] { return BranchPredictionPass(); });
+  fam.registerPass([] { return BlockEdgeFrequencyPass(); });
+  pb.registerModuleAnalyses(mam);
+  pb.registerCGSCCAnalyses(cgam);
+  pb.registerFunctionAnalyses(fam);
+  pb.registerLoopAnalyses(lam);
+  pb.crossRegisterProxies(lam, fam, cgam, mam);
+  for (llvm::Function *fun : stale) {
+    BlockEdgeFrequencyPass &freqs{ fam.getResult<BlockEdgeFrequencyPass>(*fun) };
+    llvm::TargetTransformInfo &tti{ fam.getResult<llvm::TargetIRAnalysis>(*fun) };
+    Function_cost cost{ fun->getName().str(), fingerprint(*fun), 0 };
+    for (llvm::BasicBlock &bb : *fun) {
+      double freq{ freqs.getBlockFrequency(&bb) };
+      for (llvm::Instruction &instr : bb) {
+        double instr_cost{ 1 };
+        if (kind_) {
+          auto tti_cost{ tti.getInstructionCost(&instr, *kind_).getValue() };
+          instr_cost = tti_cost.hasValue() ? static_cast<double>(tti_cost.getValue()) : 0;
+        }
+        cost.cost += freq * instr_cost;
+        if (auto *call{ llvm::dyn_cast<llvm::CallInst>(&instr) })
+          if (llvm::Function *callee{ call->getCalledFunction() }; callee && !callee->isDeclaration())
+            cost.calls[callee] += freq;
+      }
+    }
+    costs_[fun] = std::move(cost);
+  }
+  return stale.size();
+}
+
+// Sum of the function costs times their invocations: main runs once (or, without main, each function no other calls),
+// and calls are followed in reverse post order from there, skipping the calls back to a function being visited.
+double Cost_trajectory::total_cost()
+{
+  std::vector<llvm::Function *> roots{};
+  llvm::Function *main{ module_->getFunction("main") };
+  if (main && costs_.count(main)) {
+    roots.push_back(main);
+  } else {
+    llvm::SmallPtrSet<llvm::Function *, 32> called{};
+    for (auto &[fun, cost] : costs_)
+      for (auto &[callee, _] : cost.calls)
+        if (callee != fun) called.insert(callee);
+    for (llvm::Function &fun : *module_)
+      if (costs_.count(&fun) && !called.count(&fun)) roots.push_back(&fun);
+  }
+
+  std::vector<llvm::Function *> post_order{};
+  llvm::SmallPtrSet<llvm::Function *, 32> visited{};
+  std::function<void(llvm::Function *)> visit = [&](llvm::Function *fun) {
+    visited.insert(fun);
+    for (auto &[callee, _] : costs_[fun].calls)
+      if (costs_.count(callee) && !visited.count(callee)) visit(callee);
+    post_order.push_back(fun);
+  };
+  for (llvm::Function *root : roots)
+    if (!visited.count(root)) visit(root);
+
+  llvm::DenseMap<llvm::Function *, unsigned> position{};
+  for (unsigned i = 0; i < post_order.size(); ++i) position[post_order[i]] = post_order.size() - i;
+  llvm::DenseMap<llvm::Function *, double> invocations{};
+  for (llvm::Function *root : roots) invocations[root] = 1;
+  double total{ 0 };
+  for (auto fun{ post_order.rbegin() }; fun != post_order.rend(); ++fun) {
+    Function_cost &cost{ costs_[*fun] };
+    double runs{ invocations[*fun] };
+    total += runs * cost.cost;
+    for (auto &[callee, calls] : cost.calls) {
+      auto found{ position.find(callee) };
+      if (found != position.end() && found->second > position[*fun]) invocations[callee] += runs * calls;
+    }
+  }
+  return total;
+}
+
+// Cheap hash of the instructions of <fun> (opcodes, types, operand kinds, integer constants and the names of the global
+// values used, callees included), to tell the functions a module pass changed.
+uint64_t Cost_trajectory::fingerprint(llvm::Function &fun)
+{
+  llvm::hash_code hash{ llvm::hash_value(fun.size()) };
+  for (llvm::BasicBlock &bb : fun) {
+    for (llvm::Instruction &instr : bb) {
+      hash = llvm::hash_combine(hash, instr.getOpcode(), instr.getType(), instr.getNumOperands());
+      for (llvm::Value *operand : instr.operands()) {
+        hash = llvm::hash_combine(hash, operand->getValueID());
+        if (auto *constant{ llvm::dyn_cast<llvm::ConstantInt>(operand) })
+          hash = llvm::hash_combine(hash, constant->getValue());
+        else if (auto *global{ llvm::dyn_cast<llvm::GlobalValue>(operand) })
+          hash = llvm::hash_combine(hash, global->getName());
+      }
+    }
+  }
+  return hash;
+}
+
+void Cost_trajectory::write_row(const std::string &pass, double cost, unsigned estimated)
+{
+  if (!output_) {
+    std::error_code error{};
+    output_ = std::make_unique<llvm::raw_fd_ostream>(path_, error);
+    if (error) {
+      llvm::errs() << "Error: Unable to open file [" << path_ << "] for writing: " << error.message() << '\n';
+      output_.reset();
+      module_ = nullptr; // Stop tracking.
+      return;
+    }
+    *output_ << "step,pass,functions_estimated,cost,delta,delta_percent\n";
+  }
+  double delta{ step_ ? cost - cost_ : 0 };
+  *output_ << step_++ << ",\"" << pass << "\"," << estimated << ',' << llvm::format("%e", cost) << ','
+           << llvm::format("%e", delta) << ',' << llvm::format("%.3f", cost_ ? 100 * delta / cost_ : 0.0) << '\n';
+  output_->flush();
+}
@@ -0,0 +1,63 @@
+/*
+  This file is distributed under the University of Illinois Open Source
+  License. See LICENSE for details.
+*/
+
+#pragma once
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/Optional.h>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/Analysis/TargetTransformInfo.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/PassInstrumentation.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Target/TargetMachine.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Cost of the module after each pass of the pipeline it is optimized with, written as a CSV of deltas (one row per
+// pass of the top level pipeline). A fast estimate, kept up to date incrementally: only the functions a pass changed
+// are estimated again, each on its own (Wu-Larus local block frequencies times static instruction costs); invocation
+// frequencies are then propagated along the calls, from main, without following recursive calls.
+class Cost_trajectory {
+public:
+  // Instruction costs of TTI kind <kind>, or 1 per instruction without one.
+  Cost_trajectory(std::string path, llvm::Optional<llvm::TargetTransformInfo::TargetCostKind> kind)
+    : path_{ std::move(path) }, kind_{ kind } {}
+
+  void register_callbacks(llvm::PassInstrumentationCallbacks &callbacks);
+
+private:
+  struct Function_cost {
+    std::string name; // Detects a function allocated where a deleted one was.
+    uint64_t fingerprint;
+    double cost; // Per invocation.
+    std::map<llvm::Function *, double> calls{}; // Per invocation.
+  };
+
+  void before_pass(llvm::StringRef pass, llvm::Any ir);
+  void after_pass(llvm::StringRef pass, const llvm::Any *ir, const llvm::PreservedAnalyses &preserved);
+  unsigned update();
+  double total_cost();
+  void write_row(const std::string &pass, double cost, unsigned estimated);
+  static uint64_t fingerprint(llvm::Function &fun);
+
+  std::string path_;
+  llvm::Optional<llvm::TargetTransformInfo::TargetCostKind> kind_;
+  llvm::PassInstrumentationCallbacks *callbacks_{ nullptr };
+  std::unique_ptr<llvm::raw_fd_ostream> output_{};
+  std::unique_ptr<llvm::TargetMachine> tm_{};
+  llvm::Module *module_{ nullptr };
+  std::vector<bool> boundaries_{}; // Per pass running, outermost first: whether it ends a row.
+  std::vector<std::string> inner_passes_{}; // Passes run in the current row.
+  llvm::SmallPtrSet<llvm::Function *, 16> changed_{};
+  bool module_changed_{ false }; // A module pass changed the IR: compare fingerprints to find the functions.
+  llvm::DenseMap<llvm::Function *, Function_cost> costs_{};
+  double cost_{ 0 };
+  unsigned step_{ 0 };
+};
@@ -0,0 +1,165 @@
+/*
+  This file is distributed under the University of Illinois Open Source
+  License. See LICENSE for details.
+*/
+
+#pragma once
+
+// EstimateCostPass, declared apart from pass.cc so the standalone tools (tools/) can run it in process.
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Analysis/PostDominators.h>
+#include <llvm/Analysis/TargetTransformInfo.h>
+#include <llvm/IR/BasicBlock.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instruction.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/PassManager.h>
+
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../WuLarus/A3.Function_call_frequency/function_call_frequency_pass.hh"
+#include "binary_output.hh"
+#include "calibrated_cost.hh"
+#include "icache_cost.hh"
+#include "ilp_cost.hh"
+#include "kmeans_cost.hh"
+#include "libcall_cost.hh"
+#include "mca_cost.hh"
+#include "memory_cost.hh"
+#include "runtime_profile.hh"
+#include "target_cost.hh"
+#include "tier_errors.hh"
+
+enum class Report_granularity { program, function, loop, block };
+
+enum class Cost_option {
+  latency, recipthroughput, codesize, sizeandlatency, one, dynamic, mca, criticalpath, memory, calibrated, kmeans,
+};
+
+// Costs charged on top of the per-instruction costs.
+enum class Cost_component {
+  misprediction, icache, libcall,
+};
+
+bool parse_cost_option(llvm::StringRef name, Cost_option &cost);
+const char *cost_name(Cost_option cost);
+const char *component_name(Cost_component component);
+// Whether <cost> is one of the TTI cost kinds, and which.
+bool is_llvm_cost(Cost_option cost);
+llvm::TargetTransformInfo::TargetCostKind cost_opt_to_tti_cost(Cost_option cost);
+// The valid cost kinds of -prediction-cost-kind, in Cost_option order (the order of the estimates).
+std::vector<Cost_option> selected_cost_options();
+// The first valid kind of -prediction-cost-kind in command line order. Returns false if there is none.
+bool first_cost_option(Cost_option &cost);
+
+struct EstimateCostPass : public llvm::PassInfoMixin<EstimateCostPass> {
+  llvm::PreservedAnalyses run(llvm::Module &, llvm::ModuleAnalysisManager &);
+
+  // Costs of a module for the cost kinds selected on the command line, computed as run() does without writing any
+  // output. The analysis manager must have the Wu-Larus analyses registered.
+  struct Estimate {
+    std::map<Cost_option, double> totals{};
+    std::map<Cost_option, std::vector<std::pair<std::string, double>>> functions{}; // With <per_function> only.
+    std::map<Cost_option, double> sampling_errors{}; // Fast tier only: two standard deviations of the totals.
+  };
+  Estimate estimate(llvm::Module &, llvm::ModuleAnalysisManager &, bool per_function = false);
+  // The tables of the binary output, -freqs and cost files respectively, for in-process consumers.
+  Binary_output::File frequency_tables(llvm::Module &, llvm::ModuleAnalysisManager &);
+  Binary_output::File cost_tables(llvm::Module &, llvm::ModuleAnalysisManager &);
+
+private:
+  void init(llvm::Module &, llvm::ModuleAnalysisManager &);
+  void select_costs();
+  void print_freqs(llvm::Module &);
+  void compute_cost(llvm::Module &);
+  void compute_sampled_cost(llvm::Module &);
+  void compute_cost(llvm::Function &);
+  void compute_function_cost(llvm::Function &, llvm::TargetTransformInfo *);
+  void compute_cost(llvm::BasicBlock &, uint64_t, llvm::TargetTransformInfo *);
+  double block_cost(llvm::BasicBlock &, uint64_t, Cost_option, llvm::TargetTransformInfo *);
+  double misprediction_cost(llvm::BasicBlock &, double);
+  double memory_cost(llvm::BasicBlock &);
+  double libcall_cost(llvm::BasicBlock &);
+  double instruction_cost(llvm::Instruction &, Cost_option, llvm::TargetTransformInfo *);
+  void warn_uncalibrated();
+  void attribute_lines(llvm::BasicBlock &, Cost_option, size_t, double, llvm::TargetTransformInfo *);
+  std::vector<double> inclusive_cost(llvm::Function *, std::map<llvm::Function *, std::vector<double>> &,
+                                     std::set<llvm::Function *> &);
+  std::vector<double> self_cost(llvm::Function *);
+  void generate_callgrind();
+  void generate_folded_stacks();
+  void compute_target_costs(llvm::Module &);
+  void generate_yaml();
+  void generate_report(Cost_option, double);
+  void generate_linear_models_yaml();
+  void generate_freqs_yaml();
+  void generate_budget_yaml();
+  Binary_output::File freqs_binary();
+  Binary_output::File costs_binary();
+  void write_binary(const Binary_output::File &);
+
+  std::map<Cost_option, std::map<llvm::Function *, double>> costs_{};
+  std::map<Cost_component, std::map<llvm::Function *, double>> components_{};
+  std::map<Cost_option, double> sampling_errors_{}; // Fast tier, see compute_sampled_cost().
+  Report_granularity report_granularity_{ Report_granularity::program };
+  // Loop and block reports only, without components.
+  std::map<Cost_option, llvm::DenseMap<llvm::BasicBlock *, double>> block_costs_{};
+  // Source attribution (callgrind and folded stacks), without components. Costs are indexed like costs_.
+  bool attribute_lines_{ false };
+  std::map<llvm::Function *, std::map<std::pair<std::string, unsigned>, std::vector<double>>> line_costs_{};
+  struct Call_site {
+    llvm::Function *caller;
+    llvm::Function *callee;
+    std::pair<std::string, unsigned> line;
+    double calls;
+  };
+  std::vector<Call_site> call_sites_{};
+  std::map<llvm::Function *, std::map<llvm::Function *, double>> callees_{}; // Calls per invocation of the caller.
+  bool llvm_cost_selected_{ false };
+  Cost_option fallback_cost_{ Cost_option::latency };
+  // Tables read from files, shared by the passes of the process (see load_table() in pass.cc).
+  std::shared_ptr<const Runtime_profile> profile_{};
+  Mca_cost_model mca_{};
+  std::shared_ptr<const Calibrated_cost_table> calibrated_{};
+  std::shared_ptr<const Kmeans_model> kmeans_{};
+  bool kmeans_functions_{ false }; // Classify function histograms instead of block histograms.
+  bool calibrated_throughput_{ false };
+  std::set<std::pair<std::string, std::string>> uncalibrated_{}; // Opcodes and types costed by the fallback kind.
+  Mca_cost_model ilp_resources_{}; // Scheduling model resource bound of the criticalpath cost kind.
+  bool ilp_sched_bound_{ false };
+  struct Ilp_breakdown {
+    llvm::Function *fun;
+    uint64_t block_id;
+    double freq;
+    Ilp_block_cost cost;
+  };
+  std::vector<Ilp_breakdown> ilp_breakdown_{};
+  llvm::StringMap<double> cpu_misprediction_penalty_{};
+  double misprediction_penalty_{ 0 };
+  Icache_model icache_{};
+  struct Target_costs {
+    Target_cost_model model;
+    double misprediction_penalty;
+    double misprediction{ 0 };
+    std::map<Cost_option, double> totals{}; // TTI cost kinds only.
+  };
+  std::vector<Target_costs> targets_{};
+  std::shared_ptr<const Libcall_cost_table> libcalls_{};
+  struct Access_stats {
+    unsigned long count;
+    double cost;
+  };
+  std::map<Access_pattern, Access_stats> access_stats_{};
+
+  FunctionCallFrequencyPass *wu_larus_ = nullptr;
+  llvm::FunctionAnalysisManager *fam_;
+  llvm::Module *module_;
+};
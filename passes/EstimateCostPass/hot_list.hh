@@ -0,0 +1,54 @@
+/*
+  This file is distributed under the University of Illinois Open Source
+  License. See LICENSE for details.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// The <capacity> most costly items seen, kept in a min-heap so adding n items costs O(n log capacity) and the report
+// never holds more than <capacity> entries. A capacity of 0 keeps every item. Ties keep the item added first.
+template <typename T> class Hot_list {
+public:
+  explicit Hot_list(size_t capacity) : capacity_{ capacity } {}
+
+  void add(T item, double cost) {
+    Entry entry{ cost, order_++, std::move(item) };
+    if (capacity_ == 0 || heap_.size() < capacity_) {
+      heap_.push_back(std::move(entry));
+      std::push_heap(heap_.begin(), heap_.end(), hotter);
+    } else if (hotter(entry, heap_.front())) {
+      std::pop_heap(heap_.begin(), heap_.end(), hotter);
+      heap_.back() = std::move(entry);
+      std::push_heap(heap_.begin(), heap_.end(), hotter);
+    }
+  }
+
+  // The items and their costs, most costly first.
+  std::vector<std::pair<T, double>> sorted() const {
+    std::vector<Entry> entries{ heap_ };
+    std::sort(entries.begin(), entries.end(), hotter);
+    std::vector<std::pair<T, double>> items{};
+    items.reserve(entries.size());
+    for (Entry &entry : entries) items.emplace_back(std::move(entry.item), entry.cost);
+    return items;
+  }
+
+private:
+  struct Entry {
+    double cost;
+    uint64_t order;
+    T item;
+  };
+
+  // Heap order: the front is the least costly entry, the first evicted.
+  static bool hotter(const Entry &a, const Entry &b) { return a.cost != b.cost ? a.cost > b.cost : a.order < b.order; }
+
+  size_t capacity_;
+  uint64_t order_{ 0 };
+  std::vector<Entry> heap_{};
+};
@@ -0,0 +1,50 @@
+/*
+  This file is distributed under the University of Illinois Open Source
+  License. See LICENSE for details.
+*/
+
+#include <llvm/ADT/DenseMap.h>
+
+#include "icache_cost.hh"
+
+/* Instruction cache penalty.
+  The hot working set of a region is the code of its blocks executed at least hot_threshold times. A region whose
+  working set exceeds the L1 (L2) size is assumed to miss all of its lines on each iteration, each miss costing the L2
+  (memory) latency: cyclic accesses to a set larger than an LRU cache never hit. Each block is charged once, at the
+  innermost region containing it that does not fit: inner loops that fit only miss once per outer iteration.
+  Callees are not part of their callers' working set.
+***********************************************************************************************************************/
+double Icache_model::penalty(llvm::Function &fun, llvm::LoopInfo &loops, double invocations,
+                             const std::function<double(llvm::BasicBlock &)> &bytes,
+                             const std::function<double(llvm::BasicBlock &)> &global_freq) const
+{
+  llvm::DenseMap<const llvm::Loop *, double> loop_bytes{};
+  double function_bytes{ 0 };
+  llvm::DenseMap<const llvm::BasicBlock *, double> hot_bytes{};
+  for (llvm::BasicBlock &bb : fun) {
+    if (global_freq(bb) < hot_threshold) continue;
+    double size{ bytes(bb) };
+    hot_bytes[&bb] = size;
+    function_bytes += size;
+    for (const llvm::Loop *loop{ loops.getLoopFor(&bb) }; loop; loop = loop->getParentLoop())
+      loop_bytes[loop] += size;
+  }
+  auto miss_latency = [&](double working_set) {
+    return working_set > l2_size ? memory_latency : working_set > l1_size ? l2_latency : 0;
+  };
+
+  double penalty{ 0 };
+  for (auto &[bb, size] : hot_bytes) {
+    double latency{ 0 }, iterations{ 0 };
+    for (const llvm::Loop *loop{ loops.getLoopFor(bb) }; loop && latency == 0; loop = loop->getParentLoop()) {
+      latency = miss_latency(loop_bytes[loop]);
+      iterations = global_freq(*loop->getHeader());
+    }
+    if (latency == 0) {
+      latency = miss_latency(function_bytes);
+      iterations = invocations;
+    }
+    penalty += iterations * (size / line_size) * latency;
+  }
+  return penalty;
+}
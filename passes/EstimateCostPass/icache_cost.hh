@@ -0,0 +1,25 @@
+/*
+  This file is distributed under the University of Illinois Open Source
+  License. See LICENSE for details.
+*/
+
+#pragma once
+
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/IR/Function.h>
+
+#include <functional>
+
+// Instruction cache model: the hot code of a region (a loop or a whole function) is fetched again on every iteration
+// (or invocation) of that region when it does not fit in the cache.
+struct Icache_model {
+  double hot_threshold{ 1 }; // Blocks with a smaller global frequency are not part of the working set.
+  double l1_size{ 32 * 1024 }, l2_size{ 1024 * 1024 }, line_size{ 64 }; // Bytes.
+  double l2_latency{ 12 }, memory_latency{ 100 }; // Cycles to refill a line from L2 / from memory.
+
+  // Cycles lost to instruction cache misses over all invocations of <fun>, given each block's code size in bytes and
+  // global frequency.
+  double penalty(llvm::Function &fun, llvm::LoopInfo &loops, double invocations,
+                 const std::function<double(llvm::BasicBlock &)> &bytes,
+                 const std::function<double(llvm::BasicBlock &)> &global_freq) const;
+};
@@ -0,0 +1,54 @@
+/*
+  This file is distributed under the University of Illinois Open Source
+  License. See LICENSE for details.
+*/
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/IR/Instructions.h>
+
+#include <algorithm>
+
+#include "ilp_cost.hh"
+
+/* ILP-aware block cost.
+  The dependence DAG has an edge to each instruction from the operands defined in the same block, and memory edges
+  keeping the order of stores against every other memory access (loads may be reordered among themselves). Instructions
+  are visited in program order, which is a topological order of the DAG, so the critical path is computed in one pass.
+***********************************************************************************************************************/
+Ilp_block_cost compute_ilp_block_cost(llvm::BasicBlock &bb, llvm::TargetTransformInfo &tti, unsigned issue_width)
+{
+  auto instruction_cost = [&](llvm::Instruction &instr, llvm::TargetTransformInfo::TargetCostKind kind) -> double {
+    auto cost{ tti.getInstructionCost(&instr, kind).getValue() };
+    return cost.hasValue() ? static_cast<double>(cost.getValue()) : 0;
+  };
+
+  Ilp_block_cost result{};
+  llvm::DenseMap<const llvm::Instruction *, double> finish{}; // Instruction -> cycle its result is available.
+  double last_store{ 0 }; // Completion of the latest store (or call/fence writing memory).
+  double last_access{ 0 }; // Completion of the latest memory access of any kind.
+  double throughput{ 0 };
+  for (llvm::Instruction &instr : bb) {
+    double latency{ instruction_cost(instr, llvm::TargetTransformInfo::TCK_Latency) };
+    throughput += instruction_cost(instr, llvm::TargetTransformInfo::TCK_RecipThroughput);
+    result.latency += latency;
+
+    double start{ 0 };
+    if (!llvm::isa<llvm::PHINode>(instr)) { // Phi operands come from other blocks (or previous iterations).
+      for (llvm::Value *operand : instr.operands()) {
+        auto *def{ llvm::dyn_cast<llvm::Instruction>(operand) };
+        if (def && def->getParent() == &bb) start = std::max(start, finish.lookup(def));
+      }
+    }
+    bool writes{ instr.mayWriteToMemory() };
+    if (writes) start = std::max(start, last_access);
+    else if (instr.mayReadFromMemory()) start = std::max(start, last_store);
+
+    double end{ start + latency };
+    finish[&instr] = end;
+    if (writes) last_store = std::max(last_store, end);
+    if (writes || instr.mayReadFromMemory()) last_access = std::max(last_access, end);
+    result.critical_path = std::max(result.critical_path, end);
+  }
+  result.resource_bound = throughput / std::max(1u, issue_width);
+  return result;
+}
@@ -0,0 +1,21 @@
+/*
+  This file is distributed under the University of Illinois Open Source
+  License. See LICENSE for details.
+*/
+
+#pragma once
+
+#include <llvm/Analysis/TargetTransformInfo.h>
+#include <llvm/IR/BasicBlock.h>
+
+// Cost of a block allowing instruction-level parallelism: a block runs no faster than its longest dependence chain
+// (critical path) nor than its instructions can be issued (resource bound).
+struct Ilp_block_cost {
+  double latency{ 0 };        // Sum of instruction latencies (the cost assuming no parallelism).
+  double critical_path{ 0 };  // Longest latency-weighted path in the block's data dependence DAG.
+  double resource_bound{ 0 }; // Sum of reciprocal throughputs over the issue width.
+
+  double cost() const { return critical_path > resource_bound ? critical_path : resource_bound; }
+};
+
+Ilp_block_cost compute_ilp_block_cost(llvm::BasicBlock &bb, llvm::TargetTransformInfo &tti, unsigned issue_width);
@@ -0,0 +1,80 @@
+/*
+  This file is distributed under the University of Illinois Open Source
+  License. See LICENSE for details.
+*/
+
+#include <llvm/Support/Endian.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "kmeans_cost.hh"
+
+/* K-means model file.
+  Little endian: the magic "KMNS", then the version, dimensions (opcodes), PCA components and clusters as uint32, then
+  float64 arrays: the PCA mean [dimensions], the components [components][dimensions] (already divided by the singular
+  values when the PCA whitens), the centroids [clusters][components] and the average cycles [clusters].
+***********************************************************************************************************************/
+bool Kmeans_model::load(llvm::StringRef path)
+{
+  auto buffer{ llvm::MemoryBuffer::getFile(path) };
+  if (!buffer) {
+    llvm::errs() << "Error: Unable to read kmeans model [" << path << "]: " << buffer.getError().message() << '\n';
+    return false;
+  }
+  llvm::StringRef data{ (*buffer)->getBuffer() };
+  auto invalid = [&](const char *reason) {
+    llvm::errs() << "Error: Invalid kmeans model [" << path << "]: " << reason << '\n';
+    return false;
+  };
+  if (data.size() < 20 || !data.startswith("KMNS")) return invalid("bad header");
+  auto word = [&](unsigned idx) { return llvm::support::endian::read32le(data.data() + 4 + 4 * idx); };
+  if (word(0) != 1) return invalid("unsupported version");
+  dimensions_ = word(1);
+  components_ = word(2);
+  clusters_ = word(3);
+  size_t values{ dimensions_ + size_t{ components_ } * dimensions_ + size_t{ clusters_ } * components_ + clusters_ };
+  if (!clusters_ || data.size() != 20 + values * sizeof(double)) return invalid("truncated");
+
+  std::vector<double> raw(values);
+  for (size_t idx = 0; idx < values; ++idx) {
+    uint64_t bits{ llvm::support::endian::read64le(data.data() + 20 + idx * sizeof(double)) };
+    std::memcpy(&raw[idx], &bits, sizeof(double));
+  }
+  const double *mean{ raw.data() };
+  const double *components{ mean + dimensions_ };
+  const double *centroids{ components + size_t{ components_ } * dimensions_ };
+  projection_.assign(components, centroids);
+  offset_.assign(components_, 0);
+  for (unsigned component = 0; component < components_; ++component)
+    for (unsigned opcode = 0; opcode < dimensions_; ++opcode)
+      offset_[component] += projection_[component * dimensions_ + opcode] * mean[opcode];
+  centroids_.resize(size_t{ clusters_ } * components_);
+  for (unsigned cluster = 0; cluster < clusters_; ++cluster)
+    for (unsigned component = 0; component < components_; ++component)
+      centroids_[component * clusters_ + cluster] = centroids[cluster * components_ + component];
+  cycles_.assign(centroids + size_t{ clusters_ } * components_, mean + values);
+  return true;
+}
+
+// The squared distances to all the centroids are accumulated one component at a time: with the centroids stored by
+// component, the inner loop runs over contiguous arrays and vectorizes.
+double Kmeans_model::cost(const std::vector<double> &histogram) const
+{
+  if (!clusters_) return 0;
+  std::vector<double> distances(clusters_, 0);
+  size_t opcodes{ std::min<size_t>(histogram.size(), dimensions_) };
+  for (unsigned component = 0; component < components_; ++component) {
+    const double *axis{ &projection_[component * dimensions_] };
+    double projected{ -offset_[component] };
+    for (size_t opcode = 0; opcode < opcodes; ++opcode) projected += axis[opcode] * histogram[opcode];
+    const double *centroids{ &centroids_[component * clusters_] };
+    for (unsigned cluster = 0; cluster < clusters_; ++cluster) {
+      double delta{ projected - centroids[cluster] };
+      distances[cluster] += delta * delta;
+    }
+  }
+  return cycles_[std::min_element(distances.begin(), distances.end()) - distances.begin()];
+}
@@ -0,0 +1,28 @@
+/*
+  This file is distributed under the University of Illinois Open Source
+  License. See LICENSE for details.
+*/
+
+#pragma once
+
+#include <llvm/ADT/StringRef.h>
+
+#include <vector>
+
+// The k-means model of runtime-generalization/kmeans.py: an opcode histogram is projected on the principal components
+// and costs the average cycles of the cluster whose centroid is nearest.
+struct Kmeans_model {
+  // Read a model exported by runtime-generalization/kmeans-export.py. Returns false (after reporting to errs()) if the
+  // file can't be read or is not a model.
+  bool load(llvm::StringRef path);
+  // Cycles of the cluster of <histogram> (opcode -> count; opcodes beyond the model's dimensions are ignored).
+  double cost(const std::vector<double> &histogram) const;
+  unsigned dimensions() const { return dimensions_; }
+
+private:
+  unsigned dimensions_{ 0 }, components_{ 0 }, clusters_{ 0 };
+  std::vector<double> projection_; // Component major: projection_[component * dimensions + opcode].
+  std::vector<double> offset_;     // Projection of the mean, subtracted from each projected histogram.
+  std::vector<double> centroids_;  // Component major: centroids_[component * clusters + cluster].
+  std::vector<double> cycles_;     // Per cluster.
+};
@@ -0,0 +1,72 @@
+/*
+  This file is distributed under the University of Illinois Open Source
+  License. See LICENSE for details.
+*/
+
+#include <tuple>
+
+#include <llvm/ADT/Optional.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Function.h>
+#include <llvm/Support/LineIterator.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include "libcall_cost.hh"
+
+/* External library call costs.
+  Declarations have no blocks, so their time is not in the function call frequencies: it is charged at each call site
+  from a table calibrated on the target machine (see calibration/libcall_calibration.cc). Memory intrinsics and the
+  math intrinsics are looked up by their libc/libm name: llvm.memcpy.p0i8.p0i8.i64 as memcpy, llvm.sqrt.f64 as sqrt.
+***********************************************************************************************************************/
+bool Libcall_cost_table::load(llvm::StringRef path)
+{
+  auto buffer{ llvm::MemoryBuffer::getFile(path) };
+  if (!buffer) {
+    llvm::errs() << "Error: Unable to read library call costs [" << path << "]: " << buffer.getError().message() << '\n';
+    return false;
+  }
+  symbols_.clear();
+  for (llvm::line_iterator line{ **buffer, true, '#' }; !line.is_at_eof(); ++line) {
+    llvm::SmallVector<llvm::StringRef, 4> fields{};
+    line->split(fields, ',');
+    Libcall_cost cost{};
+    llvm::StringRef size_arg{}, count_arg{};
+    if (fields.size() == 4) std::tie(size_arg, count_arg) = fields[3].split('*');
+    if (fields.size() != 4 || fields[1].trim().getAsDouble(cost.base) || fields[2].trim().getAsDouble(cost.per_unit)
+        || size_arg.trim().getAsInteger(10, cost.size_arg)
+        || (!count_arg.empty() && count_arg.trim().getAsInteger(10, cost.count_arg))) {
+      if (fields[0].trim() != "symbol") // Header.
+        llvm::errs() << "Invalid library call cost [" << *line << "] in [" << path << "]\n";
+      continue;
+    }
+    symbols_[fields[0].trim()] = cost;
+  }
+  return true;
+}
+
+bool Libcall_cost_table::cost(const llvm::CallBase &call, double unknown_size, double &cycles) const
+{
+  const llvm::Function *callee{ call.getCalledFunction() };
+  if (!callee || !callee->isDeclaration()) return false;
+  llvm::StringRef name{ callee->getName() };
+  if (callee->isIntrinsic()) name = name.drop_front(5).split('.').first; // Drop "llvm." and the type suffixes.
+  auto found{ symbols_.find(name) };
+  if (found == symbols_.end()) return false;
+
+  const Libcall_cost &entry{ found->second };
+  // Value of argument <arg>, if a constant.
+  auto constant_arg = [&](int arg) -> llvm::Optional<double> {
+    if (arg < 0 || static_cast<unsigned>(arg) >= call.arg_size()) return llvm::None;
+    if (auto *value{ llvm::dyn_cast<llvm::ConstantInt>(call.getArgOperand(arg)) })
+      return static_cast<double>(value->getZExtValue());
+    return llvm::None;
+  };
+  double size{ unknown_size };
+  if (llvm::Optional<double> length{ constant_arg(entry.size_arg) }) {
+    if (entry.count_arg < 0) size = *length;
+    else if (llvm::Optional<double> count{ constant_arg(entry.count_arg) }) size = *length * *count;
+  }
+  cycles = entry.base + entry.per_unit * size;
+  return true;
+}
@@ -0,0 +1,34 @@
+/*
+  This file is distributed under the University of Illinois Open Source
+  License. See LICENSE for details.
+*/
+
+#pragma once
+
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/IR/InstrTypes.h>
+
+// Cost of a call to an external symbol: base + per_unit * size, size being the value of argument size_arg, times the
+// one of argument count_arg if any (calloc's size and nmemb), or <unknown_size> when an argument is not a constant or
+// the symbol has no size argument.
+struct Libcall_cost {
+  double base{ 0 };
+  double per_unit{ 0 };
+  int size_arg{ -1 }; // Index of the length argument, -1 if none.
+  int count_arg{ -1 }; // Index of an argument multiplying the length, -1 if none.
+};
+
+struct Libcall_cost_table {
+  // Read a CSV table of "symbol,base,per_unit,size_arg" lines ('#' starts a comment), size_arg being an argument
+  // index, or two joined by '*' whose product is the size (calloc: 1*0). Returns false (after reporting to errs()) if
+  // the file can't be read.
+  bool load(llvm::StringRef path);
+  // Set <cycles> to the cost of one execution of <call>, with <unknown_size> for sizes that aren't constant. Returns
+  // false if <call> is indirect, calls a function with a body or a symbol not in the table.
+  bool cost(const llvm::CallBase &call, double unknown_size, double &cycles) const;
+  bool empty() const { return symbols_.empty(); }
+
+private:
+  llvm::StringMap<Libcall_cost> symbols_;
+};
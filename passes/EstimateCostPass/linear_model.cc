@@ -0,0 +1,117 @@
+/*
+  This file is distributed under the University of Illinois Open Source
+  License. See LICENSE for details.
+*/
+
+#include <llvm/ADT/StringMap.h>
+#include <llvm/IR/Instruction.h>
+#include <llvm/Support/LineIterator.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include "linear_model.hh"
+
+namespace {
+
+constexpr unsigned num_opcodes{ llvm::Instruction::OtherOpsEnd }; // Opcodes start at 1, column 0 stays empty.
+
+} // namespace
+
+Opcode_matrix::Opcode_matrix() : columns_(num_opcodes) {}
+
+void Opcode_matrix::add_function(llvm::Function &fun, const std::function<double(llvm::BasicBlock &)> &freq)
+{
+  size_t begin{ function_end_.empty() ? 0 : function_end_.back() };
+  size_t end{ begin + fun.size() };
+  for (auto &column : columns_) column.resize(end, 0);
+  size_t block{ begin };
+  for (llvm::BasicBlock &bb : fun) {
+    double weight{ freq(bb) };
+    for (llvm::Instruction &instr : bb) columns_[instr.getOpcode()][block] += weight;
+    ++block;
+  }
+  function_end_.push_back(end);
+  functions_.push_back(&fun);
+}
+
+bool Linear_models::load(llvm::StringRef path)
+{
+  auto buffer{ llvm::MemoryBuffer::getFile(path) };
+  if (!buffer) {
+    llvm::errs() << "Error: Unable to read linear models [" << path << "]: " << buffer.getError().message() << '\n';
+    return false;
+  }
+  names_.clear();
+  weights_.clear();
+
+  llvm::StringMap<unsigned> opcodes{};
+  for (unsigned opcode = 1; opcode < num_opcodes; ++opcode) opcodes[llvm::Instruction::getOpcodeName(opcode)] = opcode;
+  std::vector<int> header{}; // Column -> opcode, -1 for unknown opcodes.
+  for (llvm::line_iterator line{ **buffer, true, '#' }; !line.is_at_eof(); ++line) {
+    llvm::SmallVector<llvm::StringRef, 80> fields{};
+    line->split(fields, ',');
+    if (header.empty()) {
+      for (llvm::StringRef field : llvm::makeArrayRef(fields).drop_front()) {
+        unsigned opcode{ 0 };
+        auto found{ opcodes.find(field.trim()) };
+        if (found != opcodes.end()) opcode = found->second;
+        else if (field.trim().getAsInteger(10, opcode) || opcode == 0 || opcode >= num_opcodes) {
+          llvm::errs() << "Unknown opcode [" << field.trim() << "] in [" << path << "], ignoring its weights\n";
+          opcode = 0;
+        }
+        header.push_back(opcode ? opcode : -1);
+      }
+      continue;
+    }
+    if (fields.size() != header.size() + 1) {
+      llvm::errs() << "Invalid linear model [" << fields[0] << "] in [" << path << "]: expected " << header.size()
+                   << " weights\n";
+      continue;
+    }
+    names_.push_back(fields[0].trim().str());
+    weights_.resize(weights_.size() + num_opcodes, 0);
+    double *weights{ &weights_[weights_.size() - num_opcodes] };
+    for (size_t column = 0; column < header.size(); ++column) {
+      double weight{ 0 };
+      if (header[column] >= 0 && fields[column + 1].trim().getAsDouble(weight))
+        llvm::errs() << "Invalid weight [" << fields[column + 1] << "] in model [" << names_.back() << "]\n";
+      else if (header[column] >= 0)
+        weights[header[column]] = weight;
+    }
+  }
+  return true;
+}
+
+/* Linear model evaluation.
+  A model is linear in the opcode counts, so the blocks of each function are first reduced to a functions x opcodes
+  matrix (one pass over the block columns), and all the models are then evaluated against it. Both loops run over
+  contiguous arrays with no dependence between iterations, which the compiler vectorizes.
+***********************************************************************************************************************/
+std::vector<double> Linear_models::evaluate(const Opcode_matrix &matrix) const
+{
+  size_t functions{ matrix.num_functions() };
+  std::vector<double> function_counts(num_opcodes * functions, 0); // Opcode major.
+  for (unsigned opcode = 1; opcode < num_opcodes; ++opcode) {
+    const double *column{ matrix.columns_[opcode].data() };
+    double *counts{ &function_counts[opcode * functions] };
+    size_t block{ 0 };
+    for (size_t fun = 0; fun < functions; ++fun) {
+      double sum{ 0 };
+      for (size_t end = matrix.function_end_[fun]; block < end; ++block) sum += column[block];
+      counts[fun] = sum;
+    }
+  }
+
+  std::vector<double> costs(size() * functions, 0);
+  for (size_t model = 0; model < size(); ++model) {
+    double *model_costs{ &costs[model * functions] };
+    const double *weights{ &weights_[model * num_opcodes] };
+    for (unsigned opcode = 1; opcode < num_opcodes; ++opcode) {
+      double weight{ weights[opcode] };
+      if (weight == 0) continue;
+      const double *counts{ &function_counts[opcode * functions] };
+      for (size_t fun = 0; fun < functions; ++fun) model_costs[fun] += weight * counts[fun];
+    }
+  }
+  return costs;
+}
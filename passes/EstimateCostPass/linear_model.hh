@@ -0,0 +1,43 @@
+/*
+  This file is distributed under the University of Illinois Open Source
+  License. See LICENSE for details.
+*/
+
+#pragma once
+
+#include <llvm/ADT/StringRef.h>
+#include <llvm/IR/Function.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// Frequency-weighted opcode counts of a module's blocks, stored by column (structure of arrays): columns_[opcode][b] is
+// the number of instructions of <opcode> in block b times its frequency. The blocks of a function are contiguous.
+struct Opcode_matrix {
+  Opcode_matrix();
+  // Append the blocks of <fun>, weighted by <freq>.
+  void add_function(llvm::Function &fun, const std::function<double(llvm::BasicBlock &)> &freq);
+  size_t num_functions() const { return functions_.size(); }
+  llvm::Function *function(size_t idx) const { return functions_[idx]; }
+
+  std::vector<std::vector<double>> columns_;
+  std::vector<size_t> function_end_; // One past the last block of each function.
+  std::vector<llvm::Function *> functions_;
+};
+
+// Linear cost models: the cost of an instruction is the weight of its opcode.
+struct Linear_models {
+  // Read a CSV table with a header of opcodes (names such as "add", or numbers as in the frequency YAML) and one row
+  // per model: name followed by one weight per opcode in the header. Returns false (after reporting to errs()) if the
+  // file can't be read.
+  bool load(llvm::StringRef path);
+  size_t size() const { return names_.size(); }
+  const std::string &name(size_t model) const { return names_[model]; }
+  // Costs of every model for every function of <matrix>, model major: result[model * num_functions + function].
+  std::vector<double> evaluate(const Opcode_matrix &matrix) const;
+
+private:
+  std::vector<std::string> names_;
+  std::vector<double> weights_; // Model major: weights_[model * num_opcodes + opcode].
+};
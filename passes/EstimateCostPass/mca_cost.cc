@@ -0,0 +1,177 @@
+/*
+  This file is distributed under the University of Illinois Open Source
+  License. See LICENSE for details.
+*/
+
+#include <llvm/CodeGen/MachineFunctionPass.h>
+#include <llvm/CodeGen/MachineModuleInfo.h>
+#include <llvm/CodeGen/TargetPassConfig.h>
+#include <llvm/CodeGen/TargetRegisterInfo.h>
+#include <llvm/CodeGen/TargetSchedule.h>
+#include <llvm/CodeGen/TargetSubtargetInfo.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/IR/ValueMap.h>
+#include <llvm/InitializePasses.h>
+#include <llvm/MC/TargetRegistry.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Target/TargetMachine.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "mca_cost.hh"
+
+namespace {
+
+/* Scheduling model block cost.
+  rthroughput: the block's reciprocal throughput in steady state, as llvm-mca's "Block RThroughput": the maximum
+  between the dispatch bound (micro-ops / issue width) and the pressure on the most used processor resource.
+  latency: the critical path through the block's register dependencies.
+***********************************************************************************************************************/
+double block_rthroughput(const llvm::MachineBasicBlock &mbb, const llvm::TargetSchedModel &sched)
+{
+  std::vector<double> resource_cycles(sched.getNumProcResourceKinds(), 0);
+  double micro_ops{ 0 };
+  for (const llvm::MachineInstr &mi : mbb) {
+    if (mi.isMetaInstruction()) continue;
+    micro_ops += sched.getNumMicroOps(&mi);
+    if (!sched.hasInstrSchedModel()) continue;
+    const llvm::MCSchedClassDesc *sc{ sched.resolveSchedClass(&mi) };
+    if (!sc || !sc->isValid()) continue;
+    for (auto res = sched.getWriteProcResBegin(sc), end = sched.getWriteProcResEnd(sc); res != end; ++res)
+      resource_cycles[res->ProcResourceIdx] += res->Cycles;
+  }
+  double throughput{ micro_ops / std::max(1u, sched.getIssueWidth()) };
+  for (unsigned idx = 1; idx < resource_cycles.size(); ++idx) { // Index 0 is the invalid resource.
+    unsigned units{ sched.getProcResource(idx)->NumUnits };
+    if (units) throughput = std::max(throughput, resource_cycles[idx] / units);
+  }
+  return throughput;
+}
+
+double block_latency(const llvm::MachineBasicBlock &mbb, const llvm::TargetSchedModel &sched)
+{
+  const llvm::TargetRegisterInfo *tri{ mbb.getParent()->getSubtarget().getRegisterInfo() };
+  llvm::DenseMap<unsigned, double> ready{}; // Register unit -> cycle its last definition completes.
+  double critical_path{ 0 };
+  for (const llvm::MachineInstr &mi : mbb) {
+    if (mi.isMetaInstruction()) continue;
+    double start{ 0 };
+    for (const llvm::MachineOperand &op : mi.operands()) {
+      if (!op.isReg() || !op.isUse() || !op.getReg().isPhysical()) continue;
+      for (llvm::MCRegUnitIterator unit{ op.getReg().asMCReg(), tri }; unit.isValid(); ++unit) {
+        auto found{ ready.find(*unit) };
+        if (found != ready.end()) start = std::max(start, found->second);
+      }
+    }
+    double finish{ start + sched.computeInstrLatency(&mi) };
+    for (const llvm::MachineOperand &op : mi.operands()) {
+      if (!op.isReg() || !op.isDef() || !op.getReg().isPhysical()) continue;
+      for (llvm::MCRegUnitIterator unit{ op.getReg().asMCReg(), tri }; unit.isValid(); ++unit)
+        ready[*unit] = finish;
+    }
+    critical_path = std::max(critical_path, finish);
+  }
+  return critical_path;
+}
+
+// Original block of each hot block of the clone. A value map, not a DenseMap: codegen deletes blocks of the clone
+// (CodeGenPrepare, unreachable block elimination) and allocates others, which may reuse their addresses. The entries of
+// deleted blocks are dropped with them, and those of blocks replaced with others follow the replacements.
+using Block_origins = llvm::ValueMap<const llvm::BasicBlock *, const llvm::BasicBlock *>;
+
+// Runs last in the codegen pipeline, computing the cost of each machine block and charging it to its IR block.
+struct Mca_block_pass : public llvm::MachineFunctionPass {
+  static char ID;
+  Mca_block_pass(Mca_metric metric, const Block_origins &origin, llvm::DenseMap<const llvm::BasicBlock *, double> &costs)
+    : llvm::MachineFunctionPass(ID), metric_{ metric }, origin_{ origin }, costs_{ costs } {}
+
+  void getAnalysisUsage(llvm::AnalysisUsage &usage) const override {
+    usage.setPreservesAll();
+    llvm::MachineFunctionPass::getAnalysisUsage(usage);
+  }
+
+  bool runOnMachineFunction(llvm::MachineFunction &mf) override {
+    llvm::TargetSchedModel sched{};
+    sched.init(&mf.getSubtarget());
+    for (llvm::MachineBasicBlock &mbb : mf) {
+      // Blocks created during codegen (e.g. by CodeGenPrepare) have no IR counterpart in the original module.
+      auto found{ origin_.find(mbb.getBasicBlock()) };
+      if (found == origin_.end()) continue;
+      costs_[found->second] += metric_ == Mca_metric::latency ? block_latency(mbb, sched) : block_rthroughput(mbb, sched);
+    }
+    return false;
+  }
+
+private:
+  Mca_metric metric_;
+  const Block_origins &origin_;
+  llvm::DenseMap<const llvm::BasicBlock *, double> &costs_;
+};
+
+char Mca_block_pass::ID = 0;
+
+} // namespace
+
+bool Mca_cost_model::run(llvm::Module &module, const std::function<bool(llvm::BasicBlock &)> &is_hot)
+{
+  block_costs_.clear();
+  llvm::initializeCodeGen(*llvm::PassRegistry::getPassRegistry());
+  llvm::initializeTarget(*llvm::PassRegistry::getPassRegistry());
+
+  std::string triple{ module.getTargetTriple().empty() ? llvm::sys::getDefaultTargetTriple() : module.getTargetTriple() };
+  std::string error{};
+  const llvm::Target *target{ llvm::TargetRegistry::lookupTarget(triple, error) };
+  if (!target) {
+    llvm::errs() << "Error: Unable to set up target [" << triple << "] for the mca cost kind: " << error << '\n';
+    return false;
+  }
+  std::string target_cpu{ cpu.empty() ? llvm::sys::getHostCPUName().str() : cpu };
+  std::unique_ptr<llvm::LLVMTargetMachine> tm{ static_cast<llvm::LLVMTargetMachine *>(target->createTargetMachine(
+    triple, target_cpu, "", llvm::TargetOptions{}, llvm::None, llvm::None, llvm::CodeGenOpt::Default)) };
+  if (!tm) {
+    llvm::errs() << "Error: Unable to create a target machine for [" << triple << "] for the mca cost kind\n";
+    return false;
+  }
+
+  // Codegen changes the IR, so lower a clone. Functions without hot blocks are not lowered at all.
+  llvm::ValueToValueMapTy vmap{};
+  std::unique_ptr<llvm::Module> clone{ llvm::CloneModule(module, vmap) };
+  if (clone->getDataLayout().isDefault()) clone->setDataLayout(tm->createDataLayout());
+  Block_origins origin{};
+  for (llvm::Function &fun : module) {
+    if (fun.empty()) continue;
+    auto *cloned_fun{ llvm::cast<llvm::Function>(vmap[&fun]) };
+    if (std::none_of(fun.begin(), fun.end(), is_hot)) {
+      cloned_fun->deleteBody();
+      continue;
+    }
+    for (llvm::BasicBlock &bb : fun)
+      if (is_hot(bb)) origin[llvm::cast<llvm::BasicBlock>(vmap[&bb])] = &bb;
+  }
+
+  llvm::legacy::PassManager pm{};
+  auto *mmi{ new llvm::MachineModuleInfoWrapperPass(tm.get()) };
+  llvm::TargetPassConfig *config{ tm->createPassConfig(pm) };
+  pm.add(config);
+  pm.add(mmi);
+  if (config->addISelPasses()) {
+    llvm::errs() << "Error: Unable to select instructions for [" << triple << "] for the mca cost kind\n";
+    return false;
+  }
+  config->addMachinePasses();
+  config->setInitialized();
+  pm.add(new Mca_block_pass(metric, origin, block_costs_));
+  pm.run(*clone);
+  return true;
+}
+
+const double *Mca_cost_model::lookup(const llvm::BasicBlock *bb) const
+{
+  auto found{ block_costs_.find(bb) };
+  if (found == block_costs_.end()) return nullptr;
+  return &found->second;
+}
@@ -0,0 +1,32 @@
+/*
+  This file is distributed under the University of Illinois Open Source
+  License. See LICENSE for details.
+*/
+
+#pragma once
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/IR/BasicBlock.h>
+#include <llvm/IR/Module.h>
+
+#include <functional>
+#include <string>
+
+enum class Mca_metric { rthroughput, latency };
+
+// Block costs from the target's scheduling model (MCSchedModel), computed in process on the machine code generated
+// for a clone of the module, the way llvm-mca computes a region's "Block RThroughput".
+struct Mca_cost_model {
+  // Generate code for the functions of <module> that have at least one block accepted by <is_hot> and compute the
+  // cost of one execution of each of their blocks. Returns false (after reporting to errs()) if the module's target
+  // can't be set up for code generation.
+  bool run(llvm::Module &module, const std::function<bool(llvm::BasicBlock &)> &is_hot);
+  // Cost of <bb>, or nullptr if it was not lowered (cold, or its machine blocks were created by codegen).
+  const double *lookup(const llvm::BasicBlock *bb) const;
+
+  Mca_metric metric{ Mca_metric::rthroughput };
+  std::string cpu{};
+
+private:
+  llvm::DenseMap<const llvm::BasicBlock *, double> block_costs_;
+};
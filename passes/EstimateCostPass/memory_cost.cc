@@ -0,0 +1,51 @@
+/*
+  This file is distributed under the University of Illinois Open Source
+  License. See LICENSE for details.
+*/
+
+#include <llvm/Analysis/ScalarEvolutionExpressions.h>
+#include <llvm/IR/Instructions.h>
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "memory_cost.hh"
+
+const char *access_pattern_name(Access_pattern pattern)
+{
+  switch (pattern) {
+  case Access_pattern::unit_stride: return "Unit stride";
+  case Access_pattern::constant_stride: return "Constant stride";
+  case Access_pattern::invariant: return "Invariant";
+  case Access_pattern::irregular: return "Irregular";
+  default: return "";
+  }
+}
+
+/* Access classification.
+  invariant: the address doesn't change in the loop, the line stays cached after the first iteration.
+  unit stride: consecutive elements, a new line every line_size / element_size iterations.
+  constant stride: a new line every line_size / stride iterations (every iteration for strides of a line or more).
+  irregular: any other address, e.g. pointer chasing or indirect indexing, assumed to touch a new line per iteration.
+***********************************************************************************************************************/
+Memory_access classify_access(llvm::Instruction &access, const llvm::Loop &loop, llvm::ScalarEvolution &se,
+                              double line_size)
+{
+  llvm::Value *address{ llvm::getLoadStorePointerOperand(&access) };
+  llvm::Type *type{ llvm::getLoadStoreType(&access) };
+  if (!address || !se.isSCEVable(address->getType())) return { Access_pattern::irregular, 1 };
+
+  const llvm::SCEV *scev{ se.getSCEV(address) };
+  if (se.isLoopInvariant(scev, &loop)) return { Access_pattern::invariant, 0 };
+
+  auto *rec{ llvm::dyn_cast<llvm::SCEVAddRecExpr>(scev) };
+  if (rec && rec->getLoop() == &loop && rec->isAffine()) {
+    if (auto *step{ llvm::dyn_cast<llvm::SCEVConstant>(rec->getStepRecurrence(se)) }) {
+      double stride = std::abs(step->getAPInt().getSExtValue());
+      double element = access.getModule()->getDataLayout().getTypeStoreSize(type).getKnownMinSize();
+      Access_pattern pattern{ stride == element ? Access_pattern::unit_stride : Access_pattern::constant_stride };
+      return { pattern, std::min(1.0, stride / line_size) };
+    }
+  }
+  return { Access_pattern::irregular, 1 };
+}
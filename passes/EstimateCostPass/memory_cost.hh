@@ -0,0 +1,24 @@
+/*
+  This file is distributed under the University of Illinois Open Source
+  License. See LICENSE for details.
+*/
+
+#pragma once
+
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/Analysis/ScalarEvolution.h>
+#include <llvm/IR/Instruction.h>
+
+// Access pattern of a load or store across the iterations of its innermost loop.
+enum class Access_pattern { unit_stride, constant_stride, invariant, irregular };
+
+const char *access_pattern_name(Access_pattern pattern);
+
+struct Memory_access {
+  Access_pattern pattern;
+  double lines; // Cache lines first touched per iteration.
+};
+
+// Classify the load/store <access> of <loop> using the SCEV of its address.
+Memory_access classify_access(llvm::Instruction &access, const llvm::Loop &loop, llvm::ScalarEvolution &se,
+                              double line_size);
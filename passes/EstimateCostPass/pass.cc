@@ -3,6 +3,7 @@
   License. See LICENSE for details.
 */
 
+#include <llvm/ADT/SmallPtrSet.h>
 #include <llvm/ADT/SmallSet.h>
 #include <llvm/Analysis/BlockFrequencyInfo.h>
 #include <llvm/Analysis/BlockFrequencyInfoImpl.h>
@@ -16,9 +17,11 @@
 #include <llvm/IR/BasicBlock.h>
 #include <llvm/IR/Constants.h>
 #include <llvm/IR/CFG.h>
+#include <llvm/IR/DebugInfoMetadata.h>
 #include <llvm/IR/Dominators.h>
 #include <llvm/IR/Function.h>
 #include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/InstIterator.h>
 #include <llvm/IR/InstrTypes.h>
 #include <llvm/IR/Instructions.h>
 #include <llvm/IR/PassManager.h>
@@ -28,11 +31,19 @@
 #include <llvm/Support/CommandLine.h>
 #include <llvm/Support/Compiler.h>
 #include <llvm/Support/Debug.h>
+#include <llvm/Support/FileSystem.h>
 #include <llvm/Support/Format.h>
+#include <llvm/Support/Path.h>
 #include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/xxhash.h>
 
 #include <algorithm>
+#include <array>
+#include <cmath>
+#include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <set>
 #include <sstream>
 #include <string>
@@ -41,6 +52,21 @@
 #include <vector>
 
 #include "../WuLarus/A3.Function_call_frequency/function_call_frequency_pass.hh"
+#include "binary_output.hh"
+#include "calibrated_cost.cc"
+#include "cost_trajectory.cc"
+#include "estimate_cost_pass.hh"
+#include "hot_list.hh"
+#include "icache_cost.cc"
+#include "kmeans_cost.cc"
+#include "ilp_cost.cc"
+#include "libcall_cost.cc"
+#include "linear_model.cc"
+#include "mca_cost.cc"
+#include "memory_cost.cc"
+#include "runtime_profile.cc"
+#include "target_cost.cc"
+#include "tier_errors.cc"
 
 using namespace std;
 using namespace llvm;
@@ -49,7 +75,7 @@ cl::opt<std::string> arg_cost_opt(
   "prediction-cost-kind",
   cl::init("latency"), // cl::init("recipthroughput"), cl::init("codesize"), cl::init("sizeandlatency"),
   cl::desc("Specify cost kind used"),
-  cl::value_desc("one or more of: recipthroughput, latency, codesize, sizeandlatency, one, dynamic")
+  cl::value_desc("one or more of: recipthroughput, latency, codesize, sizeandlatency, one, dynamic, mca, criticalpath, memory, calibrated, kmeans")
 );
 
 cl::opt<bool> arg_freqs(
@@ -58,9 +84,302 @@ cl::opt<bool> arg_freqs(
   cl::desc("Compute the frequencies only, don't multiply by the cost")
 );
 
-enum class Cost_option {
-  latency, recipthroughput, codesize, sizeandlatency, one, dynamic,
-};
+cl::opt<std::string> arg_binary_output(
+  "binary-output",
+  cl::init(""),
+  cl::desc("Write the frequencies (-frequencies) or the costs in the columnar binary format to this file instead of "
+           "YAML to the standard output (- for the standard output)"),
+  cl::value_desc("filename")
+);
+
+cl::opt<std::string> arg_report_granularity(
+  "report-granularity",
+  cl::init("program"),
+  cl::desc("Report the costs of the whole program, or also of each function, loop or block with its share of the total"),
+  cl::value_desc("program|function|loop|block")
+);
+
+cl::opt<unsigned> arg_report_top(
+  "report-top",
+  cl::init(0),
+  cl::desc("Report only the most costly functions, loops or blocks of each cost kind (0 reports all of them)"),
+  cl::value_desc("count")
+);
+
+cl::opt<bool> arg_binary_compress(
+  "binary-compress",
+  cl::init(false),
+  cl::desc("Compress the large columns of the binary output with zlib")
+);
+
+cl::opt<std::string> arg_estimate_targets(
+  "estimate-targets",
+  cl::init(""),
+  cl::desc("Also estimate the TTI cost kinds (and the misprediction penalty) for each of these CPUs of the module's "
+           "target, in the same run"),
+  cl::value_desc("cpu,...")
+);
+
+cl::opt<std::string> arg_runtime_profile(
+  "runtime-profile",
+  cl::init(""),
+  cl::desc("Runtime_data YAML (basicblock granularity) with measured cycles, used by the dynamic cost kind"),
+  cl::value_desc("filename")
+);
+
+cl::opt<std::string> arg_fallback_cost(
+  "fallback-cost-kind",
+  cl::init("latency"),
+  cl::desc("Static cost kind used for blocks the dynamic and mca cost kinds have no data for, and for instructions "
+           "missing from the calibrated cost table"),
+  cl::value_desc("one of: recipthroughput, latency, codesize, sizeandlatency, one")
+);
+
+cl::opt<std::string> arg_calibrated_costs(
+  "calibrated-costs",
+  cl::init(""),
+  cl::desc("CSV table of opcode costs measured on the local machine (opcode,type,latency,throughput), used by the "
+           "calibrated cost kind"),
+  cl::value_desc("filename")
+);
+
+cl::opt<std::string> arg_calibrated_metric(
+  "calibrated-metric",
+  cl::init("latency"),
+  cl::desc("Column of the calibrated cost table used by the calibrated cost kind"),
+  cl::value_desc("one of: latency, throughput")
+);
+
+cl::opt<std::string> arg_linear_models(
+  "linear-models",
+  cl::init(""),
+  cl::desc("CSV table of linear cost models (a header of opcodes, then one row of weights per model), all evaluated "
+           "on the module's frequency-weighted opcode counts"),
+  cl::value_desc("filename")
+);
+
+cl::opt<bool> arg_linear_models_per_function(
+  "linear-models-per-function",
+  cl::init(false),
+  cl::desc("Print the cost of each function for each linear model")
+);
+
+cl::opt<std::string> arg_kmeans_model(
+  "kmeans-model",
+  cl::init(""),
+  cl::desc("Model exported by runtime-generalization/kmeans-export.py, used by the kmeans cost kind"),
+  cl::value_desc("filename")
+);
+
+cl::opt<std::string> arg_kmeans_granularity(
+  "kmeans-granularity",
+  cl::init("block"),
+  cl::desc("Histograms classified by the kmeans cost kind: each block's, weighted by its frequency, or each "
+           "function's, weighted by its invocations (as the model was trained)"),
+  cl::value_desc("one of: block, function")
+);
+
+cl::opt<std::string> arg_mca_metric(
+  "mca-metric",
+  cl::init("rthroughput"),
+  cl::desc("Block cost computed from the scheduling model by the mca cost kind"),
+  cl::value_desc("one of: rthroughput, latency")
+);
+
+cl::opt<std::string> arg_mca_cpu(
+  "mca-cpu",
+  cl::init(""),
+  cl::desc("CPU whose scheduling model is used by the mca cost kind for functions without a target-cpu (default: host)"),
+  cl::value_desc("cpu name")
+);
+
+cl::opt<double> arg_mca_hot_threshold(
+  "mca-hot-threshold",
+  cl::init(0),
+  cl::desc("Only lower blocks whose global frequency is at least this value, the others use the fallback cost kind")
+);
+
+cl::opt<unsigned> arg_ilp_issue_width(
+  "ilp-issue-width",
+  cl::init(4),
+  cl::desc("Instructions issued per cycle, for the resource bound of the criticalpath cost kind")
+);
+
+cl::opt<std::string> arg_ilp_resource_bound(
+  "ilp-resource-bound",
+  cl::init("tti"),
+  cl::desc("Resource bound of the criticalpath cost kind: TTI reciprocal throughputs over the issue width, or the "
+           "scheduling model's block reciprocal throughput (as the mca cost kind)"),
+  cl::value_desc("one of: tti, sched")
+);
+
+cl::opt<std::string> arg_misprediction_penalty(
+  "misprediction-penalty",
+  cl::init(""),
+  cl::desc("Cycles lost per mispredicted branch. Enables the misprediction cost component, charged for every "
+           "conditional branch by the entropy of its predicted probabilities. Penalties can be given per target-cpu, "
+           "a plain number is used for the other CPUs"),
+  cl::value_desc("cycles or cpu=cycles,... (e.g. 15 or skylake=16,znver3=13,14)")
+);
+
+cl::opt<bool> arg_icache(
+  "icache-model",
+  cl::init(false),
+  cl::desc("Enable the instruction cache cost component, charged for functions and loops whose hot code does not fit "
+           "in the caches")
+);
+
+cl::opt<double> arg_icache_hot_threshold(
+  "icache-hot-threshold",
+  cl::init(1),
+  cl::desc("Global frequency from which a block's code is part of the hot working set")
+);
+
+cl::opt<unsigned> arg_icache_l1(
+  "icache-l1-size", cl::init(32 * 1024), cl::desc("L1 instruction cache size in bytes"));
+
+cl::opt<unsigned> arg_icache_l2(
+  "icache-l2-size", cl::init(1024 * 1024), cl::desc("L2 cache size in bytes"));
+
+cl::opt<unsigned> arg_cache_line(
+  "cache-line-size", cl::init(64), cl::desc("Cache line size in bytes"));
+
+cl::opt<double> arg_icache_l2_latency(
+  "icache-l2-latency", cl::init(12), cl::desc("Cycles to fetch a code line from L2"));
+
+cl::opt<double> arg_icache_memory_latency(
+  "icache-memory-latency", cl::init(100), cl::desc("Cycles to fetch a code line from memory"));
+
+cl::opt<double> arg_icache_bytes_per_unit(
+  "icache-bytes-per-unit",
+  cl::init(4),
+  cl::desc("Bytes of machine code per unit of TTI code size cost")
+);
+
+cl::opt<std::string> arg_libcall_costs(
+  "libcall-costs",
+  cl::init(""),
+  cl::desc("CSV table of external symbol costs (symbol,base,per_unit,size_arg, e.g. 1*0 for calloc). Enables the "
+           "libcall cost component, charged at each call to a declaration in the table"),
+  cl::value_desc("filename")
+);
+
+cl::opt<double> arg_libcall_unknown_size(
+  "libcall-unknown-size",
+  cl::init(0),
+  cl::desc("Size assumed for library calls whose length argument is not a constant")
+);
+
+cl::opt<double> arg_memory_stream_latency(
+  "memory-stream-latency",
+  cl::init(4),
+  cl::desc("Cycles per new cache line of strided accesses (prefetch friendly), for the memory cost kind")
+);
+
+cl::opt<double> arg_memory_miss_latency(
+  "memory-miss-latency",
+  cl::init(100),
+  cl::desc("Cycles per new cache line of irregular accesses (e.g. pointer chasing), for the memory cost kind")
+);
+
+cl::opt<bool> arg_ilp_breakdown(
+  "ilp-breakdown",
+  cl::init(false),
+  cl::desc("Print the critical path and resource bound of each block for the criticalpath cost kind")
+);
+
+cl::opt<std::string> arg_callgrind_output(
+  "callgrind-output",
+  cl::init(""),
+  cl::desc("Write the costs attributed to source lines (debug locations), with inclusive call costs, in the callgrind "
+           "format to this file"),
+  cl::value_desc("filename")
+);
+
+cl::opt<std::string> arg_folded_output(
+  "folded-output",
+  cl::init(""),
+  cl::desc("Write the cost of each call path, for the first cost kind, as folded stacks (flame graph input) to this file"),
+  cl::value_desc("filename")
+);
+
+cl::opt<double> arg_callpath_threshold(
+  "callpath-threshold",
+  cl::init(0.001),
+  cl::desc("Fraction of the total cost below which call paths are not expanded in the folded stacks")
+);
+
+cl::opt<std::string> arg_cost_trajectory(
+  "cost-trajectory",
+  cl::init(""),
+  cl::desc("Estimate the cost again after each pass of the pipeline (only the functions it changed) and write the "
+           "per-pass deltas as CSV to this file"),
+  cl::value_desc("filename")
+);
+
+cl::opt<std::string> arg_trajectory_cost(
+  "trajectory-cost-kind",
+  cl::init("latency"),
+  cl::desc("Instruction cost of the cost trajectory: latency, recipthroughput, codesize, sizeandlatency or one")
+);
+
+cl::opt<double> arg_tier_cold_threshold(
+  "tier-cold-threshold",
+  cl::init(1.0),
+  cl::desc("Invocation frequency below which the fast tier (-estimate-tier=fast) samples functions")
+);
+
+cl::opt<double> arg_tier_sample_rate(
+  "tier-sample-rate",
+  cl::init(0.25),
+  cl::desc("Fraction of the cold functions the fast tier estimates (the others are extrapolated from them)")
+);
+
+cl::opt<std::string> arg_tier_errors(
+  "tier-errors",
+  cl::init(""),
+  cl::desc("Relative errors of the tiers against the precise one, as written by calibrate_tiers.py, to report "
+           "with the estimate"),
+  cl::value_desc("filename")
+);
+
+bool parse_cost_option(StringRef name, Cost_option &cost)
+{
+  if (name == "latency") cost = Cost_option::latency;
+  else if (name == "recipthroughput") cost = Cost_option::recipthroughput;
+  else if (name == "codesize") cost = Cost_option::codesize;
+  else if (name == "sizeandlatency") cost = Cost_option::sizeandlatency;
+  else if (name == "one") cost = Cost_option::one;
+  else if (name == "dynamic") cost = Cost_option::dynamic;
+  else if (name == "mca") cost = Cost_option::mca;
+  else if (name == "criticalpath") cost = Cost_option::criticalpath;
+  else if (name == "memory") cost = Cost_option::memory;
+  else if (name == "calibrated") cost = Cost_option::calibrated;
+  else if (name == "kmeans") cost = Cost_option::kmeans;
+  else return false;
+  return true;
+}
+
+vector<Cost_option> selected_cost_options()
+{
+  set<Cost_option> selected{};
+  stringstream ss{ arg_cost_opt };
+  string name{};
+  Cost_option cost{};
+  while (getline(ss, name, ','))
+    if (parse_cost_option(name, cost)) selected.insert(cost);
+  if (estimate_tier() == Estimate_tier::precise) selected.insert(Cost_option::memory);
+  return { selected.begin(), selected.end() };
+}
+
+bool first_cost_option(Cost_option &cost)
+{
+  stringstream ss{ arg_cost_opt };
+  string name{};
+  while (getline(ss, name, ','))
+    if (parse_cost_option(name, cost)) return true;
+  return false;
+}
 
 const char *cost_name(Cost_option cost)
 {
@@ -71,10 +390,51 @@ const char *cost_name(Cost_option cost)
   case Cost_option::sizeandlatency: return "Sizeandlatency";
   case Cost_option::one: return "One";
   case Cost_option::dynamic: return "Dynamic";
+  case Cost_option::mca: return "Mca";
+  case Cost_option::criticalpath: return "Criticalpath";
+  case Cost_option::memory: return "Memory";
+  case Cost_option::calibrated: return "Calibrated";
+  case Cost_option::kmeans: return "Kmeans";
+  default: return "";
+  }
+}
+
+// Kinds that estimate time, to which the cost components are added.
+bool is_time_cost(Cost_option cost)
+{
+  switch (cost) {
+  case Cost_option::latency: case Cost_option::recipthroughput: case Cost_option::sizeandlatency:
+  case Cost_option::mca: case Cost_option::criticalpath: case Cost_option::memory: case Cost_option::calibrated:
+  case Cost_option::kmeans:
+    return true;
+  default: return false;
+  }
+}
+
+const char *component_name(Cost_component component)
+{
+  switch (component) {
+  case Cost_component::misprediction: return "Misprediction";
+  case Cost_component::icache: return "Icache";
+  case Cost_component::libcall: return "Libcall";
   default: return "";
   }
 }
 
+// Expected fraction of mispredicted executions of a branch whose successors are taken with <probabilities>: the
+// entropy of the distribution, normalized so that a uniform choice among m successors mispredicts (m - 1) / m of the
+// time and a branch always taking the same successor never mispredicts.
+double misprediction_rate(const vector<double> &probabilities)
+{
+  double total{ 0 }, entropy{ 0 };
+  for (double p : probabilities) total += p;
+  if (probabilities.size() < 2 || total <= 0) return 0;
+  for (double p : probabilities)
+    if (p > 0) entropy -= (p / total) * log2(p / total);
+  double m = probabilities.size();
+  return entropy / log2(m) * (m - 1) / m;
+}
+
 bool is_llvm_cost(Cost_option cost)
 {
   switch (cost) {
@@ -96,27 +456,32 @@ TargetTransformInfo::TargetCostKind cost_opt_to_tti_cost(Cost_option cost)
   }
 }
 
-struct EstimateCostPass : public PassInfoMixin<EstimateCostPass> {
-  PreservedAnalyses run(Module &, ModuleAnalysisManager &);
-
-private:
-  void select_costs();
-  void print_freqs(Module &);
-  void compute_cost(Module &);
-  void compute_cost(Function &);
-  void compute_cost(BasicBlock &, TargetTransformInfo *);
-  void generate_yaml();
-  void generate_freqs_yaml();
+// Path of the source file of <scope>, ??? without debug information.
+string source_file(DIScope *scope)
+{
+  if (!scope) return "???";
+  SmallString<256> path{ scope->getFilename() };
+  if (!sys::path::is_absolute(path) && !scope->getDirectory().empty())
+    sys::path::append(path = scope->getDirectory(), scope->getFilename());
+  return string{ path };
+}
 
-  map<Cost_option, map<Function *, double>> costs_{};
-  bool llvm_cost_selected_{ false };
+// Source file and line of <instr>'s debug location, or its function's file and line 0 without one.
+pair<string, unsigned> source_line(Instruction &instr)
+{
+  if (const DebugLoc &loc{ instr.getDebugLoc() }) return { source_file(cast<DIScope>(loc.getScope())), loc.getLine() };
+  return { source_file(instr.getFunction()->getSubprogram()), 0 };
+}
 
-  FunctionCallFrequencyPass *wu_larus_ = nullptr;
-  FunctionAnalysisManager *fam_;
-  Module *module_;
-};
+// Source file and line of the definition of <fun>.
+pair<string, unsigned> source_line(Function &fun)
+{
+  DISubprogram *subprogram{ fun.getSubprogram() };
+  return { source_file(subprogram), subprogram ? subprogram->getLine() : 0 };
+}
 
-llvm::PreservedAnalyses EstimateCostPass::run(llvm::Module &module, llvm::ModuleAnalysisManager &mam) {
+void EstimateCostPass::init(Module &module, ModuleAnalysisManager &mam)
+{
 //-  outs() << "Estimate Cost Pass for module: [" << module.getName() << "]\n";;
   fam_ = &mam.getResult<FunctionAnalysisManagerModuleProxy>(module).getManager();
   module_ = &module;
@@ -124,63 +489,532 @@ llvm::PreservedAnalyses EstimateCostPass::run(llvm::Module &module, llvm::Module
 //  outs() << "\n\n********************[ Running Wu & Larus ]********************\n";
   wu_larus_ = &mam.getResult<FunctionCallFrequencyPass>(module);
 //  outs() << "\n\n********************[ Ran Wu & Larus ]********************\n";
+}
+
+llvm::PreservedAnalyses EstimateCostPass::run(llvm::Module &module, llvm::ModuleAnalysisManager &mam) {
+  init(module, mam);
   if (arg_freqs) {// Generate the frequencies only.
-    generate_freqs_yaml();
+    if (arg_binary_output.empty()) generate_freqs_yaml();
+    else write_binary(freqs_binary());
   } else {// Multiply frequencies by instruction costs.
     select_costs();
     compute_cost(module);
-    generate_yaml();
+    if (arg_binary_output.empty()) generate_yaml();
+    else write_binary(costs_binary());
+    if (!arg_callgrind_output.empty()) generate_callgrind();
+    if (!arg_folded_output.empty()) generate_folded_stacks();
+    if (!arg_linear_models.empty()) generate_linear_models_yaml();
   }
+  if (arg_binary_output.empty()) generate_budget_yaml();
   return llvm::PreservedAnalyses::all();
 }
 
+EstimateCostPass::Estimate EstimateCostPass::estimate(Module &module, ModuleAnalysisManager &mam, bool per_function)
+{
+  init(module, mam);
+  select_costs();
+  compute_cost(module);
+  Estimate result{};
+  for (auto &[cost_option, function_costs] : costs_) {
+    double &total{ result.totals[cost_option] };
+    for (Function &fun : module) {
+      auto found{ function_costs.find(&fun) };
+      if (found == function_costs.end()) continue;
+      total += found->second;
+      if (per_function) result.functions[cost_option].emplace_back(fun.getName().str(), found->second);
+    }
+  }
+  result.sampling_errors = sampling_errors_;
+  return result;
+}
+
+Binary_output::File EstimateCostPass::frequency_tables(Module &module, ModuleAnalysisManager &mam)
+{
+  init(module, mam);
+  return freqs_binary();
+}
+
+Binary_output::File EstimateCostPass::cost_tables(Module &module, ModuleAnalysisManager &mam)
+{
+  init(module, mam);
+  select_costs();
+  compute_cost(module);
+  return costs_binary();
+}
+
+/* Tables.
+  The runtime profile, calibrated costs, kmeans model and library call costs are read once per process and shared: the
+  tools estimate each module with a new pass, on several threads, and would otherwise parse them again per module. A
+  file modified since it was read is read again. A file that can't be read gives an empty table (and its error) each
+  time.
+***********************************************************************************************************************/
+template <typename Table>
+shared_ptr<const Table> load_table(const string &path)
+{
+  static mutex tables_mutex{};
+  static map<string, pair<sys::TimePoint<>, shared_ptr<const Table>>> tables{};
+  sys::fs::file_status status{};
+  sys::TimePoint<> modified{};
+  if (!sys::fs::status(path, status)) modified = status.getLastModificationTime();
+  lock_guard<mutex> lock{ tables_mutex };
+  auto found{ tables.find(path) };
+  if (found != tables.end() && found->second.first == modified) return found->second.second;
+  auto table{ make_shared<Table>() };
+  if (path.empty() || !table->load(path)) return table;
+  tables[path] = { modified, table };
+  return table;
+}
+
 void EstimateCostPass::select_costs()
 {
   stringstream ss{ arg_cost_opt };
   string cost{};
   costs_.clear();
+  if (arg_report_granularity == "function") report_granularity_ = Report_granularity::function;
+  else if (arg_report_granularity == "loop") report_granularity_ = Report_granularity::loop;
+  else if (arg_report_granularity == "block") report_granularity_ = Report_granularity::block;
+  else if (arg_report_granularity != "program") errs() << "Unrecognized report granularity [" << arg_report_granularity << "], using program\n";
+  attribute_lines_ = !arg_callgrind_output.empty() || !arg_folded_output.empty();
+  if (estimate_tier() == Estimate_tier::fast && (attribute_lines_ || report_granularity_ >= Report_granularity::loop)) {
+    errs() << "Warning: The fast tier (-estimate-tier=fast) has function costs only, no loop, block or line costs\n";
+    attribute_lines_ = false;
+    if (report_granularity_ >= Report_granularity::loop) report_granularity_ = Report_granularity::function;
+  }
   while (getline(ss, cost, ',')) {
-    if (cost == "latency") { costs_[Cost_option::latency] = {}; llvm_cost_selected_ = true; }
-    else if (cost == "recipthroughput") { costs_[Cost_option::recipthroughput] = {}; llvm_cost_selected_ = true; }
-    else if (cost == "codesize") { costs_[Cost_option::codesize] = {}; llvm_cost_selected_ = true; }
-    else if (cost == "sizeandlatency") { costs_[Cost_option::sizeandlatency] = {}; llvm_cost_selected_ = true; }
-    else if (cost == "one") costs_[Cost_option::one] = {};
-    else if (cost == "dynamic") costs_[Cost_option::dynamic] = {};
-    else errs() << "Unrecognized cost kind [" << cost << "]\n";
+    Cost_option cost_opt;
+    if (!parse_cost_option(cost, cost_opt)) {
+      errs() << "Unrecognized cost kind [" << cost << "]\n";
+      continue;
+    }
+    costs_[cost_opt] = {};
+    if (is_llvm_cost(cost_opt) || cost_opt == Cost_option::criticalpath || cost_opt == Cost_option::memory)
+      llvm_cost_selected_ = true;
+  }
+  if (estimate_tier() == Estimate_tier::precise) {// Memory modelling is part of the precise tier.
+    costs_[Cost_option::memory] = {};
+    llvm_cost_selected_ = true;
+  }
+  if (costs_.count(Cost_option::dynamic) || costs_.count(Cost_option::mca) || costs_.count(Cost_option::calibrated)) {
+    if (!parse_cost_option(arg_fallback_cost, fallback_cost_) || !(is_llvm_cost(fallback_cost_) || fallback_cost_ == Cost_option::one)) {
+      errs() << "Invalid fallback cost kind [" << arg_fallback_cost << "], using latency\n";
+      fallback_cost_ = Cost_option::latency;
+    }
+    if (is_llvm_cost(fallback_cost_)) llvm_cost_selected_ = true;
+  }
+  if (costs_.count(Cost_option::dynamic)) {
+    if (arg_runtime_profile.empty())
+      errs() << "No runtime profile given (-runtime-profile), dynamic cost will use the fallback cost kind only\n";
+    profile_ = load_table<Runtime_profile>(arg_runtime_profile);
+  }
+  if (costs_.count(Cost_option::calibrated)) {
+    if (arg_calibrated_costs.empty())
+      errs() << "No calibrated cost table given (-calibrated-costs), calibrated cost will use the fallback cost kind only\n";
+    calibrated_ = load_table<Calibrated_cost_table>(arg_calibrated_costs);
+    if (arg_calibrated_metric == "throughput") calibrated_throughput_ = true;
+    else if (arg_calibrated_metric != "latency") errs() << "Unrecognized calibrated metric [" << arg_calibrated_metric << "], using latency\n";
+  }
+  if (costs_.count(Cost_option::kmeans)) {
+    if (arg_kmeans_model.empty()) errs() << "No kmeans model given (-kmeans-model), kmeans cost will be 0\n";
+    kmeans_ = load_table<Kmeans_model>(arg_kmeans_model);
+    if (arg_kmeans_granularity == "function") kmeans_functions_ = true;
+    else if (arg_kmeans_granularity != "block") errs() << "Unrecognized kmeans granularity [" << arg_kmeans_granularity << "], using block\n";
+  }
+  if (costs_.count(Cost_option::mca)) {
+    if (arg_mca_metric == "latency") mca_.metric = Mca_metric::latency;
+    else if (arg_mca_metric == "rthroughput") mca_.metric = Mca_metric::rthroughput;
+    else errs() << "Unrecognized mca metric [" << arg_mca_metric << "], using rthroughput\n";
+    mca_.cpu = arg_mca_cpu;
+  }
+  if (costs_.count(Cost_option::criticalpath)) {
+    if (arg_ilp_resource_bound == "sched") ilp_sched_bound_ = true;
+    else if (arg_ilp_resource_bound != "tti") errs() << "Unrecognized resource bound [" << arg_ilp_resource_bound << "], using tti\n";
+    ilp_resources_.cpu = arg_mca_cpu;
+    ilp_breakdown_.clear();
+  }
+
+  access_stats_.clear();
+
+  components_.clear();
+  if (!arg_misprediction_penalty.empty()) {
+    components_[Cost_component::misprediction] = {};
+    stringstream penalties{ arg_misprediction_penalty };
+    string penalty{};
+    while (getline(penalties, penalty, ',')) {
+      auto [cpu, cycles] = StringRef{ penalty }.trim().rsplit('=');
+      double value{ 0 };
+      if ((cycles.empty() ? cpu : cycles).getAsDouble(value)) {
+        errs() << "Invalid misprediction penalty [" << penalty << "]\n";
+        continue;
+      }
+      if (cycles.empty()) misprediction_penalty_ = value;
+      else cpu_misprediction_penalty_[cpu] = value;
+    }
+  }
+  if (arg_icache) {
+    components_[Cost_component::icache] = {};
+    llvm_cost_selected_ = true; // Code size comes from TTI.
+    icache_.hot_threshold = arg_icache_hot_threshold;
+    icache_.l1_size = arg_icache_l1;
+    icache_.l2_size = arg_icache_l2;
+    icache_.line_size = arg_cache_line;
+    icache_.l2_latency = arg_icache_l2_latency;
+    icache_.memory_latency = arg_icache_memory_latency;
+  }
+  if (!arg_libcall_costs.empty() && !(libcalls_ = load_table<Libcall_cost_table>(arg_libcall_costs))->empty())
+    components_[Cost_component::libcall] = {};
+  targets_.clear();
+  if (!arg_estimate_targets.empty()) {
+    if (!llvm_cost_selected_) errs() << "Warning: -estimate-targets only applies to the TTI cost kinds, none selected\n";
+    stringstream cpus{ arg_estimate_targets };
+    string cpu{};
+    while (getline(cpus, cpu, ',')) {
+      Target_costs target{};
+      if (!target.model.init(*module_, cpu)) continue;
+      auto found{ cpu_misprediction_penalty_.find(cpu) };
+      target.misprediction_penalty = found != cpu_misprediction_penalty_.end() ? found->second : misprediction_penalty_;
+      targets_.push_back(std::move(target));
+    }
   }
 }
 
 void EstimateCostPass::compute_cost(Module &mod)
 {
-  for (Function &fun: mod)
+  auto is_hot{ [&](BasicBlock &bb) { return wu_larus_->get_global_block_frequency(&bb) >= arg_mca_hot_threshold; } };
+  if (costs_.count(Cost_option::mca) && !mca_.run(mod, is_hot))
+    errs() << "Error: Unable to compute the mca cost kind of [" << mod.getName()
+           << "], using the static fallback cost of every block\n";
+  if (ilp_sched_bound_ && !ilp_resources_.run(mod, [](BasicBlock &) { return true; }))
+    errs() << "Error: Unable to compute the scheduling model bound of the criticalpath cost kind of [" << mod.getName()
+           << "], using the dependence and issue width bounds only\n";
+  sampling_errors_.clear();
+  uncalibrated_.clear();
+  if (estimate_tier() == Estimate_tier::fast && arg_tier_sample_rate > 0 && arg_tier_sample_rate < 1) {
+    compute_sampled_cost(mod);
+  } else {
+    for (Function &fun: mod)
+      compute_cost(fun);
+  }
+  if (!targets_.empty()) compute_target_costs(mod);
+  warn_uncalibrated();
+}
+
+/* Sampled costs (fast tier).
+  Costs are computed per function (compute_function_cost). Functions never invoked are skipped, and the cold ones
+  (invoked less than -tier-cold-threshold times) are sampled at rate p: each is estimated with probability p, the
+  choice being a hash of its name so that it doesn't change from one run to the next, and its costs are divided by p
+  (Horvitz-Thompson estimator). The sampling error of a kind is two standard deviations of its total, the variance
+  being estimated by the sum of (1 - p) (cost / p)^2 over the sampled functions.
+***********************************************************************************************************************/
+void EstimateCostPass::compute_sampled_cost(Module &mod)
+{
+  const double rate{ arg_tier_sample_rate };
+  map<Cost_option, double> variances{};
+  for (Function &fun : mod) {
+    if (fun.empty()) continue;
+    double invocations{ wu_larus_->get_invocation_frequency(&fun) };
+    if (invocations == 0) continue;
+    if (invocations >= arg_tier_cold_threshold) {
+      compute_cost(fun);
+      continue;
+    }
+    if (static_cast<double>(xxHash64(fun.getName())) >= rate * static_cast<double>(UINT64_MAX)) continue;
     compute_cost(fun);
+    for (auto &[cost_opt, function_costs] : costs_) {
+      auto found{ function_costs.find(&fun) };
+      if (found == function_costs.end()) continue;
+      found->second /= rate;
+      variances[cost_opt] += (1 - rate) * found->second * found->second;
+    }
+    for (auto &[_, component_costs] : components_) {
+      auto found{ component_costs.find(&fun) };
+      if (found != component_costs.end()) found->second /= rate;
+    }
+  }
+  for (auto &[cost_opt, _] : costs_) sampling_errors_[cost_opt] = 2 * sqrt(variances[cost_opt]);
+}
+
+/* Per-target costs.
+  The block frequencies of each function are read once and shared by all the targets. Only the TTI cost kinds depend
+  on the CPU; the time kinds include the module's cost components, except for the misprediction component, priced
+  with each CPU's penalty.
+***********************************************************************************************************************/
+void EstimateCostPass::compute_target_costs(Module &mod)
+{
+  vector<Cost_option> kinds{};
+  for (auto &[cost_opt, _] : costs_)
+    if (is_llvm_cost(cost_opt)) kinds.push_back(cost_opt);
+  bool misprediction{ components_.count(Cost_component::misprediction) > 0 };
+  vector<double> freqs{};
+  for (Function &fun : mod) {
+    if (fun.empty()) continue;
+    freqs.clear();
+    for (BasicBlock &bb : fun) freqs.push_back(wu_larus_->get_global_block_frequency(&bb));
+    for (Target_costs &target : targets_) {
+      TargetTransformInfo tti{ target.model.tti(fun) };
+      size_t block{ 0 };
+      for (BasicBlock &bb : fun) {
+        double freq{ freqs[block++] };
+        if (freq == 0) continue;
+        for (Cost_option kind : kinds) target.totals[kind] += block_cost(bb, 0, kind, &tti) * freq;
+        if (misprediction) target.misprediction += misprediction_cost(bb, target.misprediction_penalty);
+      }
+    }
+  }
+  double components{ 0 };
+  for (auto &[component, function_costs] : components_)
+    if (component != Cost_component::misprediction)
+      for (auto &[_, cost] : function_costs) components += cost;
+  for (Target_costs &target : targets_)
+    for (auto &[kind, total] : target.totals)
+      if (is_time_cost(kind)) total += components + target.misprediction;
 }
 
 void EstimateCostPass::compute_cost(Function &fun)
 {
-  // if (granularity == function) ...
-  for (BasicBlock &bb: fun)
-    compute_cost(bb, llvm_cost_selected_ ? &fam_->getResult<TargetIRAnalysis>(*bb.getParent()) : nullptr);
+  TargetTransformInfo *tti{ llvm_cost_selected_ && !fun.empty() ? &fam_->getResult<TargetIRAnalysis>(fun) : nullptr };
+  uint64_t block_id{ 0 }; // Block ordinal, the id used by the instrumentation.
+  if (estimate_tier() == Estimate_tier::fast) {
+    compute_function_cost(fun, tti);
+  } else {
+    for (BasicBlock &bb: fun)
+      compute_cost(bb, block_id++, tti);
+  }
+  if (kmeans_functions_ && !fun.empty()) {
+    vector<double> histogram(kmeans_->dimensions(), 0);
+    for (Instruction &instr : instructions(fun))
+      if (instr.getOpcode() < histogram.size()) histogram[instr.getOpcode()] += 1;
+    costs_[Cost_option::kmeans][&fun] = kmeans_->cost(histogram) * wu_larus_->get_invocation_frequency(&fun);
+  }
+
+  if (fun.empty() || components_.empty()) return;
+  if (components_.count(Cost_component::misprediction)) {
+    auto found{ cpu_misprediction_penalty_.find(fun.getFnAttribute("target-cpu").getValueAsString()) };
+    double penalty{ found != cpu_misprediction_penalty_.end() ? found->second : misprediction_penalty_ };
+    for (BasicBlock &bb : fun)
+      components_[Cost_component::misprediction][&fun] += misprediction_cost(bb, penalty);
+  }
+  if (components_.count(Cost_component::icache)) {
+    components_[Cost_component::icache][&fun] = icache_.penalty(
+      fun, fam_->getResult<LoopAnalysis>(fun), wu_larus_->get_invocation_frequency(&fun),
+      [&](BasicBlock &bb) { return block_cost(bb, 0, Cost_option::codesize, tti) * arg_icache_bytes_per_unit; },
+      [&](BasicBlock &bb) { return wu_larus_->get_global_block_frequency(&bb); });
+  }
+  if (components_.count(Cost_component::libcall)) {
+    for (BasicBlock &bb : fun)
+      components_[Cost_component::libcall][&fun] += libcall_cost(bb) * wu_larus_->get_global_block_frequency(&bb);
+  }
+  for (auto &[cost_opt, function_costs] : costs_) {
+    if (!is_time_cost(cost_opt)) continue;
+    for (auto &[_, component_costs] : components_) function_costs[&fun] += component_costs[&fun];
+  }
+}
+
+// Expected cycles a single execution of <bb> waits for the cache lines its loads and stores bring in each iteration.
+double EstimateCostPass::memory_cost(BasicBlock &bb)
+{
+  Function &fun{ *bb.getParent() };
+  Loop *loop{ fam_->getResult<LoopAnalysis>(fun).getLoopFor(&bb) };
+  if (!loop) return 0; // Accesses outside loops run once per invocation.
+  ScalarEvolution &se{ fam_->getResult<ScalarEvolutionAnalysis>(fun) };
+  double freq{ wu_larus_->get_global_block_frequency(&bb) };
+  double cost{ 0 };
+  for (Instruction &instr : bb) {
+    if (!isa<LoadInst>(instr) && !isa<StoreInst>(instr)) continue;
+    Memory_access access{ classify_access(instr, *loop, se, arg_cache_line) };
+    double latency{ access.pattern == Access_pattern::irregular ? arg_memory_miss_latency : arg_memory_stream_latency };
+    cost += access.lines * latency;
+    access_stats_[access.pattern].count += 1;
+    access_stats_[access.pattern].cost += access.lines * latency * freq;
+  }
+  return cost;
 }
 
-void EstimateCostPass::compute_cost(BasicBlock &bb, TargetTransformInfo *tti)
+// Cycles spent in the external library calls of a single execution of <bb>.
+double EstimateCostPass::libcall_cost(BasicBlock &bb)
+{
+  double cost{ 0 };
+  for (Instruction &instr : bb) {
+    double cycles{ 0 };
+    if (auto *call{ dyn_cast<CallBase>(&instr) }; call && libcalls_->cost(*call, arg_libcall_unknown_size, cycles))
+      cost += cycles;
+  }
+  return cost;
+}
+
+// Expected cycles lost by the mispredictions of <bb>'s terminator over all of its executions.
+double EstimateCostPass::misprediction_cost(BasicBlock &bb, double penalty)
+{
+  Instruction *term{ bb.getTerminator() };
+  auto *branch{ dyn_cast<BranchInst>(term) };
+  if (!(branch && branch->isConditional()) && !isa<SwitchInst>(term)) return 0;
+  double local_freq{ wu_larus_->get_local_block_frequency(&bb) };
+  if (local_freq <= 0) return 0;
+  SmallPtrSet<BasicBlock *, 8> seen{};
+  vector<double> probabilities{};
+  for (BasicBlock *succ : successors(&bb)) // Cases sharing a destination are a single edge.
+    if (seen.insert(succ).second)
+      probabilities.push_back(wu_larus_->get_local_edge_frequency(&bb, succ) / local_freq);
+  return wu_larus_->get_global_block_frequency(&bb) * misprediction_rate(probabilities) * penalty;
+}
+
+void EstimateCostPass::compute_cost(BasicBlock &bb, uint64_t block_id, TargetTransformInfo *tti)
 {
   Function *fun = bb.getParent();
   double freq{ wu_larus_->get_global_block_frequency(&bb) };
-  for (auto &[cost_opt, _] : costs_) {
-    // Default LLVM costs from TargetIRAnalysis.
-    if (cost_opt == Cost_option::one) {
-      costs_[cost_opt][fun] += bb.size() * freq;
-    } else if (cost_opt == Cost_option::dynamic) {
-      // TODO.
-    } else if (is_llvm_cost(cost_opt)) {
-      for (Instruction &instr : bb) {
-        auto tti_cost{ tti->getInstructionCost(&instr, cost_opt_to_tti_cost(cost_opt)).getValue() };
-        double icost{ tti_cost.hasValue() ? static_cast<double>(tti_cost.getValue()) : 0 };
-        costs_[cost_opt][fun] += icost * freq;
-      }
+  size_t kind{ 0 };
+  for (auto &[cost_opt, function_costs] : costs_) {
+    double cost{ block_cost(bb, block_id, cost_opt, tti) * freq };
+    function_costs[fun] += cost;
+    if (report_granularity_ >= Report_granularity::loop) block_costs_[cost_opt][&bb] = cost;
+    if (attribute_lines_) attribute_lines(bb, cost_opt, kind++, cost, tti);
+  }
+  if (!attribute_lines_) return;
+  for (Instruction &instr : bb) {
+    auto *call{ dyn_cast<CallBase>(&instr) };
+    Function *callee{ call ? call->getCalledFunction() : nullptr };
+    if (!callee || callee->isDeclaration()) continue;
+    call_sites_.push_back({ fun, callee, source_line(instr), freq });
+    callees_[fun][callee] = wu_larus_->get_local_call_frequency({ fun, callee });
+  }
+}
+
+// Fast tier: the costs of a single invocation of <fun>, times its invocation frequency, without the loop, block and
+// line costs of the reports.
+void EstimateCostPass::compute_function_cost(Function &fun, TargetTransformInfo *tti)
+{
+  map<Cost_option, double> invocation{};
+  uint64_t block_id{ 0 };
+  for (BasicBlock &bb : fun) {
+    double freq{ wu_larus_->get_local_block_frequency(&bb) };
+    for (auto &[cost_opt, _] : costs_) invocation[cost_opt] += block_cost(bb, block_id, cost_opt, tti) * freq;
+    ++block_id;
+  }
+  double invocations{ wu_larus_->get_invocation_frequency(&fun) };
+  for (auto &[cost_opt, function_costs] : costs_) function_costs[&fun] += invocation[cost_opt] * invocations;
+}
+
+// Cost of a single execution of <bb>.
+double EstimateCostPass::block_cost(BasicBlock &bb, uint64_t block_id, Cost_option cost_opt, TargetTransformInfo *tti)
+{
+  double cost{ 0 };
+  if (cost_opt == Cost_option::one) {
+    cost = bb.size();
+  } else if (cost_opt == Cost_option::dynamic) {
+    // Measured average cycles, or the static fallback for blocks the profile never saw executing.
+    if (const Block_profile *measured{ profile_->lookup(bb.getParent()->getName(), block_id) })
+      cost = measured->average;
+    else
+      cost = block_cost(bb, block_id, fallback_cost_, tti);
+  } else if (cost_opt == Cost_option::mca) {
+    // Scheduling model cost of the generated code, or the static fallback for blocks that were not lowered.
+    if (const double *modelled{ mca_.lookup(&bb) })
+      cost = *modelled;
+    else
+      cost = block_cost(bb, block_id, fallback_cost_, tti);
+  } else if (cost_opt == Cost_option::criticalpath) {
+    Ilp_block_cost ilp{ compute_ilp_block_cost(bb, *tti, arg_ilp_issue_width) };
+    if (ilp_sched_bound_) {
+      const double *sched_bound{ ilp_resources_.lookup(&bb) };
+      ilp.resource_bound = sched_bound ? *sched_bound : 0;
     }
+    if (arg_ilp_breakdown)
+      ilp_breakdown_.push_back({ bb.getParent(), block_id, wu_larus_->get_global_block_frequency(&bb), ilp });
+    cost = ilp.cost();
+  } else if (cost_opt == Cost_option::memory) {
+    cost = block_cost(bb, block_id, Cost_option::latency, tti) + memory_cost(bb);
+  } else if (cost_opt == Cost_option::kmeans) {
+    if (kmeans_functions_) return 0; // Charged to the whole function.
+    vector<double> histogram(kmeans_->dimensions(), 0);
+    for (Instruction &instr : bb)
+      if (instr.getOpcode() < histogram.size()) histogram[instr.getOpcode()] += 1;
+    cost = kmeans_->cost(histogram);
+  } else if (is_llvm_cost(cost_opt) || cost_opt == Cost_option::calibrated) {
+    // Default LLVM costs from TargetIRAnalysis, or measured opcode costs.
+    for (Instruction &instr : bb)
+      cost += instruction_cost(instr, cost_opt, tti);
   }
+  return cost;
+}
+
+// Static cost of <instr> for a TTI cost kind, one or calibrated.
+double EstimateCostPass::instruction_cost(Instruction &instr, Cost_option cost_opt, TargetTransformInfo *tti)
+{
+  if (cost_opt == Cost_option::one) return 1;
+  if (cost_opt == Cost_option::calibrated) {
+    // Measured opcode costs, or the static fallback for the opcodes the table doesn't have.
+    if (const Opcode_cost *measured{ calibrated_->lookup(instr) })
+      return calibrated_throughput_ ? measured->throughput : measured->latency;
+    if (!calibrated_->empty()) uncalibrated_.insert(opcode_cost_key(instr));
+    return instruction_cost(instr, fallback_cost_, tti);
+  }
+  auto tti_cost{ tti->getInstructionCost(&instr, cost_opt_to_tti_cost(cost_opt)).getValue() };
+  return tti_cost.hasValue() ? static_cast<double>(tti_cost.getValue()) : 0;
+}
+
+// Report the opcodes and types of the calibrated cost kind that the table doesn't have (see
+// calibration/opcode_calibration.cc for those it covers), once per process: the tools estimate many modules.
+void EstimateCostPass::warn_uncalibrated()
+{
+  static mutex warned_mutex{};
+  static set<pair<string, string>> warned{};
+  if (uncalibrated_.empty()) return;
+  lock_guard<mutex> lock{ warned_mutex };
+  for (const pair<string, string> &key : uncalibrated_)
+    if (warned.insert(key).second)
+      errs() << "Warning: No calibrated cost for [" << key.first << ' ' << key.second
+             << "], using the fallback cost kind [" << cost_name(fallback_cost_) << "]\n";
+}
+
+// Split <cost>, the cost of kind <cost_opt> (the <kind>th of costs_) of all executions of <bb>, among the source lines of
+// its instructions: in proportion to the instruction costs for the kinds computed per instruction, evenly among the
+// instructions for the kinds computed per block.
+void EstimateCostPass::attribute_lines(BasicBlock &bb, Cost_option cost_opt, size_t kind, double cost,
+                                       TargetTransformInfo *tti)
+{
+  bool per_instruction{ is_llvm_cost(cost_opt) || cost_opt == Cost_option::one || cost_opt == Cost_option::calibrated };
+  vector<double> weights{};
+  double total{ 0 };
+  for (Instruction &instr : bb) {
+    double weight{ isa<DbgInfoIntrinsic>(instr) ? 0 : per_instruction ? instruction_cost(instr, cost_opt, tti) : 1 };
+    weights.push_back(weight);
+    total += weight;
+  }
+  auto &lines{ line_costs_[bb.getParent()] };
+  size_t i{ 0 };
+  for (Instruction &instr : bb) {
+    double share{ total > 0 ? weights[i++] / total : 1.0 / weights.size() };
+    if (share == 0) continue;
+    vector<double> &line_cost{ lines[source_line(instr)] };
+    line_cost.resize(costs_.size());
+    line_cost[kind] += cost * share;
+  }
+}
+
+// Cost of one invocation of <fun> attributed to its own lines, per cost kind.
+vector<double> EstimateCostPass::self_cost(Function *fun)
+{
+  vector<double> cost(costs_.size(), 0);
+  double invocations{ wu_larus_->get_invocation_frequency(fun) };
+  if (invocations <= 0) return cost;
+  for (auto &[_, line_cost] : line_costs_[fun])
+    for (size_t kind = 0; kind < cost.size(); ++kind) cost[kind] += line_cost[kind] / invocations;
+  return cost;
+}
+
+// Cost of one invocation of <fun> including its callees, per cost kind. Calls closing a recursion cycle (to a function
+// in <active>) only count the callee's self cost.
+vector<double> EstimateCostPass::inclusive_cost(Function *fun, map<Function *, vector<double>> &memo,
+                                                set<Function *> &active)
+{
+  if (auto found{ memo.find(fun) }; found != memo.end()) return found->second;
+  vector<double> cost{ self_cost(fun) };
+  active.insert(fun);
+  for (auto &[callee, calls] : callees_[fun]) {
+    vector<double> callee_cost{ active.count(callee) ? self_cost(callee) : inclusive_cost(callee, memo, active) };
+    for (size_t kind = 0; kind < cost.size(); ++kind) cost[kind] += calls * callee_cost[kind];
+  }
+  active.erase(fun);
+  return memo[fun] = cost;
 }
 
 void EstimateCostPass::print_freqs(Module &module)
@@ -210,14 +1044,152 @@ void EstimateCostPass::generate_yaml()
     for (auto &[_, cost] : function_costs) program_cost += cost;
     outs() << "- Option:\n";
     outs() << "    Name: " << cost_name(cost_option) << '\n';
-    // outs() << "    Functions:\n";
-    // for (auto &[function, cost] : function_costs) {
-    //   outs() << "    - Function:\n"
-    //          << "        Name: " << function->getName() << '\n'
-    //          << "        Cost: " << cost << '\n';
-    //   program_cost += cost;
-    // }
     outs() << "    Total cost: " << program_cost << '\n';
+    if (report_granularity_ != Report_granularity::program) generate_report(cost_option, program_cost);
+  }
+  if (!components_.empty()) {// Already included in the total of the time cost kinds.
+    outs() << "Cost_components:\n";
+    for (auto &[component, function_costs] : components_) {
+      double program_cost{ 0 };
+      for (auto &[_, cost] : function_costs) program_cost += cost;
+      outs() << "- Component:\n"
+             << "    Name: " << component_name(component) << '\n'
+             << "    Total cost: " << program_cost << '\n';
+    }
+  }
+  if (!targets_.empty()) {
+    outs() << "Targets:\n";
+    for (Target_costs &target : targets_) {
+      outs() << "- Target:\n"
+             << "    CPU: " << target.model.cpu() << '\n'
+             << "    Cost_options:\n";
+      for (auto &[cost_option, total] : target.totals) {
+        outs() << "    - Option:\n"
+               << "        Name: " << cost_name(cost_option) << '\n'
+               << "        Total cost: " << total << '\n';
+      }
+    }
+  }
+  if (!access_stats_.empty()) {
+    outs() << "Memory_accesses:\n";
+    for (auto &[pattern, stats] : access_stats_) {
+      outs() << "- Pattern:\n"
+             << "    Name: " << access_pattern_name(pattern) << '\n'
+             << "    Count: " << stats.count << '\n'
+             << "    Cost: " << stats.cost << '\n';
+    }
+  }
+  Estimate_tier tier{ estimate_tier() };
+  if (tier != Estimate_tier::standard || !arg_tier_errors.empty()) {
+    Tier_error_table errors{};
+    if (!arg_tier_errors.empty()) errors.load(arg_tier_errors);
+    outs() << "Tier:\n"
+           << "  Name: " << estimate_tier_name(tier) << '\n'
+           << "  Cost_options:\n";
+    for (auto &[cost_option, _] : costs_) {
+      outs() << "  - Option:\n"
+             << "      Name: " << cost_name(cost_option) << '\n';
+      if (const Tier_error *error{ errors.find(estimate_tier_name(tier), cost_name(cost_option)) }) {
+        outs() << "      Calibration files: " << error->files << '\n'
+               << "      Mean error: " << error->mean << '\n'
+               << "      P90 error: " << error->p90 << '\n'
+               << "      Max error: " << error->max << '\n';
+      }
+      auto sampling{ sampling_errors_.find(cost_option) };
+      if (sampling != sampling_errors_.end()) outs() << "      Sampling error: " << sampling->second << '\n';
+    }
+  }
+  if (!ilp_breakdown_.empty()) {
+    outs() << "Criticalpath_blocks:\n";
+    for (auto &[fun, block_id, freq, ilp] : ilp_breakdown_) {
+      outs() << "- Block:\n"
+             << "    Function: " << fun->getName() << '\n'
+             << "    ID: " << block_id << '\n'
+             << "    Freq: " << freq << '\n'
+             << "    Latency: " << ilp.latency << '\n'
+             << "    Critical path: " << ilp.critical_path << '\n'
+             << "    Resource bound: " << ilp.resource_bound << '\n'
+             << "    Cost: " << ilp.cost() << '\n';
+    }
+  }
+}
+
+/* Cost report.
+  The functions, loops or blocks of <cost_option>, most costly first, with their share of <program_cost>. Function costs
+  include the cost components; loop and block costs don't, as components are charged to whole functions. A loop's cost
+  includes its inner loops. Blocks are identified by their ordinal in the function, as in the instrumentation.
+***********************************************************************************************************************/
+void EstimateCostPass::generate_report(Cost_option cost_option, double program_cost)
+{
+  auto share = [&](double cost) { return program_cost != 0 ? cost / program_cost : 0; };
+  if (report_granularity_ == Report_granularity::function) {
+    Hot_list<Function *> hot{ arg_report_top };
+    for (Function &fun : *module_)
+      if (!fun.empty()) hot.add(&fun, costs_[cost_option][&fun]);
+    outs() << "    Functions:\n";
+    for (auto &[fun, cost] : hot.sorted()) {
+      outs() << "    - Function:\n"
+             << "        Name: " << fun->getName() << '\n'
+             << "        Cost: " << cost << '\n'
+             << "        Share: " << share(cost) << '\n';
+    }
+    return;
+  }
+
+  struct Block_ref { BasicBlock *bb; uint64_t id; unsigned depth; };
+  DenseMap<BasicBlock *, double> &block_costs{ block_costs_[cost_option] };
+  Hot_list<Block_ref> hot{ arg_report_top };
+  for (Function &fun : *module_) {
+    if (fun.empty()) continue;
+    LoopInfo &loops{ fam_->getResult<LoopAnalysis>(fun) };
+    DenseMap<BasicBlock *, uint64_t> block_ids{};
+    for (BasicBlock &bb : fun) block_ids[&bb] = block_ids.size();
+    if (report_granularity_ == Report_granularity::block) {
+      for (BasicBlock &bb : fun) hot.add({ &bb, block_ids[&bb], loops.getLoopDepth(&bb) }, block_costs.lookup(&bb));
+      continue;
+    }
+    for (Loop *loop : loops.getLoopsInPreorder()) {
+      double cost{ 0 };
+      for (BasicBlock *bb : loop->blocks()) cost += block_costs.lookup(bb);
+      hot.add({ loop->getHeader(), block_ids[loop->getHeader()], loop->getLoopDepth() }, cost);
+    }
+  }
+  bool blocks{ report_granularity_ == Report_granularity::block };
+  outs() << (blocks ? "    Blocks:\n" : "    Loops:\n");
+  for (auto &[ref, cost] : hot.sorted()) {
+    outs() << (blocks ? "    - Block:\n" : "    - Loop:\n")
+           << "        Function: " << ref.bb->getParent()->getName() << '\n'
+           << (blocks ? "        ID: " : "        Header: ") << ref.id << '\n'
+           << "        Depth: " << ref.depth << '\n'
+           << "        Cost: " << cost << '\n'
+           << "        Share: " << share(cost) << '\n';
+  }
+}
+
+void EstimateCostPass::generate_linear_models_yaml()
+{
+  Linear_models models{};
+  if (!models.load(arg_linear_models)) return;
+  Opcode_matrix matrix{};
+  for (Function &fun : *module_)
+    if (!fun.empty()) matrix.add_function(fun, [&](BasicBlock &bb) { return wu_larus_->get_global_block_frequency(&bb); });
+  vector<double> costs{ models.evaluate(matrix) };
+
+  size_t functions{ matrix.num_functions() };
+  outs() << "Linear_models:\n";
+  for (size_t model = 0; model < models.size(); ++model) {
+    double program_cost{ 0 };
+    for (size_t fun = 0; fun < functions; ++fun) program_cost += costs[model * functions + fun];
+    outs() << "- Model:\n"
+           << "    Name: " << models.name(model) << '\n'
+           << "    Total cost: " << program_cost << '\n';
+    if (!arg_linear_models_per_function) continue;
+    outs() << "    Functions:\n";
+    for (size_t fun = 0; fun < functions; ++fun) {
+      outs() << "    - Function:\n"
+             << "        Name: " << matrix.function(fun)->getName() << '\n'
+             << "        Cost: " << costs[model * functions + fun] << '\n';
+    }
   }
 }
 
@@ -235,18 +1207,258 @@ void EstimateCostPass::generate_freqs_yaml()
            << "        BasicBlocks:\n";
     for (BasicBlock &bb : fun) {
       double bfreq{ wu_larus_->get_global_block_frequency(&bb) };
-      map<unsigned, unsigned long> histogram{}; // Opcode -> count.
+      array<unsigned long, Instruction::OtherOpsEnd> histogram{}; // Opcode -> count.
       outs() << "          - BasicBlock:\n";
       for (Instruction &instr : bb) histogram[instr.getOpcode()] += 1;
       outs() << "              Freq: " << bfreq << '\n'
              << "              Histogram:\n";
-      for (auto &[opcode, count] : histogram) {
-        outs() << "                - " << opcode << ": " << count << '\n';
+      for (unsigned opcode = 0; opcode < histogram.size(); ++opcode) {
+        if (histogram[opcode]) outs() << "                - " << opcode << ": " << histogram[opcode] << '\n';
       }
     }
   }
 }
 
+// What the Wu-Larus analyses left out to stay within their budget (-wu-larus-step-budget, -wu-larus-time-budget),
+// if anything: the functions with loop depth frequencies, the indirect calls points-to gave up on, and the recursion.
+void EstimateCostPass::generate_budget_yaml()
+{
+  vector<Function *> degraded{ wu_larus_->degraded_functions() };
+  if (degraded.empty() && !wu_larus_->points2_truncated() && !wu_larus_->recursion_degraded()) return;
+  outs() << "Analysis_budget:\n"
+         << "  Truncated indirect calls: " << wu_larus_->points2_truncated() << '\n'
+         << "  Recursion degraded: " << (wu_larus_->recursion_degraded() ? "true" : "false") << '\n'
+         << "  Degraded functions:\n";
+  for (Function *fun : degraded) outs() << "  - " << fun->getName() << '\n';
+}
+
+// The frequencies YAML as tables: module (name), functions (name, id, freq, block_end) and blocks (function row, id,
+// freq, opcode counts, a matrix with one column per opcode).
+Binary_output::File EstimateCostPass::freqs_binary()
+{
+  constexpr unsigned num_opcodes{ Instruction::OtherOpsEnd };
+  Binary_output::Table module{ "module", 1 }, functions{ "functions" }, blocks{ "blocks" };
+  module.add_strings("name", { module_->getName().str() });
+  vector<string> names{};
+  vector<uint32_t> function_ids{}, block_function{}, block_ids{}, opcodes{};
+  vector<uint64_t> block_end{};
+  vector<double> function_freqs{}, block_freqs{};
+  uint32_t function_id{ 0 };
+  for (Function &fun : *module_) {
+    uint32_t id{ function_id++ };
+    if (fun.empty() && !fun.isMaterializable()) continue;
+    uint32_t row = names.size();
+    names.push_back(fun.getName().str());
+    function_ids.push_back(id);
+    function_freqs.push_back(wu_larus_->get_invocation_frequency(&fun));
+    uint32_t block_id{ 0 };
+    for (BasicBlock &bb : fun) {
+      block_function.push_back(row);
+      block_ids.push_back(block_id++);
+      block_freqs.push_back(wu_larus_->get_global_block_frequency(&bb));
+      opcodes.resize(opcodes.size() + num_opcodes, 0);
+      uint32_t *histogram{ &opcodes[opcodes.size() - num_opcodes] };
+      for (Instruction &instr : bb) histogram[instr.getOpcode()] += 1;
+    }
+    block_end.push_back(block_ids.size());
+  }
+  functions.rows = names.size();
+  functions.add_strings("name", names);
+  functions.add("id", function_ids);
+  functions.add("freq", function_freqs);
+  functions.add("block_end", block_end);
+  blocks.rows = block_ids.size();
+  blocks.add("function", block_function);
+  blocks.add("id", block_ids);
+  blocks.add("freq", block_freqs);
+  blocks.add("opcodes", opcodes, num_opcodes);
+  return { Binary_output::Kind::frequencies, { module, functions, blocks } };
+}
+
+// The costs as tables: options and components (name, total) and functions (name, id, costs: a matrix with one column
+// per option, in the order of the options table).
+Binary_output::File EstimateCostPass::costs_binary()
+{
+  Binary_output::Table options{ "options" }, components{ "components" }, functions{ "functions" };
+  vector<string> names{};
+  vector<double> totals{};
+  for (auto &[cost_option, function_costs] : costs_) {
+    double program_cost{ 0 };
+    for (auto &[_, cost] : function_costs) program_cost += cost;
+    names.push_back(cost_name(cost_option));
+    totals.push_back(program_cost);
+  }
+  options.rows = names.size();
+  options.add_strings("name", names);
+  options.add("total", totals);
+  names.clear();
+  totals.clear();
+  for (auto &[component, function_costs] : components_) {
+    double program_cost{ 0 };
+    for (auto &[_, cost] : function_costs) program_cost += cost;
+    names.push_back(component_name(component));
+    totals.push_back(program_cost);
+  }
+  components.rows = names.size();
+  components.add_strings("name", names);
+  components.add("total", totals);
+
+  names.clear();
+  vector<uint32_t> ids{};
+  vector<double> costs{};
+  uint32_t id{ 0 };
+  for (Function &fun : *module_) {
+    if (!fun.empty()) {
+      names.push_back(fun.getName().str());
+      ids.push_back(id);
+      for (auto &[_, function_costs] : costs_) {
+        auto found{ function_costs.find(&fun) };
+        costs.push_back(found != function_costs.end() ? found->second : 0);
+      }
+    }
+    ++id;
+  }
+  functions.rows = names.size();
+  functions.add_strings("name", names);
+  functions.add("id", ids);
+  functions.add("costs", costs, costs_.size());
+
+  // One row per target and TTI cost kind.
+  Binary_output::Table targets{ "targets" };
+  vector<string> cpus{};
+  names.clear();
+  totals.clear();
+  for (Target_costs &target : targets_) {
+    for (auto &[cost_option, total] : target.totals) {
+      cpus.push_back(target.model.cpu());
+      names.push_back(cost_name(cost_option));
+      totals.push_back(total);
+    }
+  }
+  targets.rows = names.size();
+  targets.add_strings("cpu", cpus);
+  targets.add_strings("option", names);
+  targets.add("total", totals);
+  return { Binary_output::Kind::costs, { options, components, functions, targets } };
+}
+
+/* Callgrind output.
+  Costs are per source line (positions: line) and rounded to integers, one event per cost kind. The cost of a call line
+  is the inclusive cost of the callee times the estimated number of calls from that site. Instructions inlined from
+  another file are reported under fi= of their own file.
+***********************************************************************************************************************/
+void EstimateCostPass::generate_callgrind()
+{
+  std::error_code error{};
+  raw_fd_ostream output{ arg_callgrind_output, error };
+  if (error) {
+    errs() << "Error: Unable to open file [" << arg_callgrind_output << "] for writing: " << error.message() << '\n';
+    return;
+  }
+  auto write_costs = [&](unsigned line, const vector<double> &costs) {
+    output << line;
+    for (double cost : costs) output << ' ' << llround(cost);
+    output << '\n';
+  };
+
+  vector<double> summary(costs_.size(), 0);
+  for (auto &[_, lines] : line_costs_)
+    for (auto &[_, line_cost] : lines)
+      for (size_t kind = 0; kind < summary.size(); ++kind) summary[kind] += line_cost[kind];
+  output << "# callgrind format\nversion: 1\ncreator: EstimateCostPass\npositions: line\nevents:";
+  for (auto &[cost_opt, _] : costs_) output << ' ' << cost_name(cost_opt);
+  output << "\nsummary:";
+  for (double cost : summary) output << ' ' << llround(cost);
+  output << "\n";
+
+  map<Function *, vector<double>> inclusive{};
+  set<Function *> active{};
+  for (Function &fun : *module_) {
+    if (fun.empty()) continue;
+    string file{ source_line(fun).first };
+    output << "\nfl=" << file << "\nfn=" << fun.getName() << '\n';
+    string current{ file };
+    for (auto &[line, line_cost] : line_costs_[&fun]) {
+      if (line.first != current) output << "fi=" << (current = line.first) << '\n';
+      write_costs(line.second, line_cost);
+    }
+    for (Call_site &site : call_sites_) {
+      if (site.caller != &fun) continue;
+      if (site.line.first != current) output << "fi=" << (current = site.line.first) << '\n';
+      auto callee_line{ source_line(*site.callee) };
+      output << "cfi=" << callee_line.first << "\ncfn=" << site.callee->getName() << '\n'
+             << "calls=" << llround(site.calls) << ' ' << callee_line.second << '\n';
+      vector<double> cost{ inclusive_cost(site.callee, inclusive, active) };
+      for (double &kind_cost : cost) kind_cost *= site.calls;
+      write_costs(site.line.second, cost);
+    }
+  }
+}
+
+/* Folded stacks.
+  One line per call path from the functions no other function calls, "root;caller;callee cost", with the self cost of
+  the last function along that path for the first cost kind, rounded to an integer. Paths are followed while their
+  inclusive cost is at least -callpath-threshold of the total, and stop at recursive calls.
+***********************************************************************************************************************/
+void EstimateCostPass::generate_folded_stacks()
+{
+  std::error_code error{};
+  raw_fd_ostream output{ arg_folded_output, error };
+  if (error) {
+    errs() << "Error: Unable to open file [" << arg_folded_output << "] for writing: " << error.message() << '\n';
+    return;
+  }
+  Cost_option first_cost{};
+  if (!first_cost_option(first_cost) || !costs_.count(first_cost))
+    return;
+  size_t kind{ static_cast<size_t>(distance(costs_.begin(), costs_.find(first_cost))) };
+
+  map<Function *, vector<double>> inclusive{};
+  set<Function *> active{}, on_path{}, called{};
+  double total{ 0 };
+  for (auto &[caller, calls] : callees_)
+    for (auto &[callee, _] : calls)
+      if (callee != caller) called.insert(callee);
+  for (auto &[fun, _] : line_costs_) total += self_cost(fun)[kind] * wu_larus_->get_invocation_frequency(fun);
+  double threshold{ arg_callpath_threshold * total };
+
+  vector<Function *> path{};
+  function<void(Function *, double)> fold = [&](Function *fun, double invocations) {
+    path.push_back(fun);
+    on_path.insert(fun);
+    if (long cost{ llround(self_cost(fun)[kind] * invocations) }; cost > 0) {
+      for (size_t i = 0; i < path.size(); ++i) output << (i ? ";" : "") << path[i]->getName();
+      output << ' ' << cost << '\n';
+    }
+    for (auto &[callee, calls] : callees_[fun]) {
+      if (on_path.count(callee)) continue;
+      double callee_invocations{ invocations * calls };
+      if (inclusive_cost(callee, inclusive, active)[kind] * callee_invocations >= threshold)
+        fold(callee, callee_invocations);
+    }
+    on_path.erase(fun);
+    path.pop_back();
+  };
+  for (Function &fun : *module_)
+    if (!fun.empty() && !called.count(&fun)) fold(&fun, wu_larus_->get_invocation_frequency(&fun));
+}
+
+void EstimateCostPass::write_binary(const Binary_output::File &file)
+{
+  string data{ Binary_output::serialize(file, arg_binary_compress) };
+  if (arg_binary_output == "-") {
+    outs() << data;
+    return;
+  }
+  std::error_code error{};
+  raw_fd_ostream output{ arg_binary_output, error };
+  if (error) {
+    errs() << "Error: Unable to open file [" << arg_binary_output << "] for writing: " << error.message() << '\n';
+    return;
+  }
+  output << data;
+}
+
 
 extern "C" LLVM_ATTRIBUTE_WEAK llvm::PassPluginLibraryInfo llvmGetPassPluginInfo() {
   return {
@@ -261,6 +1473,20 @@ extern "C" LLVM_ATTRIBUTE_WEAK llvm::PassPluginLibraryInfo llvmGetPassPluginInfo
           }
           return false;
         });
+      static bool trajectory_registered{ false };
+      if (!arg_cost_trajectory.empty() && pb.getPassInstrumentationCallbacks() && !trajectory_registered) {
+        Cost_option cost{};
+        if (!parse_cost_option(arg_trajectory_cost, cost) || !(is_llvm_cost(cost) || cost == Cost_option::one)) {
+          errs() << "Invalid trajectory cost kind [" << arg_trajectory_cost << "], using latency\n";
+          cost = Cost_option::latency;
+        }
+        llvm::Optional<TargetTransformInfo::TargetCostKind> kind{};
+        if (is_llvm_cost(cost)) kind = cost_opt_to_tti_cost(cost);
+        // Never destroyed: the callbacks may run until the pass builder goes away, at exit.
+        auto *trajectory{ new Cost_trajectory{ arg_cost_trajectory, kind } };
+        trajectory->register_callbacks(*pb.getPassInstrumentationCallbacks());
+        trajectory_registered = true;
+      }
     }
   };
 }
@@ -0,0 +1,86 @@
+/*
+  This file is distributed under the University of Illinois Open Source
+  License. See LICENSE for details.
+*/
+
+#include <llvm/Support/LineIterator.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include "binary_output.hh"
+#include "runtime_profile.hh"
+
+/* Runtime profile reader.
+  The profile is the Runtime_data YAML written by the PAPI instrumentation runtime. Both layouts (papi_instrumentation
+  and papi_instrumentation_v2) are flat enough to be read line by line, keyed only by the field names, so the file is
+  scanned once from a memory buffer instead of being built into a YAML document first.
+***********************************************************************************************************************/
+bool Runtime_profile::load(llvm::StringRef path)
+{
+  auto buffer{ llvm::MemoryBuffer::getFile(path) };
+  if (!buffer) {
+    llvm::errs() << "Error: Unable to read runtime profile [" << path << "]: " << buffer.getError().message() << '\n';
+    return false;
+  }
+  functions_.clear();
+  if ((*buffer)->getBuffer().startswith(llvm::StringRef{ Binary_output::magic, sizeof(Binary_output::magic) }))
+    return load_binary((*buffer)->getBuffer().str(), path);
+
+  llvm::DenseMap<uint64_t, Block_profile> *blocks{ nullptr };
+  Block_profile *block{ nullptr };
+  for (llvm::line_iterator line{ **buffer, true }; !line.is_at_eof(); ++line) {
+    llvm::StringRef entry{ line->ltrim() };
+    if (entry.consume_front("-")) entry = entry.ltrim();
+    auto [key, value] = entry.split(':');
+    value = value.trim();
+    if (key == "Name") {
+      blocks = &functions_[value];
+      block = nullptr;
+    } else if (key == "ID" && blocks) {
+      uint64_t id{ 0 };
+      if (value.getAsInteger(10, id)) continue;
+      block = &(*blocks)[id];
+    } else if (!block) {
+      continue;
+    } else if (key == "Runs") {
+      value.getAsInteger(10, block->runs);
+    } else if (key == "Cycles") {
+      value.getAsDouble(block->cycles);
+    } else if (key == "Average") {
+      value.getAsDouble(block->average);
+    }
+  }
+  return true;
+}
+
+const Block_profile *Runtime_profile::lookup(llvm::StringRef function, uint64_t block_id) const
+{
+  auto fun{ functions_.find(function) };
+  if (fun == functions_.end()) return nullptr;
+  auto found{ fun->second.find(block_id) };
+  if (found == fun->second.end() || found->second.runs == 0) return nullptr;
+  return &found->second;
+}
+
+// Runtime data written by the PAPI runtime to a *.bin output file.
+bool Runtime_profile::load_binary(const std::string &data, llvm::StringRef path)
+{
+  Binary_output::File file{};
+  const Binary_output::Table *blocks{ nullptr };
+  if (!Binary_output::parse(data, file) || file.kind != Binary_output::Kind::runtime_data || !(blocks = file.find("blocks"))) {
+    llvm::errs() << "Error: Invalid binary runtime profile [" << path << "]\n";
+    return false;
+  }
+  std::vector<std::string> names{ blocks->get_strings("function") };
+  std::vector<uint64_t> ids{ blocks->get<uint64_t>("id") }, runs{ blocks->get<uint64_t>("runs") };
+  std::vector<uint64_t> cycles{ blocks->get<uint64_t>("cycles") };
+  std::vector<double> average{ blocks->get<double>("average") };
+  if (names.size() != blocks->rows || ids.size() != blocks->rows || runs.size() != blocks->rows
+      || cycles.size() != blocks->rows || average.size() != blocks->rows) {
+    llvm::errs() << "Error: Invalid binary runtime profile [" << path << "]: missing columns\n";
+    return false;
+  }
+  for (size_t row = 0; row < blocks->rows; ++row)
+    functions_[names[row]][ids[row]] = { runs[row], static_cast<double>(cycles[row]), average[row] };
+  return true;
+}
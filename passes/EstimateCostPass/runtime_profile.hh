@@ -0,0 +1,35 @@
+/*
+  This file is distributed under the University of Illinois Open Source
+  License. See LICENSE for details.
+*/
+
+#pragma once
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringRef.h>
+
+#include <cstdint>
+#include <string>
+
+// Runtime profile: measured cycles per basic block, as written by InstrumentationPass/papi/papi_instrumentation*.cc.
+struct Block_profile {
+  uint64_t runs{ 0 };
+  double cycles{ 0 };
+  double average{ 0 }; // Cycles per block execution.
+};
+
+struct Runtime_profile {
+  // Load a Runtime_data YAML file, or its binary equivalent. Returns false (after reporting to errs()) if the file can't
+  // be read.
+  bool load(llvm::StringRef path);
+  // Measured data of block <block_id> (its ordinal in the function) of <function>, or nullptr if never executed.
+  const Block_profile *lookup(llvm::StringRef function, uint64_t block_id) const;
+  bool empty() const { return functions_.empty(); }
+
+private:
+  bool load_binary(const std::string &data, llvm::StringRef path);
+
+  // Function name -> block id -> profile.
+  llvm::StringMap<llvm::DenseMap<uint64_t, Block_profile>> functions_;
+};
@@ -0,0 +1,54 @@
+/*
+  This file is distributed under the University of Illinois Open Source
+  License. See LICENSE for details.
+*/
+
+#include <llvm/IR/Attributes.h>
+#include <llvm/MC/MCSubtargetInfo.h>
+#include <llvm/MC/TargetRegistry.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include "target_cost.hh"
+
+bool Target_cost_model::init(llvm::Module &module, const std::string &cpu)
+{
+  std::string triple{ module.getTargetTriple().empty() ? llvm::sys::getDefaultTargetTriple()
+                                                      : module.getTargetTriple() };
+  std::string error{};
+  const llvm::Target *target{ llvm::TargetRegistry::lookupTarget(triple, error) };
+  if (!target) {
+    llvm::errs() << "Error: Unable to set up target [" << triple << "] for the estimate targets: " << error << '\n';
+    return false;
+  }
+  std::unique_ptr<llvm::MCSubtargetInfo> subtarget{ target->createMCSubtargetInfo(triple, "", "") };
+  if (!subtarget || !subtarget->isCPUStringValid(cpu)) {
+    llvm::errs() << "Error: Unknown CPU [" << cpu << "] for target [" << triple << "]\n";
+    return false;
+  }
+  tm_.reset(target->createTargetMachine(triple, cpu, "", llvm::TargetOptions{}, llvm::None));
+  if (!tm_) {
+    llvm::errs() << "Error: Unable to create a target machine for [" << triple << "] and CPU [" << cpu << "]\n";
+    return false;
+  }
+  cpu_ = cpu;
+  return true;
+}
+
+/* Per-CPU TTI.
+  The target machine picks the subtarget of a function from its target-cpu, tune-cpu and target-features attributes,
+  which front ends always set, before its own CPU and features. The attributes are swapped for this CPU while the TTI
+  is created (the TTI resolves its subtarget at construction) and then restored, so the module is left unchanged.
+  target-features is dropped, not kept: it lists the features of the compiling CPU (e.g. +avx512f), which would
+  otherwise be added to those of this CPU and change its vector costs.
+***********************************************************************************************************************/
+llvm::TargetTransformInfo Target_cost_model::tti(llvm::Function &fun) const
+{
+  llvm::AttributeList original{ fun.getAttributes() };
+  fun.addFnAttr("target-cpu", cpu_);
+  fun.removeFnAttr("tune-cpu");
+  fun.removeFnAttr("target-features");
+  llvm::TargetTransformInfo tti{ tm_->getTargetTransformInfo(fun) };
+  fun.setAttributes(original);
+  return tti;
+}
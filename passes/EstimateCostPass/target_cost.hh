@@ -0,0 +1,30 @@
+/*
+  This file is distributed under the University of Illinois Open Source
+  License. See LICENSE for details.
+*/
+
+#pragma once
+
+#include <llvm/Analysis/TargetTransformInfo.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Target/TargetMachine.h>
+
+#include <memory>
+#include <string>
+
+// Cost model of another CPU of the module's target, for estimating the same frequencies under several CPUs in one run.
+struct Target_cost_model {
+  // Create the target machine for <cpu> and the triple of <module>. Returns false (after reporting to errs()) if the
+  // target can't be set up or doesn't know <cpu>.
+  bool init(llvm::Module &module, const std::string &cpu);
+  // TTI of <fun> compiled for this CPU, ignoring the function's own target-cpu, tune-cpu and target-features
+  // attributes.
+  llvm::TargetTransformInfo tti(llvm::Function &fun) const;
+
+  const std::string &cpu() const { return cpu_; }
+
+private:
+  std::string cpu_{};
+  std::unique_ptr<llvm::TargetMachine> tm_{};
+};
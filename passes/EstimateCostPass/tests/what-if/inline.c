@@ -0,0 +1,33 @@
+#include <stdio.h>
+
+static int square(int x)
+{
+  return x * x;
+}
+
+static int sum_squares(int n)
+{
+  int sum = 0;
+  for (int i = 0; i < n; ++i)
+    sum += square(i);
+  return sum;
+}
+
+static int clamp(int x, int low, int high)
+{
+  if (x < low)
+    return low;
+  if (x > high)
+    return high;
+  return x;
+}
+
+int main(int argc, char **argv)
+{
+  int total = 0;
+  for (int i = 0; i < argc * 100; ++i)
+    total += clamp(sum_squares(i % 10), 0, 200);
+  total += square(argc);
+  printf("%d\n", total);
+  return 0;
+}
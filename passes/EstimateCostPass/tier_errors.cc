@@ -0,0 +1,39 @@
+/*
+  This file is distributed under the University of Illinois Open Source
+  License. See LICENSE for details.
+*/
+
+#include <llvm/Support/LineIterator.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include "tier_errors.hh"
+
+bool Tier_error_table::load(llvm::StringRef path)
+{
+  auto buffer{ llvm::MemoryBuffer::getFile(path) };
+  if (!buffer) {
+    llvm::errs() << "Error: Unable to read tier errors [" << path << "]: " << buffer.getError().message() << '\n';
+    return false;
+  }
+  errors_.clear();
+  for (llvm::line_iterator line{ **buffer, true, '#' }; !line.is_at_eof(); ++line) {
+    llvm::SmallVector<llvm::StringRef, 6> fields{};
+    line->split(fields, ',');
+    Tier_error error{};
+    if (fields.size() != 6 || fields[2].trim().getAsInteger(10, error.files) || fields[3].trim().getAsDouble(error.mean)
+        || fields[4].trim().getAsDouble(error.p90) || fields[5].trim().getAsDouble(error.max)) {
+      if (fields[0].trim() != "tier") // Header.
+        llvm::errs() << "Invalid tier error [" << *line << "] in [" << path << "]\n";
+      continue;
+    }
+    errors_[(fields[0].trim() + "," + fields[1].trim().lower()).str()] = error;
+  }
+  return true;
+}
+
+const Tier_error *Tier_error_table::find(llvm::StringRef tier, llvm::StringRef kind) const
+{
+  auto found{ errors_.find((tier + "," + kind.lower()).str()) };
+  return found == errors_.end() ? nullptr : &found->second;
+}
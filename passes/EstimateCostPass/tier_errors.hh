@@ -0,0 +1,30 @@
+/*
+  This file is distributed under the University of Illinois Open Source
+  License. See LICENSE for details.
+*/
+
+#pragma once
+
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringRef.h>
+
+// Relative error of a tier's estimates against the precise tier, measured over a calibration corpus by
+// runtime-generalization/calibrate_tiers.py.
+struct Tier_error {
+  unsigned files{ 0 };
+  double mean{ 0 };
+  double p90{ 0 };
+  double max{ 0 };
+};
+
+struct Tier_error_table {
+  // Read a CSV table of "tier,cost_kind,files,mean_error,p90_error,max_error" lines ('#' starts a comment). Returns
+  // false (after reporting to errs()) if the file can't be read.
+  bool load(llvm::StringRef path);
+  // The errors of cost kind <kind> (case insensitive) in tier <tier>, nullptr if not calibrated.
+  const Tier_error *find(llvm::StringRef tier, llvm::StringRef kind) const;
+  bool empty() const { return errors_.empty(); }
+
+private:
+  llvm::StringMap<Tier_error> errors_; // By "tier,kind".
+};
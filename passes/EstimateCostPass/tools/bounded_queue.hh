@@ -0,0 +1,53 @@
+/*
+  This file is distributed under the University of Illinois Open Source
+  License. See LICENSE for details.
+*/
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+// Multi-producer multi-consumer queue holding at most <capacity> items, connecting the stages of the tools: a fast
+// stage blocks instead of buffering its whole output in front of a slow one.
+template <typename T> class Bounded_queue {
+public:
+  explicit Bounded_queue(size_t capacity) : capacity_{ capacity ? capacity : 1 } {}
+
+  // Wait for room and add <item>. Returns false (dropping it) if the queue was closed.
+  bool push(T item) {
+    std::unique_lock<std::mutex> lock{ mutex_ };
+    not_full_.wait(lock, [&] { return closed_ || items_.size() < capacity_; });
+    if (closed_) return false;
+    items_.push_back(std::move(item));
+    not_empty_.notify_one();
+    return true;
+  }
+
+  // Wait for an item. Returns false once the queue is closed and empty.
+  bool pop(T &item) {
+    std::unique_lock<std::mutex> lock{ mutex_ };
+    not_empty_.wait(lock, [&] { return closed_ || !items_.empty(); });
+    if (items_.empty()) return false;
+    item = std::move(items_.front());
+    items_.pop_front();
+    not_full_.notify_one();
+    return true;
+  }
+
+  // No more items will be pushed; consumers drain the remaining ones.
+  void close() {
+    std::lock_guard<std::mutex> lock{ mutex_ };
+    closed_ = true;
+    not_empty_.notify_all();
+    not_full_.notify_all();
+  }
+
+private:
+  size_t capacity_;
+  std::mutex mutex_{};
+  std::condition_variable not_full_{}, not_empty_{};
+  std::deque<T> items_{};
+  bool closed_{ false };
+};
@@ -0,0 +1,176 @@
+/*
+  This file is distributed under the University of Illinois Open Source
+  License. See LICENSE for details.
+*/
+
+// Estimates the cost of one module under many optimization sequences in process: the module is parsed once per
+// worker thread, cloned for each sequence, optimized with the sequence translated to a new pass manager pipeline and
+// estimated by EstimateCostPass (which takes its usual options, e.g. -prediction-cost-kind). Replaces one runcpu build
+// per sequence of run_experiment.py's wl experiment.
+// Usage: estimate-batch -sequences flags.yaml [-j N] [-O-levels] [-o results.csv] module.bc
+
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IRReader/IRReader.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/Format.h>
+#include <llvm/Support/LineIterator.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/SourceMgr.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "estimator.hh"
+#include "legacy_pipeline.hh"
+
+using namespace std;
+using namespace llvm;
+
+cl::opt<std::string> arg_input(cl::Positional, cl::Required, cl::desc("<module (bitcode or IR)>"));
+
+cl::opt<std::string> arg_sequences(
+  "sequences", cl::Required, cl::desc("Sequences YAML (experiments/seqs/flags.yaml)"), cl::value_desc("filename"));
+
+cl::opt<std::string> arg_output("o", cl::init("-"), cl::desc("Output CSV"), cl::value_desc("filename"));
+
+cl::opt<unsigned> arg_jobs("j", cl::init(0), cl::desc("Worker threads (0: one per hardware thread)"));
+
+cl::opt<bool> arg_o_levels("O-levels", cl::init(false), cl::desc("Also estimate -O0 to -O3, as run_experiment.py --O-flags"));
+
+namespace {
+  struct Sequence {
+    string name;
+    vector<string> flags;
+  };
+
+  struct Sequence_result {
+    string status{ "not run" };
+    double seconds{ 0 };
+    vector<string> skipped{};
+    map<Cost_option, double> totals{};
+  };
+
+  // The sequences map of a flags.yaml: "sequences:" then "  <id>:" keys, each followed by its "  - -flag" items.
+  bool read_sequences(StringRef path, vector<Sequence> &sequences)
+  {
+    auto buffer{ MemoryBuffer::getFile(path) };
+    if (!buffer) {
+      errs() << "Error: Unable to read [" << path << "]: " << buffer.getError().message() << '\n';
+      return false;
+    }
+    bool in_sequences{ false };
+    for (line_iterator line{ **buffer, true, '#' }; !line.is_at_eof(); ++line) {
+      if (!line->startswith(" ")) { // Top level key.
+        in_sequences = line->trim() == "sequences:";
+        continue;
+      }
+      StringRef entry{ line->trim() };
+      if (!in_sequences) continue;
+      if (entry.consume_front("-")) {
+        if (!sequences.empty()) sequences.back().flags.push_back(entry.trim().trim("'\"").str());
+      } else if (entry.consume_back(":")) {
+        sequences.push_back({ "S" + entry.trim("'\"").str(), {} });
+      }
+    }
+    return true;
+  }
+
+  string csv_quote(const string &text)
+  {
+    if (text.find_first_of(",\"\n") == string::npos) return text;
+    string quoted{ "\"" };
+    for (char c : text) quoted += c == '"' ? string{ "\"\"" } : string{ c };
+    return quoted + '"';
+  }
+
+  // Worker thread: parse the module into its own context, then optimize and estimate a clone for each sequence taken
+  // from <next>.
+  void run_sequences(const MemoryBuffer &input, const vector<Sequence> &sequences, atomic<size_t> &next,
+                     vector<Sequence_result> &results)
+  {
+    LLVMContext context{};
+    SMDiagnostic diagnostic{};
+    unique_ptr<Module> module{ parseIR(input.getMemBufferRef(), diagnostic, context) };
+    if (!module) {
+      diagnostic.print("estimate-batch", errs());
+      return;
+    }
+    unique_ptr<TargetMachine> tm{ create_target_machine(*module) };
+    for (size_t i = next++; i < sequences.size(); i = next++) {
+      auto start{ chrono::steady_clock::now() };
+      Sequence_result &result{ results[i] };
+      Legacy_pipeline pipeline{ legacy_pipeline(sequences[i].flags) };
+      result.skipped = pipeline.skipped;
+      unique_ptr<Module> clone{ CloneModule(*module) };
+      string error{};
+      if (!pipeline.text.empty() && !optimize(*clone, tm.get(), pipeline.text, error)) {
+        result.status = "pipeline error: " + error;
+      } else {
+        result.totals = estimate(*clone, tm.get()).totals;
+        result.status = "ok";
+      }
+      result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+  }
+} // namespace
+
+int main(int argc, char *argv[])
+{
+  initialize_targets();
+  cl::ParseCommandLineOptions(argc, argv, "Estimate the cost of a module under many optimization sequences\n");
+  vector<Sequence> sequences{};
+  if (arg_o_levels)
+    for (const char *level : { "O0", "O1", "O2", "O3" }) sequences.push_back({ level, { string{ "-" } + level } });
+  if (!read_sequences(arg_sequences, sequences)) return 1;
+  auto input{ MemoryBuffer::getFileOrSTDIN(arg_input) };
+  if (!input) {
+    errs() << "Error: Unable to read [" << arg_input << "]: " << input.getError().message() << '\n';
+    return 1;
+  }
+
+  auto start{ chrono::steady_clock::now() };
+  unsigned jobs{ arg_jobs ? arg_jobs.getValue() : max(1u, thread::hardware_concurrency()) };
+  jobs = min<size_t>(jobs, max<size_t>(1, sequences.size()));
+  vector<Sequence_result> results(sequences.size());
+  atomic<size_t> next{ 0 };
+  vector<thread> workers{};
+  for (unsigned job = 0; job < jobs; ++job)
+    workers.emplace_back(run_sequences, cref(**input), cref(sequences), ref(next), ref(results));
+  for (thread &worker : workers) worker.join();
+  double seconds{ chrono::duration<double>(chrono::steady_clock::now() - start).count() };
+
+  std::error_code error{};
+  raw_fd_ostream output{ arg_output, error };
+  if (error) {
+    errs() << "Error: Unable to open file [" << arg_output << "] for writing: " << error.message() << '\n';
+    return 1;
+  }
+  set<Cost_option> kinds{};
+  for (Sequence_result &result : results)
+    for (auto &[kind, _] : result.totals) kinds.insert(kind);
+  output << "sequence,status,seconds";
+  for (Cost_option kind : kinds) output << ',' << cost_name(kind);
+  output << ",skipped\n";
+  for (size_t i = 0; i < sequences.size(); ++i) {
+    Sequence_result &result{ results[i] };
+    output << csv_quote(sequences[i].name) << ',' << csv_quote(result.status) << ',' << result.seconds;
+    for (Cost_option kind : kinds) {
+      auto found{ result.totals.find(kind) };
+      output << ',';
+      if (found != result.totals.end()) output << format("%e", found->second);
+    }
+    output << ',' << csv_quote(join(result.skipped, " ")) << '\n';
+  }
+  errs() << "Estimated " << sequences.size() << " sequences in " << format("%.2f", seconds) << " s ("
+         << format("%.2f", sequences.size() / seconds) << " sequences/s) with " << jobs << " workers\n";
+  return 0;
+}
@@ -0,0 +1,227 @@
+/*
+  This file is distributed under the University of Illinois Open Source
+  License. See LICENSE for details.
+*/
+
+// Estimates the cost of many modules in one process, without opt and plugin loading. Three stages overlap, connected
+// by bounded queues: a reader thread loads the files, worker threads parse and estimate them (with the usual
+// EstimateCostPass options, e.g. -prediction-cost-kind) and a writer thread streams one row per file to a CSV, or
+// collects them for a binary file (*.bin output). Throughput is reported on the standard error.
+// Usage: estimate-cost [-j N] [-o costs.csv|costs.bin] file.bc|directory...
+
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IRReader/IRReader.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Format.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/SourceMgr.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bounded_queue.hh"
+#include "estimator.hh"
+
+using namespace std;
+using namespace llvm;
+
+cl::list<std::string> arg_inputs(cl::Positional, cl::OneOrMore, cl::desc("<modules or directories of .bc/.ll files>"));
+
+cl::opt<std::string> arg_output(
+  "o", cl::init("-"), cl::desc("Output CSV, or binary file if its name ends in .bin"), cl::value_desc("filename"));
+
+cl::opt<unsigned> arg_jobs("j", cl::init(0), cl::desc("Estimation threads (0: one per hardware thread)"));
+
+cl::opt<unsigned> arg_queue_size("queue-size", cl::init(8), cl::desc("Files buffered between stages, per estimation thread"));
+
+namespace {
+  struct Input_file {
+    string path;
+    unique_ptr<MemoryBuffer> buffer; // Null if the file couldn't be read.
+    string error{};
+  };
+
+  struct File_result {
+    string path;
+    string status;
+    uint64_t functions{ 0 };
+    double seconds{ 0 };
+    map<Cost_option, double> totals{};
+  };
+
+  double elapsed(chrono::steady_clock::time_point start)
+  {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  }
+
+  // The files named on the command line, directories searched recursively for bitcode and IR files.
+  vector<string> collect_inputs()
+  {
+    vector<string> files{};
+    for (const string &input : arg_inputs) {
+      if (!sys::fs::is_directory(input)) {
+        files.push_back(input);
+        continue;
+      }
+      std::error_code error{};
+      vector<string> found{};
+      for (sys::fs::recursive_directory_iterator entry{ input, error }, end; entry != end && !error; entry.increment(error)) {
+        StringRef extension{ sys::path::extension(entry->path()) };
+        if ((extension == ".bc" || extension == ".ll") && !sys::fs::is_directory(entry->path()))
+          found.push_back(entry->path());
+      }
+      if (error) errs() << "Error: Unable to read directory [" << input << "]: " << error.message() << '\n';
+      std::sort(found.begin(), found.end());
+      files.insert(files.end(), found.begin(), found.end());
+    }
+    return files;
+  }
+
+  /* Stages.
+    Each estimation thread keeps a target machine per triple; every module gets its own LLVMContext, released with it.
+  *********************************************************************************************************************/
+  void read_files(const vector<string> &files, Bounded_queue<Input_file> &inputs, atomic<uint64_t> &bytes)
+  {
+    for (const string &path : files) {
+      Input_file input{ path, nullptr };
+      auto buffer{ MemoryBuffer::getFile(path) };
+      if (buffer) {
+        bytes += (*buffer)->getBufferSize();
+        input.buffer = std::move(*buffer);
+      } else {
+        input.error = buffer.getError().message();
+      }
+      if (!inputs.push(std::move(input))) break;
+    }
+    inputs.close();
+  }
+
+  void estimate_files(Bounded_queue<Input_file> &inputs, Bounded_queue<File_result> &results)
+  {
+    map<string, unique_ptr<TargetMachine>> target_machines{};
+    Input_file input{};
+    while (inputs.pop(input)) {
+      auto start{ chrono::steady_clock::now() };
+      File_result result{ input.path };
+      if (!input.buffer) {
+        result.status = "read error: " + input.error;
+        results.push(std::move(result));
+        continue;
+      }
+      LLVMContext context{};
+      SMDiagnostic diagnostic{};
+      unique_ptr<Module> module{ parseIR(input.buffer->getMemBufferRef(), diagnostic, context) };
+      input.buffer.reset();
+      if (!module) {
+        result.status = "parse error: " + diagnostic.getMessage().str();
+      } else {
+        unique_ptr<TargetMachine> &tm{ target_machines[module->getTargetTriple()] };
+        if (!tm) tm = create_target_machine(*module);
+        result.totals = estimate(*module, tm.get()).totals;
+        result.functions = count_if(module->begin(), module->end(), [](Function &fun) { return !fun.empty(); });
+        result.status = "ok";
+      }
+      result.seconds = elapsed(start);
+      results.push(std::move(result));
+    }
+  }
+
+  // Rows are written as files complete, so the CSV order follows completion, not the command line.
+  void write_results(Bounded_queue<File_result> &results, raw_ostream &output, bool binary, uint64_t &functions,
+                     uint64_t &failed)
+  {
+    vector<Cost_option> kinds{ selected_cost_options() };
+    if (!binary) {
+      output << "file,status,functions,seconds";
+      for (Cost_option kind : kinds) output << ',' << cost_name(kind);
+      output << '\n';
+    }
+    vector<string> paths{}, statuses{};
+    vector<uint64_t> function_counts{};
+    vector<double> seconds{}, costs{};
+    File_result result{};
+    while (results.pop(result)) {
+      functions += result.functions;
+      if (result.status != "ok") {
+        ++failed;
+        errs() << "Error: [" << result.path << "] " << result.status << '\n';
+      }
+      if (binary) {
+        paths.push_back(result.path);
+        statuses.push_back(result.status);
+        function_counts.push_back(result.functions);
+        seconds.push_back(result.seconds);
+        for (Cost_option kind : kinds) costs.push_back(result.totals[kind]);
+        continue;
+      }
+      output << result.path << ',' << (result.status == "ok" ? "ok" : "error") << ',' << result.functions << ','
+             << result.seconds;
+      for (Cost_option kind : kinds) {
+        output << ',';
+        if (result.status == "ok") output << format("%e", result.totals[kind]);
+      }
+      output << '\n';
+    }
+    if (!binary) return;
+
+    Binary_output::Table options{ "options" }, files{ "files" };
+    vector<string> names{};
+    for (Cost_option kind : kinds) names.push_back(cost_name(kind));
+    options.rows = names.size();
+    options.add_strings("name", names);
+    files.rows = paths.size();
+    files.add_strings("name", paths);
+    files.add_strings("status", statuses);
+    files.add("functions", function_counts);
+    files.add("seconds", seconds);
+    files.add("costs", costs, kinds.size());
+    output << Binary_output::serialize({ Binary_output::Kind::file_costs, { options, files } });
+  }
+} // namespace
+
+int main(int argc, char *argv[])
+{
+  initialize_targets();
+  cl::ParseCommandLineOptions(argc, argv, "Estimate the cost of many modules\n");
+  vector<string> files{ collect_inputs() };
+  std::error_code error{};
+  raw_fd_ostream output{ arg_output, error };
+  if (error) {
+    errs() << "Error: Unable to open file [" << arg_output << "] for writing: " << error.message() << '\n';
+    return 1;
+  }
+
+  auto start{ chrono::steady_clock::now() };
+  unsigned jobs{ arg_jobs ? arg_jobs.getValue() : max(1u, thread::hardware_concurrency()) };
+  jobs = min<size_t>(jobs, max<size_t>(1, files.size()));
+  Bounded_queue<Input_file> inputs{ arg_queue_size * jobs };
+  Bounded_queue<File_result> results{ arg_queue_size * jobs };
+  atomic<uint64_t> bytes{ 0 };
+  uint64_t functions{ 0 }, failed{ 0 };
+  thread reader{ read_files, cref(files), ref(inputs), ref(bytes) };
+  thread writer{ write_results, ref(results), ref(output), Binary_output::is_binary_path(arg_output), ref(functions),
+                 ref(failed) };
+  vector<thread> workers{};
+  for (unsigned job = 0; job < jobs; ++job) workers.emplace_back(estimate_files, ref(inputs), ref(results));
+  reader.join();
+  for (thread &worker : workers) worker.join();
+  results.close();
+  writer.join();
+
+  double seconds{ elapsed(start) };
+  errs() << "Estimated " << files.size() - failed << " of " << files.size() << " files (" << functions
+         << " functions, " << format("%.1f", bytes / 1048576.0) << " MB) in " << format("%.2f", seconds) << " s with "
+         << jobs << " threads: " << format("%.2f", files.size() / seconds) << " files/s, "
+         << format("%.1f", functions / seconds) << " functions/s\n";
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,225 @@
+/*
+  This file is distributed under the University of Illinois Open Source
+  License. See LICENSE for details.
+*/
+
+// Estimation server for the clients that query many costs (autotuners): it listens on a Unix domain socket, so each
+// query costs neither a process start nor LLVM and target initialization. Worker threads keep their LLVMContext and a
+// target machine per triple across queries; the cost kinds and the other EstimateCostPass options are the server's.
+// Usage: estimate-daemon -socket /tmp/estimate.sock [-j N] [-prediction-cost-kind=...]
+//
+// Protocol, little endian; a connection carries any number of requests, answered in order:
+//   request:  flags u32 | size u64 | payload (size bytes: a module, bitcode or IR, or a path if flags & 1)
+//             flags & 2 asks for the per-function costs.
+//   response: status u32 (0: ok) | on error, size u64 | message
+//             on success, kinds u32 | per kind: string name | total f64 | functions u32 | per function: string | f64
+//   string:   size u32 | bytes
+// runtime-generalization/estimate_client.py is a client.
+
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IRReader/IRReader.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/SourceMgr.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <future>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bounded_queue.hh"
+#include "estimator.hh"
+
+using namespace std;
+using namespace llvm;
+
+cl::opt<std::string> arg_socket("socket", cl::Required, cl::desc("Unix domain socket to listen on"), cl::value_desc("path"));
+
+cl::opt<unsigned> arg_jobs("j", cl::init(0), cl::desc("Estimation threads (0: one per hardware thread)"));
+
+cl::opt<unsigned> arg_context_reuse(
+  "context-reuse", cl::init(64), cl::desc("Modules parsed into a thread's LLVMContext before it is recreated"));
+
+cl::opt<unsigned> arg_max_request_mb("max-request-mb", cl::init(1024), cl::desc("Largest request accepted, in MB"));
+
+namespace {
+  enum Request_flags : uint32_t { path_payload = 1, per_function = 2 };
+
+  struct Request {
+    uint32_t flags;
+    string payload;
+    promise<string> response{};
+  };
+
+  char socket_path[sizeof(sockaddr_un::sun_path)]{};
+
+  void stop(int)
+  {
+    unlink(socket_path);
+    _exit(0);
+  }
+
+  bool read_all(int fd, void *data, size_t size)
+  {
+    for (char *out{ static_cast<char *>(data) }; size;) {
+      ssize_t count{ read(fd, out, size) };
+      if (count <= 0) return false;
+      out += count;
+      size -= count;
+    }
+    return true;
+  }
+
+  bool write_all(int fd, const string &data)
+  {
+    for (size_t done{ 0 }; done < data.size();) {
+      ssize_t count{ send(fd, data.data() + done, data.size() - done, MSG_NOSIGNAL) };
+      if (count <= 0) return false;
+      done += count;
+    }
+    return true;
+  }
+
+  template <typename T> void put(string &out, T value) { out.append(reinterpret_cast<const char *>(&value), sizeof(T)); }
+
+  void put_string(string &out, StringRef text)
+  {
+    put<uint32_t>(out, text.size());
+    out.append(text.begin(), text.end());
+  }
+
+  string error_response(const string &message)
+  {
+    string out{};
+    put<uint32_t>(out, 1);
+    put<uint64_t>(out, message.size());
+    return out + message;
+  }
+
+  string estimate_response(const EstimateCostPass::Estimate &estimate)
+  {
+    string out{};
+    put<uint32_t>(out, 0);
+    put<uint32_t>(out, estimate.totals.size());
+    for (auto &[kind, total] : estimate.totals) {
+      put_string(out, cost_name(kind));
+      put<double>(out, total);
+      auto functions{ estimate.functions.find(kind) };
+      if (functions == estimate.functions.end()) {
+        put<uint32_t>(out, 0);
+        continue;
+      }
+      put<uint32_t>(out, functions->second.size());
+      for (auto &[name, cost] : functions->second) {
+        put_string(out, name);
+        put<double>(out, cost);
+      }
+    }
+    return out;
+  }
+
+  /* Workers.
+    The context is recreated every -context-reuse modules: the types and constants of the modules parsed into it are
+    only released with it. Target machines don't depend on the context and are kept for the life of the thread.
+  *********************************************************************************************************************/
+  void serve_requests(Bounded_queue<shared_ptr<Request>> &requests)
+  {
+    map<string, unique_ptr<TargetMachine>> target_machines{};
+    unique_ptr<LLVMContext> context{};
+    unsigned parsed{ 0 };
+    shared_ptr<Request> request{};
+    while (requests.pop(request)) {
+      if (!context || parsed++ % max(1u, arg_context_reuse.getValue()) == 0) context = make_unique<LLVMContext>();
+      unique_ptr<MemoryBuffer> buffer{};
+      if (request->flags & path_payload) {
+        auto file{ MemoryBuffer::getFile(request->payload) };
+        if (!file) {
+          request->response.set_value(error_response("Unable to read [" + request->payload + "]: " + file.getError().message()));
+          continue;
+        }
+        buffer = std::move(*file);
+      } else {
+        buffer = MemoryBuffer::getMemBuffer(request->payload, "request", false);
+      }
+      SMDiagnostic diagnostic{};
+      unique_ptr<Module> module{ parseIR(buffer->getMemBufferRef(), diagnostic, *context) };
+      if (!module) {
+        request->response.set_value(error_response("Unable to parse the module: " + diagnostic.getMessage().str()));
+        continue;
+      }
+      unique_ptr<TargetMachine> &tm{ target_machines[module->getTargetTriple()] };
+      if (!tm) tm = create_target_machine(*module);
+      request->response.set_value(estimate_response(estimate(*module, tm.get(), request->flags & per_function)));
+    }
+  }
+
+  // Connection thread: forward the client's requests to the workers, one at a time, and send back the responses.
+  void serve_client(int fd, Bounded_queue<shared_ptr<Request>> &requests)
+  {
+    uint32_t flags{};
+    uint64_t size{};
+    while (read_all(fd, &flags, sizeof(flags)) && read_all(fd, &size, sizeof(size))) {
+      if (size > uint64_t{ arg_max_request_mb } << 20) {
+        write_all(fd, error_response("Request too large"));
+        break;
+      }
+      auto request{ make_shared<Request>() };
+      request->flags = flags;
+      request->payload.resize(size);
+      if (!read_all(fd, request->payload.data(), size)) break;
+      future<string> response{ request->response.get_future() };
+      if (!requests.push(request) || !write_all(fd, response.get())) break;
+    }
+    close(fd);
+  }
+} // namespace
+
+int main(int argc, char *argv[])
+{
+  initialize_targets();
+  cl::ParseCommandLineOptions(argc, argv, "Serve cost estimates over a Unix domain socket\n");
+  if (arg_socket.size() >= sizeof(socket_path)) {
+    errs() << "Error: Socket path too long [" << arg_socket << "]\n";
+    return 1;
+  }
+  strcpy(socket_path, arg_socket.c_str());
+  int listener{ socket(AF_UNIX, SOCK_STREAM, 0) };
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, socket_path);
+  unlink(socket_path);
+  if (listener < 0 || bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0
+      || listen(listener, SOMAXCONN) < 0) {
+    errs() << "Error: Unable to listen on [" << arg_socket << "]: " << strerror(errno) << '\n';
+    return 1;
+  }
+  signal(SIGINT, stop);
+  signal(SIGTERM, stop);
+
+  unsigned jobs{ arg_jobs ? arg_jobs.getValue() : max(1u, thread::hardware_concurrency()) };
+  Bounded_queue<shared_ptr<Request>> requests{ 4 * jobs };
+  for (unsigned job = 0; job < jobs; ++job) thread{ serve_requests, ref(requests) }.detach();
+  errs() << "Listening on [" << arg_socket << "] with " << jobs << " threads\n";
+  while (true) {
+    int client{ accept(listener, nullptr, nullptr) };
+    if (client < 0) {
+      if (errno == EINTR) continue;
+      errs() << "Error: Unable to accept a connection: " << strerror(errno) << '\n';
+      break;
+    }
+    thread{ serve_client, client, ref(requests) }.detach();
+  }
+  unlink(socket_path);
+  return 1;
+}
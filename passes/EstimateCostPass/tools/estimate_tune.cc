@@ -0,0 +1,469 @@
+/*
+  This file is distributed under the University of Illinois Open Source
+  License. See LICENSE for details.
+*/
+
+// Searches opt flag sequences (generate_seqs.py's LLVM_FLAGS, or -flags-file) for the lowest estimated cost, with
+// EstimateCostPass as the fitness function: the first kind given to -prediction-cost-kind, as a ratio to the cost of
+// the unoptimized module, averaged over the modules given. Candidates are optimized on clones and estimated in
+// parallel; results are memoized by sequence and by the hash of the optimized IR, so sequences that produce the same
+// code are estimated once. The best -top sequences are written as a flags.yaml for confirmation runs
+// (run_experiment.py --flags-file).
+// Usage: estimate-tune -strategy genetic|hill-climbing|successive-halving [-budget N] [-j N] [-o best.yaml] module...
+
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IRReader/IRReader.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/Format.h>
+#include <llvm/Support/LineIterator.h>
+#include <llvm/Support/MD5.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/SourceMgr.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "estimator.hh"
+#include "legacy_pipeline.hh"
+
+using namespace std;
+using namespace llvm;
+
+cl::list<std::string> arg_inputs(cl::Positional, cl::OneOrMore, cl::desc("<modules (bitcode or IR)>"));
+
+cl::opt<std::string> arg_strategy(
+  "strategy", cl::init("genetic"), cl::desc("Search strategy: genetic, hill-climbing or successive-halving"));
+
+cl::opt<std::string> arg_flags_file(
+  "flags-file", cl::desc("YAML list of the flags to draw from (generate_seqs.py --flags-file)"), cl::value_desc("filename"));
+
+cl::opt<std::string> arg_output("o", cl::init("-"), cl::desc("Output flags.yaml of the best sequences"), cl::value_desc("filename"));
+
+cl::opt<unsigned> arg_jobs("j", cl::init(0), cl::desc("Worker threads (0: one per hardware thread)"));
+
+cl::opt<unsigned> arg_budget(
+  "budget", cl::init(1000), cl::desc("Candidate estimates on a module, memoized ones included"));
+
+cl::opt<unsigned> arg_top("top", cl::init(10), cl::desc("Sequences written"));
+
+cl::opt<unsigned> arg_seed("seed", cl::init(1), cl::desc("Random seed"));
+
+cl::opt<unsigned> arg_min_length("min-length", cl::init(1), cl::desc("Shortest sequence"));
+
+cl::opt<unsigned> arg_max_length("max-length", cl::init(37), cl::desc("Longest sequence"));
+
+cl::opt<unsigned> arg_population(
+  "population", cl::init(32), cl::desc("Genetic population, and candidates per successive halving bracket"));
+
+cl::opt<double> arg_mutation_rate("mutation-rate", cl::init(0.3), cl::desc("Genetic: probability of mutating a child"));
+
+cl::opt<unsigned> arg_neighbors("neighbors", cl::init(8), cl::desc("Hill climbing: mutations tried per step"));
+
+cl::opt<unsigned> arg_patience(
+  "patience", cl::init(3), cl::desc("Hill climbing: steps without improvement before a restart"));
+
+namespace {
+  constexpr double infinity{ numeric_limits<double>::infinity() };
+
+  using Ir_hash = pair<uint64_t, uint64_t>; // MD5 of the optimized module's IR.
+
+  struct Estimated {
+    double cost; // Infinity if the pipeline failed.
+    Ir_hash code;
+  };
+
+  struct Candidate {
+    vector<string> flags;
+    vector<double> costs{}; // Per module, NaN until estimated, infinity if the pipeline failed.
+    vector<Ir_hash> codes{}; // Per module.
+    double fitness{ infinity }; // Mean cost ratio to the unoptimized modules, over the modules estimated.
+  };
+
+  bool fitter(const Candidate &a, const Candidate &b) { return a.fitness < b.fitness; }
+
+  bool read_flags(StringRef path, vector<string> &flags)
+  {
+    auto buffer{ MemoryBuffer::getFile(path) };
+    if (!buffer) {
+      errs() << "Error: Unable to read [" << path << "]: " << buffer.getError().message() << '\n';
+      return false;
+    }
+    for (line_iterator line{ **buffer, true, '#' }; !line.is_at_eof(); ++line) {
+      StringRef entry{ line->trim() };
+      if (entry.consume_front("-") && !entry.trim().empty()) flags.push_back(entry.trim().trim("'\"").str());
+    }
+    return true;
+  }
+
+  /* Evaluation.
+    Each worker parses every module once into its own context; a candidate is estimated on clones. The costs are
+    memoized by (module, sequence) and by (module, optimized IR hash). The budget counts the estimates asked for,
+    memoized or not: once the searches only revisit known sequences (few flags, short sequences, a converged
+    population), they would otherwise never spend it.
+  *********************************************************************************************************************/
+  class Evaluator {
+  public:
+    Evaluator(vector<unique_ptr<MemoryBuffer>> &inputs, unsigned jobs, Cost_option kind)
+      : inputs_{ inputs }, workers_(jobs), kind_{ kind } {}
+
+    bool init() {
+      for (Worker &worker : workers_) {
+        for (auto &input : inputs_) {
+          SMDiagnostic diagnostic{};
+          worker.modules.push_back(parseIR(input->getMemBufferRef(), diagnostic, worker.context));
+          if (!worker.modules.back()) {
+            diagnostic.print("estimate-tune", errs());
+            return false;
+          }
+          worker.tms.push_back(create_target_machine(*worker.modules.back()));
+        }
+      }
+      vector<Candidate> unoptimized{ { {} } };
+      estimate_costs(unoptimized, inputs_.size());
+      baseline_ = unoptimized.front().costs;
+      for (size_t module = 0; module < baseline_.size(); ++module) {
+        if (!isfinite(baseline_[module])) {
+          errs() << "Error: Unable to estimate [" << inputs_[module]->getBufferIdentifier() << "]\n";
+          return false;
+        }
+      }
+      return true;
+    }
+
+    // Estimate <candidates> on the first <modules> modules and set their fitness.
+    void evaluate(vector<Candidate> &candidates, size_t modules) {
+      estimate_costs(candidates, modules);
+      evaluations_ += candidates.size() * modules;
+      for (Candidate &candidate : candidates) {
+        double ratios{ 0 };
+        for (size_t module = 0; module < modules; ++module)
+          ratios += baseline_[module] ? candidate.costs[module] / baseline_[module] : candidate.costs[module];
+        candidate.fitness = ratios / modules;
+        if (modules == inputs_.size()) record(candidate);
+      }
+    }
+
+    bool exhausted() const { return evaluations_ >= arg_budget; }
+    // The best sequences evaluated on every module, best first. Of the sequences producing the same code, only the
+    // shortest is kept: confirmation runs would measure the same binaries.
+    vector<Candidate> best(size_t count) const {
+      vector<Candidate> sorted{};
+      for (auto &[_, candidate] : evaluated_) sorted.push_back(candidate);
+      std::stable_sort(sorted.begin(), sorted.end(), [](const Candidate &a, const Candidate &b) {
+        return a.fitness != b.fitness ? a.fitness < b.fitness : a.flags.size() < b.flags.size();
+      });
+      vector<Candidate> best{};
+      set<vector<Ir_hash>> codes{};
+      for (Candidate &candidate : sorted)
+        if (best.size() < count && isfinite(candidate.fitness) && codes.insert(candidate.codes).second)
+          best.push_back(std::move(candidate));
+      return best;
+    }
+
+    void print_stats(raw_ostream &out, double seconds) const {
+      out << evaluations_ << " estimates, " << optimized_ << " module clones optimized in " << format("%.2f", seconds)
+          << " s (" << format("%.1f", optimized_ / seconds) << "/s): " << sequence_hits_ << " sequence cache hits, "
+          << ir_hits_ << " IR cache hits, " << failures_ << " failed pipelines, " << evaluated_.size() << " sequences evaluated\n";
+    }
+
+  private:
+    struct Worker {
+      LLVMContext context{};
+      vector<unique_ptr<Module>> modules{};
+      vector<unique_ptr<TargetMachine>> tms{};
+    };
+
+    // The costs of <candidates> not known yet on the first <modules> modules, estimated in parallel.
+    void estimate_costs(vector<Candidate> &candidates, size_t modules) {
+      vector<pair<Candidate *, size_t>> tasks{};
+      for (Candidate &candidate : candidates) {
+        candidate.costs.resize(inputs_.size(), NAN);
+        candidate.codes.resize(inputs_.size());
+        for (size_t module = 0; module < modules; ++module)
+          if (isnan(candidate.costs[module])) tasks.emplace_back(&candidate, module);
+      }
+      atomic<size_t> next{ 0 };
+      vector<thread> threads{};
+      for (Worker &worker : workers_) {
+        threads.emplace_back([&] {
+          for (size_t i = next++; i < tasks.size(); i = next++) {
+            auto [candidate, module] = tasks[i];
+            Estimated estimated{ cost(worker, candidate->flags, module) };
+            candidate->costs[module] = estimated.cost;
+            candidate->codes[module] = estimated.code;
+          }
+        });
+      }
+      for (thread &thread : threads) thread.join();
+    }
+
+    Estimated cost(Worker &worker, const vector<string> &flags, size_t module) {
+      string sequence{ join(flags, " ") };
+      {
+        lock_guard<mutex> lock{ mutex_ };
+        auto found{ sequences_.find({ module, sequence }) };
+        if (found != sequences_.end()) {
+          ++sequence_hits_;
+          return found->second;
+        }
+        ++optimized_;
+      }
+      unique_ptr<Module> clone{ CloneModule(*worker.modules[module]) };
+      Legacy_pipeline pipeline{ legacy_pipeline(flags) };
+      string error{};
+      Estimated result{ infinity, {} };
+      if (pipeline.text.empty() || optimize(*clone, worker.tms[module].get(), pipeline.text, error)) {
+        string ir{};
+        raw_string_ostream ir_stream{ ir };
+        ir_stream << *clone;
+        MD5 md5{};
+        md5.update(ir_stream.str());
+        MD5::MD5Result hash{};
+        md5.final(hash);
+        result.code = hash.words();
+        bool known{ false };
+        {
+          lock_guard<mutex> lock{ mutex_ };
+          auto found{ ir_costs_.find({ module, result.code }) };
+          if ((known = found != ir_costs_.end())) {
+            ++ir_hits_;
+            result.cost = found->second;
+          }
+        }
+        if (!known) {
+          result.cost = estimate(*clone, worker.tms[module].get()).totals[kind_];
+          lock_guard<mutex> lock{ mutex_ };
+          ir_costs_[{ module, result.code }] = result.cost;
+        }
+      }
+      lock_guard<mutex> lock{ mutex_ };
+      if (!isfinite(result.cost)) ++failures_;
+      sequences_[{ module, sequence }] = result;
+      return result;
+    }
+
+    void record(const Candidate &candidate) {
+      auto found{ evaluated_.find(join(candidate.flags, " ")) };
+      if (found == evaluated_.end()) evaluated_.emplace(join(candidate.flags, " "), candidate);
+    }
+
+    vector<unique_ptr<MemoryBuffer>> &inputs_;
+    vector<Worker> workers_;
+    Cost_option kind_;
+    vector<double> baseline_{};
+    mutex mutex_{};
+    map<pair<size_t, string>, Estimated> sequences_{};
+    map<pair<size_t, Ir_hash>, double> ir_costs_{};
+    map<string, Candidate> evaluated_{};
+    size_t evaluations_{ 0 };
+    unsigned optimized_{ 0 }, sequence_hits_{ 0 }, ir_hits_{ 0 }, failures_{ 0 };
+  };
+
+  /* Strategies.
+    All stop when the budget of estimates runs out, checked between batches of candidates.
+  *********************************************************************************************************************/
+  class Search {
+  public:
+    Search(Evaluator &evaluator, const vector<string> &flags, size_t modules)
+      : evaluator_{ evaluator }, flags_{ flags }, modules_{ modules }, random_{ arg_seed } {}
+
+    void genetic() {
+      vector<Candidate> population{};
+      for (unsigned i = 0; i < max(2u, arg_population.getValue()); ++i) population.push_back(random_candidate());
+      evaluator_.evaluate(population, modules_);
+      while (!evaluator_.exhausted()) {
+        std::stable_sort(population.begin(), population.end(), fitter);
+        vector<Candidate> next{ population[0], population[1] }; // Elitism.
+        while (next.size() < population.size()) {
+          Candidate child{ crossover(tournament(population), tournament(population)) };
+          if (chance(arg_mutation_rate)) mutate(child.flags);
+          next.push_back(std::move(child));
+        }
+        population = std::move(next);
+        evaluator_.evaluate(population, modules_);
+      }
+    }
+
+    // From a random sequence, move to the best of -neighbors mutations while one improves; restart from another
+    // random sequence after -patience steps without improvement.
+    void hill_climbing() {
+      while (!evaluator_.exhausted()) {
+        vector<Candidate> current{ random_candidate() };
+        evaluator_.evaluate(current, modules_);
+        for (unsigned stale = 0; stale < arg_patience && !evaluator_.exhausted();) {
+          vector<Candidate> neighbors{};
+          for (unsigned i = 0; i < max(1u, arg_neighbors.getValue()); ++i) {
+            neighbors.push_back({ current.front().flags });
+            mutate(neighbors.back().flags);
+          }
+          evaluator_.evaluate(neighbors, modules_);
+          auto best{ min_element(neighbors.begin(), neighbors.end(), fitter) };
+          if (best->fitness < current.front().fitness) {
+            current.front() = *best;
+            stale = 0;
+          } else {
+            ++stale;
+          }
+        }
+      }
+    }
+
+    // Brackets of -population random sequences estimated on one module, then the better half on twice as many
+    // modules, and so on until every module is used. Pays off with several modules; with one, it is a random search.
+    void successive_halving() {
+      while (!evaluator_.exhausted()) {
+        vector<Candidate> bracket{};
+        for (unsigned i = 0; i < max(1u, arg_population.getValue()); ++i) bracket.push_back(random_candidate());
+        for (size_t modules = 1;; modules = min(modules_, 2 * modules)) {
+          evaluator_.evaluate(bracket, modules);
+          if (modules == modules_ || bracket.size() == 1 || evaluator_.exhausted()) break;
+          std::stable_sort(bracket.begin(), bracket.end(), fitter);
+          bracket.resize((bracket.size() + 1) / 2);
+        }
+      }
+    }
+
+  private:
+    bool chance(double probability) { return uniform_real_distribution<double>{ 0, 1 }(random_) < probability; }
+    size_t below(size_t count) { return uniform_int_distribution<size_t>{ 0, count - 1 }(random_); }
+    const string &random_flag() { return flags_[below(flags_.size())]; }
+
+    Candidate random_candidate() {
+      size_t length{ arg_min_length + below(arg_max_length - arg_min_length + 1) };
+      Candidate candidate{};
+      for (size_t i = 0; i < length; ++i) candidate.flags.push_back(random_flag());
+      return candidate;
+    }
+
+    // Replace, insert, remove or swap flags, keeping the length within bounds.
+    void mutate(vector<string> &flags) {
+      switch (below(4)) {
+      case 0:
+        if (!flags.empty()) {
+          flags[below(flags.size())] = random_flag();
+          break;
+        }
+        [[fallthrough]];
+      case 1:
+        if (flags.size() < arg_max_length) {
+          flags.insert(flags.begin() + below(flags.size() + 1), random_flag());
+          break;
+        }
+        [[fallthrough]];
+      case 2:
+        if (flags.size() > arg_min_length) {
+          flags.erase(flags.begin() + below(flags.size()));
+          break;
+        }
+        [[fallthrough]];
+      default:
+        if (flags.size() > 1) swap(flags[below(flags.size())], flags[below(flags.size())]);
+        else if (!flags.empty()) flags[0] = random_flag();
+      }
+    }
+
+    const Candidate &tournament(const vector<Candidate> &population) {
+      const Candidate *best{ &population[below(population.size())] };
+      for (int i = 0; i < 2; ++i) {
+        const Candidate &other{ population[below(population.size())] };
+        if (other.fitness < best->fitness) best = &other;
+      }
+      return *best;
+    }
+
+    // One point crossover, cut at a random point of each parent, clamped to the length bounds.
+    Candidate crossover(const Candidate &a, const Candidate &b) {
+      Candidate child{};
+      child.flags.assign(a.flags.begin(), a.flags.begin() + below(a.flags.size() + 1));
+      child.flags.insert(child.flags.end(), b.flags.begin() + below(b.flags.size() + 1), b.flags.end());
+      if (child.flags.size() > arg_max_length) child.flags.resize(arg_max_length);
+      while (child.flags.size() < arg_min_length) child.flags.push_back(random_flag());
+      return child;
+    }
+
+    Evaluator &evaluator_;
+    const vector<string> &flags_;
+    size_t modules_;
+    mt19937_64 random_;
+  };
+
+  void write_sequences(raw_ostream &output, const vector<Candidate> &best, const vector<string> &flags,
+                       Cost_option fitness)
+  {
+    output << "metodology:\n  strategy: " << arg_strategy << "\n  fitness: " << cost_name(fitness)
+           << " cost ratio to the unoptimized modules\n  minimum sequence length: '" << arg_min_length
+           << "'\n  maximum sequence length: '" << arg_max_length << "'\n  total sequences: '" << best.size()
+           << "'\n  used flags:\n";
+    for (const string &flag : flags) output << "  - " << flag << '\n';
+    output << "estimates:\n";
+    for (size_t i = 0; i < best.size(); ++i) output << "  " << i << ": " << format("%.6f", best[i].fitness) << '\n';
+    output << "sequences:\n";
+    for (size_t i = 0; i < best.size(); ++i) {
+      output << "  " << i << ":" << (best[i].flags.empty() ? " []\n" : "\n");
+      for (const string &flag : best[i].flags) output << "  - " << flag << '\n';
+    }
+  }
+} // namespace
+
+int main(int argc, char *argv[])
+{
+  initialize_targets();
+  cl::ParseCommandLineOptions(argc, argv, "Search optimization sequences with the estimated cost as fitness\n");
+  vector<string> flags{};
+  if (arg_flags_file.empty()) flags = legacy_flags();
+  else if (!read_flags(arg_flags_file, flags)) return 1;
+  Cost_option fitness{};
+  if (flags.empty() || !first_cost_option(fitness) || arg_min_length > arg_max_length) {
+    errs() << "Error: Need flags, a cost kind and -min-length <= -max-length\n";
+    return 1;
+  }
+  vector<unique_ptr<MemoryBuffer>> inputs{};
+  for (const string &path : arg_inputs) {
+    auto input{ MemoryBuffer::getFile(path) };
+    if (!input) {
+      errs() << "Error: Unable to read [" << path << "]: " << input.getError().message() << '\n';
+      return 1;
+    }
+    inputs.push_back(std::move(*input));
+  }
+
+  auto start{ chrono::steady_clock::now() };
+  unsigned jobs{ arg_jobs ? arg_jobs.getValue() : max(1u, thread::hardware_concurrency()) };
+  Evaluator evaluator{ inputs, jobs, fitness };
+  if (!evaluator.init()) return 1;
+  Search search{ evaluator, flags, inputs.size() };
+  if (arg_strategy == "genetic") search.genetic();
+  else if (arg_strategy == "hill-climbing") search.hill_climbing();
+  else if (arg_strategy == "successive-halving") search.successive_halving();
+  else {
+    errs() << "Error: Unknown strategy [" << arg_strategy << "]\n";
+    return 1;
+  }
+  evaluator.print_stats(errs(), chrono::duration<double>(chrono::steady_clock::now() - start).count());
+
+  vector<Candidate> best{ evaluator.best(arg_top) };
+  std::error_code error{};
+  raw_fd_ostream output{ arg_output, error };
+  if (error) {
+    errs() << "Error: Unable to open file [" << arg_output << "] for writing: " << error.message() << '\n';
+    return 1;
+  }
+  write_sequences(output, best, flags, fitness);
+  for (size_t i = 0; i < best.size(); ++i)
+    errs() << "S" << i << ": " << format("%.4f", best[i].fitness) << " (" << best[i].flags.size() << " flags)\n";
+  return 0;
+}
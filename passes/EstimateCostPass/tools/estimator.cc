@@ -0,0 +1,79 @@
+/*
+  This file is distributed under the University of Illinois Open Source
+  License. See LICENSE for details.
+*/
+
+#include <llvm/Analysis/PostDominators.h>
+#include <llvm/MC/TargetRegistry.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include "../../WuLarus/A1.Branch_prediction/branch_prediction_pass.hh"
+#include "../../WuLarus/A2.Block_edge_frequency/block_edge_frequency_pass.hh"
+#include "../../WuLarus/A3.Function_call_frequency/function_call_frequency_pass.hh"
+#include "estimator.hh"
+
+Analysis_managers::Analysis_managers(llvm::PassBuilder &pb)
+{
+  fam.registerPass([] { return BranchPredictionPass(); });
+  fam.registerPass([] { return BlockEdgeFrequencyPass(); });
+  mam.registerPass([] { return FunctionCallFrequencyPass(); });
+  pb.registerModuleAnalyses(mam);
+  pb.registerCGSCCAnalyses(cgam);
+  pb.registerFunctionAnalyses(fam);
+  pb.registerLoopAnalyses(lam);
+  pb.crossRegisterProxies(lam, fam, cgam, mam);
+}
+
+void initialize_targets()
+{
+  llvm::InitializeAllTargetInfos();
+  llvm::InitializeAllTargets();
+  llvm::InitializeAllTargetMCs();
+  llvm::InitializeAllAsmPrinters();
+  llvm::InitializeAllAsmParsers();
+}
+
+std::unique_ptr<llvm::TargetMachine> create_target_machine(llvm::Module &module)
+{
+  std::string error{};
+  const llvm::Target *target{ llvm::TargetRegistry::lookupTarget(module.getTargetTriple(), error) };
+  if (!target) return nullptr;
+  return std::unique_ptr<llvm::TargetMachine>{ target->createTargetMachine(
+    module.getTargetTriple(), "", "", llvm::TargetOptions{}, llvm::None) };
+}
+
+bool optimize(llvm::Module &module, llvm::TargetMachine *tm, const std::string &pipeline, std::string &error)
+{
+  llvm::PassBuilder pb{ tm };
+  Analysis_managers managers{ pb };
+  llvm::ModulePassManager mpm{};
+  if (auto parse_error{ pb.parsePassPipeline(mpm, pipeline) }) {
+    error = llvm::toString(std::move(parse_error));
+    return false;
+  }
+  mpm.run(module, managers.mam);
+  return true;
+}
+
+EstimateCostPass::Estimate estimate(llvm::Module &module, llvm::TargetMachine *tm, bool per_function)
+{
+  llvm::PassBuilder pb{ tm };
+  Analysis_managers managers{ pb };
+  return EstimateCostPass{}.estimate(module, managers.mam, per_function);
+}
+
+Binary_output::File frequency_tables(llvm::Module &module, llvm::TargetMachine *tm)
+{
+  llvm::PassBuilder pb{ tm };
+  Analysis_managers managers{ pb };
+  return EstimateCostPass{}.frequency_tables(module, managers.mam);
+}
+
+Binary_output::File cost_tables(llvm::Module &module, llvm::TargetMachine *tm)
+{
+  llvm::PassBuilder pb{ tm };
+  Analysis_managers managers{ pb };
+  return EstimateCostPass{}.cost_tables(module, managers.mam);
+}
@@ -0,0 +1,46 @@
+/*
+  This file is distributed under the University of Illinois Open Source
+  License. See LICENSE for details.
+*/
+
+#pragma once
+
+// Support for the standalone tools, which link EstimateCostPass and the Wu-Larus analyses in instead of loading them
+// as opt plugins.
+
+#include <llvm/IR/Module.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Target/TargetMachine.h>
+
+#include <memory>
+#include <string>
+
+#include "../estimate_cost_pass.hh"
+
+// Analysis managers of one pipeline run, with the standard analyses and the Wu-Larus ones the plugins register.
+struct Analysis_managers {
+  llvm::LoopAnalysisManager lam{};
+  llvm::FunctionAnalysisManager fam{};
+  llvm::CGSCCAnalysisManager cgam{};
+  llvm::ModuleAnalysisManager mam{};
+
+  explicit Analysis_managers(llvm::PassBuilder &pb);
+};
+
+// Register every target, as opt does (the mca cost kind and -estimate-targets need their code generators).
+void initialize_targets();
+
+// Target machine for the triple of <module> with the generic CPU, used by PassBuilder; the cost model itself follows
+// each function's target-cpu. Returns nullptr if the module has no triple or the target isn't available.
+std::unique_ptr<llvm::TargetMachine> create_target_machine(llvm::Module &module);
+
+// Run the new pass manager pipeline <pipeline> (PassBuilder text) on <module>. Returns false and sets <error> if the
+// pipeline doesn't parse.
+bool optimize(llvm::Module &module, llvm::TargetMachine *tm, const std::string &pipeline, std::string &error);
+
+// EstimateCostPass::estimate on <module>, with fresh analysis managers.
+EstimateCostPass::Estimate estimate(llvm::Module &module, llvm::TargetMachine *tm, bool per_function = false);
+
+// EstimateCostPass::frequency_tables and cost_tables on <module>, with fresh analysis managers.
+Binary_output::File frequency_tables(llvm::Module &module, llvm::TargetMachine *tm);
+Binary_output::File cost_tables(llvm::Module &module, llvm::TargetMachine *tm);
@@ -0,0 +1,124 @@
+/*
+  This file is distributed under the University of Illinois Open Source
+  License. See LICENSE for details.
+*/
+
+#include <llvm/ADT/STLExtras.h>
+#include <llvm/Analysis/PostDominators.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <llvm/Transforms/Utils/ValueMapper.h>
+
+#include "../../WuLarus/A3.Function_call_frequency/function_call_frequency_pass.hh"
+#include "incremental_estimator.hh"
+
+namespace {
+  // Move the blocks of <from> to <to>, which has none. The blocks and their instructions stay the same objects.
+  void move_blocks(llvm::Function &to, llvm::Function &from)
+  {
+    to.getBasicBlockList().splice(to.end(), from.getBasicBlockList());
+  }
+} // namespace
+
+Incremental_estimator::Incremental_estimator(llvm::Module &module, llvm::TargetMachine *tm,
+                                             llvm::Optional<llvm::TargetTransformInfo::TargetCostKind> kind)
+  : module_{ module }, kind_{ kind }, pb_{ tm }, managers_{ pb_ },
+    wu_larus_{ &managers_.mam.getResult<FunctionCallFrequencyPass>(module) }
+{
+  for (llvm::Function &fun : module_) estimate(fun);
+  functions_ = module_.size();
+}
+
+void Incremental_estimator::invalidate(llvm::Function &fun)
+{
+  // Also drops the results cached for an erased function at the same address.
+  managers_.fam.invalidate(fun, llvm::PreservedAnalyses::none());
+  dirty_.insert(&fun);
+}
+
+double Incremental_estimator::cost()
+{
+  if (!dirty_.empty() || module_.size() != functions_) {
+    wu_larus_->update(module_, managers_.fam, dirty_);
+    llvm::DenseMap<llvm::Function *, double> local_costs{};
+    for (llvm::Function &fun : module_) { // Invalidated functions may have been erased since.
+      if (dirty_.count(&fun)) estimate(fun);
+      auto found{ local_costs_.find(&fun) };
+      if (found != local_costs_.end()) local_costs[&fun] = found->second;
+    }
+    local_costs_ = std::move(local_costs);
+    dirty_.clear();
+    functions_ = module_.size();
+  }
+  double total{ 0 };
+  for (auto &[fun, cost] : local_costs_) total += cost * wu_larus_->get_invocation_frequency(fun);
+  return total;
+}
+
+double Incremental_estimator::local_cost(llvm::Function &fun)
+{
+  cost();
+  auto found{ local_costs_.find(&fun) };
+  return found == local_costs_.end() ? 0 : found->second;
+}
+
+double Incremental_estimator::global_cost(llvm::Function &fun)
+{
+  return local_cost(fun) * wu_larus_->get_invocation_frequency(&fun);
+}
+
+/* What-if estimates.
+  The blocks of the transformed clone are moved into <fun> for the estimate, the ones of <fun> waiting in a detached
+  function meanwhile, then both are moved back: the blocks and instructions of <fun> are never copied or freed, so the
+  caller's pointers into it stay valid (e.g. while it goes through the call sites of <fun>). The clone leaves the
+  module once transformed, so A3 never sees it. Both updates are incremental: A2 runs on <fun> alone each time.
+***********************************************************************************************************************/
+double Incremental_estimator::what_if(llvm::Function &fun, llvm::function_ref<bool(llvm::Function &)> transform)
+{
+  double current{ cost() };
+  if (fun.isDeclaration()) return current;
+  llvm::ValueToValueMapTy scratch_values{};
+  llvm::Function *scratch{ llvm::CloneFunction(&fun, scratch_values) };
+  if (!transform(*scratch)) {
+    scratch->eraseFromParent();
+    return current;
+  }
+  scratch->removeFromParent();
+  // The arguments of <fun> stand in for those of the clone in its blocks.
+  for (auto [scratch_arg, arg] : llvm::zip(scratch->args(), fun.args())) scratch_arg.replaceAllUsesWith(&arg);
+  std::unique_ptr<llvm::Function> original{ llvm::Function::Create(fun.getFunctionType(), fun.getLinkage()) };
+  move_blocks(*original, fun);
+  move_blocks(fun, *scratch);
+  invalidate(fun);
+  double transformed{ cost() };
+  move_blocks(*scratch, fun);
+  move_blocks(fun, *original);
+  delete scratch;
+  invalidate(fun);
+  cost();
+  return transformed;
+}
+
+// Cost of a single invocation of <fun>: the instruction costs times the local frequencies (A2) of their blocks.
+void Incremental_estimator::estimate(llvm::Function &fun)
+{
+  if (fun.isDeclaration()) {
+    local_costs_.erase(&fun);
+    return;
+  }
+  llvm::TargetTransformInfo &tti{ managers_.fam.getResult<llvm::TargetIRAnalysis>(fun) };
+  double cost{ 0 };
+  for (llvm::BasicBlock &bb : fun) {
+    double instructions{ 0 };
+    for (llvm::Instruction &instr : bb) {
+      if (!kind_) {
+        instructions += 1;
+        continue;
+      }
+      auto tti_cost{ tti.getInstructionCost(&instr, *kind_).getValue() };
+      instructions += tti_cost.hasValue() ? static_cast<double>(tti_cost.getValue()) : 0;
+    }
+    cost += instructions * wu_larus_->get_local_block_frequency(&bb);
+  }
+  local_costs_[&fun] = cost;
+}
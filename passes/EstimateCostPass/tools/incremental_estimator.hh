@@ -0,0 +1,56 @@
+/*
+  This file is distributed under the University of Illinois Open Source
+  License. See LICENSE for details.
+*/
+
+#pragma once
+
+// Cost of a module kept up to date across local changes (inlining a call site, unrolling a loop, deleting a block),
+// for the clients that try many of them: only the changed functions are analysed again (Wu-Larus A1 and A2), and the
+// invocation frequencies are propagated again (A3) through the functions they call, directly or not. The cost is the
+// one EstimateCostPass computes for a TTI cost kind (or one), without the components.
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/Optional.h>
+#include <llvm/ADT/STLFunctionalExtras.h>
+#include <llvm/Analysis/TargetTransformInfo.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Target/TargetMachine.h>
+
+#include <set>
+
+#include "estimator.hh"
+
+class Incremental_estimator {
+public:
+  // Instruction costs of TTI kind <kind>, or 1 per instruction without one. <module> and <tm> must outlive it.
+  Incremental_estimator(llvm::Module &module, llvm::TargetMachine *tm,
+                        llvm::Optional<llvm::TargetTransformInfo::TargetCostKind> kind);
+
+  // <fun> was changed, or added to the module. Erasing a function needs no call.
+  void invalidate(llvm::Function &fun);
+  // Cost of the module, brought up to date with the functions invalidated since the last call.
+  double cost();
+  // Cost of <fun> per invocation, and in all its invocations.
+  double local_cost(llvm::Function &fun);
+  double global_cost(llvm::Function &fun);
+  // Cost the module would have if <transform> were applied to <fun>, which is left as it was, down to its blocks and
+  // instructions. <transform> runs on a scratch clone of <fun>, whose body stands in for the one of <fun> during the
+  // estimate; it returns whether it changed the clone. The cost of the other functions changes only through the
+  // invocation frequencies.
+  double what_if(llvm::Function &fun, llvm::function_ref<bool(llvm::Function &)> transform);
+
+private:
+  void estimate(llvm::Function &fun);
+
+  llvm::Module &module_;
+  llvm::Optional<llvm::TargetTransformInfo::TargetCostKind> kind_;
+  llvm::PassBuilder pb_;
+  Analysis_managers managers_;
+  FunctionCallFrequencyPass *wu_larus_;
+  std::set<llvm::Function *> dirty_{};
+  size_t functions_{ 0 }; // In the module at the last update: erased functions change it.
+  llvm::DenseMap<llvm::Function *, double> local_costs_{}; // Per invocation.
+};
@@ -0,0 +1,119 @@
+/*
+  This file is distributed under the University of Illinois Open Source
+  License. See LICENSE for details.
+*/
+
+#include <llvm/ADT/StringRef.h>
+
+#include <algorithm>
+
+#include "legacy_pipeline.hh"
+
+namespace {
+  // Pass manager nesting a pass runs in.
+  enum class Pass_level { module, cgscc, function, loop, loop_mssa };
+
+  struct Legacy_pass {
+    const char *flag;
+    const char *name; // New pass manager name.
+    Pass_level level;
+  };
+
+  // The flags used by the experiments. codegenprepare and prune-eh have no new pass manager version.
+  constexpr Legacy_pass legacy_passes[]{
+    { "adce", "adce", Pass_level::function },
+    { "aggressive-instcombine", "aggressive-instcombine", Pass_level::function },
+    { "always-inline", "always-inline", Pass_level::module },
+    { "break-crit-edges", "break-crit-edges", Pass_level::function },
+    { "constmerge", "constmerge", Pass_level::module },
+    { "dce", "dce", Pass_level::function },
+    { "deadargelim", "deadargelim", Pass_level::module },
+    { "dse", "dse", Pass_level::function },
+    { "function-attrs", "function-attrs", Pass_level::cgscc },
+    { "globaldce", "globaldce", Pass_level::module },
+    { "globalopt", "globalopt", Pass_level::module },
+    { "gvn", "gvn", Pass_level::function },
+    { "indvars", "indvars", Pass_level::loop },
+    { "inline", "inline", Pass_level::cgscc },
+    { "instcombine", "instcombine", Pass_level::function },
+    { "ipsccp", "ipsccp", Pass_level::module },
+    { "jump-threading", "jump-threading", Pass_level::function },
+    { "lcssa", "lcssa", Pass_level::function },
+    { "licm", "licm", Pass_level::loop_mssa },
+    { "loop-deletion", "loop-deletion", Pass_level::loop },
+    { "loop-extract", "loop-extract", Pass_level::module },
+    { "loop-extract-single", "loop-extract<single>", Pass_level::module },
+    { "loop-reduce", "loop-reduce", Pass_level::loop },
+    { "loop-rotate", "loop-rotate", Pass_level::loop },
+    { "loop-simplify", "loop-simplify", Pass_level::function },
+    { "loop-unroll", "loop-unroll", Pass_level::function },
+    { "loop-unroll-and-jam", "loop-unroll-and-jam", Pass_level::loop },
+    { "lower-global-dtors", "lower-global-dtors", Pass_level::module },
+    { "loweratomic", "loweratomic", Pass_level::function },
+    { "lowerinvoke", "lowerinvoke", Pass_level::function },
+    { "lowerswitch", "lowerswitch", Pass_level::function },
+    { "mem2reg", "mem2reg", Pass_level::function },
+    { "memcpyopt", "memcpyopt", Pass_level::function },
+    { "mergefunc", "mergefunc", Pass_level::module },
+    { "mergereturn", "mergereturn", Pass_level::function },
+    { "partial-inliner", "partial-inliner", Pass_level::module },
+    { "reassociate", "reassociate", Pass_level::function },
+    { "reg2mem", "reg2mem", Pass_level::function },
+    { "sccp", "sccp", Pass_level::function },
+    { "simplifycfg", "simplifycfg", Pass_level::function },
+    { "sink", "sink", Pass_level::function },
+    { "sroa", "sroa", Pass_level::function },
+    { "strip", "strip", Pass_level::module },
+    { "strip-dead-debug-info", "strip-dead-debug-info", Pass_level::module },
+    { "strip-dead-prototypes", "strip-dead-prototypes", Pass_level::module },
+    { "strip-debug-declare", "strip-debug-declare", Pass_level::module },
+    { "strip-nondebug", "strip-nondebug", Pass_level::module },
+    { "tailcallelim", "tailcallelim", Pass_level::function },
+  };
+
+  const std::vector<std::string> &adaptors(Pass_level level)
+  {
+    static const std::vector<std::string> module{}, cgscc{ "cgscc" }, function{ "function" },
+      loop{ "function", "loop" }, loop_mssa{ "function", "loop-mssa" };
+    switch (level) {
+    case Pass_level::cgscc: return cgscc;
+    case Pass_level::function: return function;
+    case Pass_level::loop: return loop;
+    case Pass_level::loop_mssa: return loop_mssa;
+    default: return module;
+    }
+  }
+} // namespace
+
+Legacy_pipeline legacy_pipeline(const std::vector<std::string> &flags)
+{
+  Legacy_pipeline pipeline{};
+  auto add = [&](const std::vector<std::string> &nesting, const std::string &name) {
+    if (!pipeline.text.empty()) pipeline.text += ',';
+    for (const std::string &adaptor : nesting) pipeline.text += adaptor + '(';
+    pipeline.text += name + std::string(nesting.size(), ')');
+  };
+
+  for (const std::string &flag : flags) {
+    llvm::StringRef name{ llvm::StringRef{ flag }.trim().ltrim('-') };
+    if (name.empty()) continue;
+    if (name == "O0" || name == "O1" || name == "O2" || name == "O3" || name == "Os" || name == "Oz") {
+      add(adaptors(Pass_level::module), "default<" + name.str() + '>');
+      continue;
+    }
+    const Legacy_pass *found{ nullptr };
+    for (const Legacy_pass &pass : legacy_passes)
+      if (name == pass.flag) found = &pass;
+    if (found) add(adaptors(found->level), found->name);
+    else if (std::find(pipeline.skipped.begin(), pipeline.skipped.end(), flag) == pipeline.skipped.end())
+      pipeline.skipped.push_back(flag);
+  }
+  return pipeline;
+}
+
+std::vector<std::string> legacy_flags()
+{
+  std::vector<std::string> flags{};
+  for (const Legacy_pass &pass : legacy_passes) flags.push_back(std::string{ "-" } + pass.flag);
+  return flags;
+}
@@ -0,0 +1,23 @@
+/*
+  This file is distributed under the University of Illinois Open Source
+  License. See LICENSE for details.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+// A legacy opt flag sequence (-adce -licm ..., as in experiments/seqs/flags.yaml) as new pass manager pipeline text.
+struct Legacy_pipeline {
+  std::string text{};
+  std::vector<std::string> skipped{}; // Flags without a new pass manager equivalent, dropped (listed once).
+};
+
+// Translate <flags> in order. Each flag is a top level pass of its own, in its adaptor if it runs on functions, loops
+// or SCCs, so it runs over the whole module before the next one starts, as with opt <flags>. -O0 to -O3, -Os and -Oz
+// become the default pipelines.
+Legacy_pipeline legacy_pipeline(const std::vector<std::string> &flags);
+
+// The flags legacy_pipeline translates (generate_seqs.py's LLVM_FLAGS but codegenprepare and prune-eh), "-" prefixed.
+std::vector<std::string> legacy_flags();
@@ -0,0 +1,415 @@
+/*
+  This file is distributed under the University of Illinois Open Source
+  License. See LICENSE for details.
+*/
+
+// Python module estimate_cost: the estimator in process, for the scripts that otherwise go through opt and YAML files.
+// Tables come back as binary_output.load returns them ({table: {column: array, 'rows': n}}, strings as lists), but
+// the arrays are numpy views of the C++ columns, which live as long as any array of the call does.
+//
+//   import estimate_cost
+//   estimate_cost.set_options(['-prediction-cost-kind=latency,one'])  # EstimateCostPass options, replacing earlier ones
+//   module = estimate_cost.Module('x.bc')                               # Or Module(data=bitcode_or_ir_bytes)
+//   skipped = module.optimize(['-mem2reg', '-licm'])                    # Legacy flags, or a new pass manager pipeline
+//   module.estimate()                                                   # {'Latency': ..., 'One': ...}
+//   module.frequencies()['blocks']['freq'], module.costs()['functions']['costs']
+//   cost, sites = module.what_if_inline('main')                        # Cost with each call of main inlined
+// Written with the CPython and numpy C APIs, so it builds wherever the Python headers and numpy are installed.
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#define NPY_NO_DEPRECATED_API NPY_1_7_API_VERSION
+#include <numpy/arrayobject.h>
+
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IRReader/IRReader.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/SourceMgr.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "estimator.hh"
+#include "incremental_estimator.hh"
+#include "legacy_pipeline.hh"
+
+namespace {
+  // Copies share the context of the module they were made from, so it is released with the last of them.
+  struct Module_state {
+    std::shared_ptr<llvm::LLVMContext> context;
+    std::unique_ptr<llvm::Module> module;
+    std::unique_ptr<llvm::TargetMachine> tm;
+  };
+
+  struct Py_module {
+    PyObject_HEAD
+    Module_state *state;
+  };
+
+  PyObject *py_module_type_object();
+
+  PyObject *new_py_module(Module_state *state)
+  {
+    Py_module *self{ PyObject_New(Py_module, reinterpret_cast<PyTypeObject *>(py_module_type_object())) };
+    if (!self) {
+      delete state;
+      return nullptr;
+    }
+    self->state = state;
+    return reinterpret_cast<PyObject *>(self);
+  }
+
+  /* Tables.
+    Each array holds a reference to a capsule owning the shared tables, the base object numpy keeps alive.
+  *********************************************************************************************************************/
+  int numpy_type(Binary_output::Type type)
+  {
+    switch (type) {
+    case Binary_output::Type::u32: return NPY_UINT32;
+    case Binary_output::Type::u64: return NPY_UINT64;
+    case Binary_output::Type::f64: return NPY_FLOAT64;
+    default: return NPY_UINT8;
+    }
+  }
+
+  PyObject *column_array(const Binary_output::Column &column, const std::shared_ptr<Binary_output::File> &file)
+  {
+    int type{ numpy_type(column.type) };
+    npy_intp item_size{ column.type == Binary_output::Type::u32 ? 4 : column.type == Binary_output::Type::bytes ? 1 : 8 };
+    npy_intp width{ column.width ? static_cast<npy_intp>(column.width) : 1 };
+    npy_intp dims[2]{ static_cast<npy_intp>(column.data.size()) / item_size / width, width };
+    int nd{ width > 1 ? 2 : 1 };
+    if (column.data.empty()) return PyArray_SimpleNew(nd, dims, type);
+    PyObject *array{ PyArray_SimpleNewFromData(nd, dims, type, const_cast<char *>(column.data.data())) };
+    if (!array) return nullptr;
+    PyObject *owner{ PyCapsule_New(new std::shared_ptr<Binary_output::File>{ file }, nullptr, [](PyObject *capsule) {
+      delete static_cast<std::shared_ptr<Binary_output::File> *>(PyCapsule_GetPointer(capsule, nullptr));
+    }) };
+    if (!owner || PyArray_SetBaseObject(reinterpret_cast<PyArrayObject *>(array), owner) < 0) {
+      Py_XDECREF(owner);
+      Py_DECREF(array);
+      return nullptr;
+    }
+    PyArray_CLEARFLAGS(reinterpret_cast<PyArrayObject *>(array), NPY_ARRAY_WRITEABLE);
+    return array;
+  }
+
+  // Set <key> of <dict> to <value>, taking the reference. Returns false (with the Python error set) on failure.
+  bool set_item(PyObject *dict, const std::string &key, PyObject *value)
+  {
+    if (!value) return false;
+    int result{ PyDict_SetItemString(dict, key.c_str(), value) };
+    Py_DECREF(value);
+    return result == 0;
+  }
+
+  PyObject *tables_dict(Binary_output::File tables)
+  {
+    auto file{ std::make_shared<Binary_output::File>(std::move(tables)) };
+    PyObject *result{ PyDict_New() };
+    for (const Binary_output::Table &table : file->tables) {
+      PyObject *columns{ PyDict_New() };
+      bool ok{ set_item(result, table.name, columns) };
+      for (const Binary_output::Column &column : table.columns) {
+        if (!ok) break;
+        if (table.find(column.name + "_data")) { // Strings.
+          std::vector<std::string> values{ table.get_strings(column.name) };
+          PyObject *list{ PyList_New(values.size()) };
+          for (size_t i = 0; list && i < values.size(); ++i)
+            PyList_SET_ITEM(list, i, PyUnicode_DecodeUTF8(values[i].data(), values[i].size(), "replace"));
+          ok = set_item(columns, column.name, list);
+        } else if (column.type != Binary_output::Type::bytes) {
+          ok = set_item(columns, column.name, column_array(column, file));
+        }
+      }
+      if (!ok || !set_item(columns, "rows", PyLong_FromUnsignedLongLong(table.rows))) {
+        Py_DECREF(result);
+        return nullptr;
+      }
+    }
+    return result;
+  }
+
+  /* Module.
+  *********************************************************************************************************************/
+  int module_init(Py_module *self, PyObject *args, PyObject *kwargs)
+  {
+    const char *keywords[]{ "path", "data", nullptr };
+    const char *path{ nullptr };
+    Py_buffer data{};
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|zy*", const_cast<char **>(keywords), &path, &data)) return -1;
+    std::unique_ptr<llvm::MemoryBuffer> buffer{};
+    if (data.obj) {
+      buffer = llvm::MemoryBuffer::getMemBufferCopy(
+        llvm::StringRef{ static_cast<const char *>(data.buf), static_cast<size_t>(data.len) }, "data");
+      PyBuffer_Release(&data);
+    } else if (path) {
+      auto file{ llvm::MemoryBuffer::getFile(path) };
+      if (!file) {
+        PyErr_Format(PyExc_OSError, "Unable to read [%s]: %s", path, file.getError().message().c_str());
+        return -1;
+      }
+      buffer = std::move(*file);
+    } else {
+      PyErr_SetString(PyExc_TypeError, "Module() needs a path or data");
+      return -1;
+    }
+    auto state{ std::make_unique<Module_state>() };
+    state->context = std::make_shared<llvm::LLVMContext>();
+    llvm::SMDiagnostic diagnostic{};
+    state->module = llvm::parseIR(buffer->getMemBufferRef(), diagnostic, *state->context);
+    if (!state->module) {
+      PyErr_Format(PyExc_ValueError, "Unable to parse the module: %s", diagnostic.getMessage().str().c_str());
+      return -1;
+    }
+    state->tm = create_target_machine(*state->module);
+    delete self->state;
+    self->state = state.release();
+    return 0;
+  }
+
+  void module_dealloc(Py_module *self)
+  {
+    delete self->state;
+    Py_TYPE(self)->tp_free(reinterpret_cast<PyObject *>(self));
+  }
+
+  Module_state *checked_state(Py_module *self)
+  {
+    if (!self->state) PyErr_SetString(PyExc_RuntimeError, "Module not initialized");
+    return self->state;
+  }
+
+  // optimize(pipeline): a new pass manager pipeline string, or a list of legacy flags (as in flags.yaml). Returns the
+  // legacy flags without a new pass manager equivalent, which were skipped.
+  PyObject *module_optimize(Py_module *self, PyObject *pipeline)
+  {
+    Module_state *state{ checked_state(self) };
+    if (!state) return nullptr;
+    Legacy_pipeline translated{};
+    if (PyUnicode_Check(pipeline)) {
+      translated.text = PyUnicode_AsUTF8(pipeline);
+    } else {
+      PyObject *flags{ PySequence_Fast(pipeline, "optimize() takes a pipeline string or a list of flags") };
+      if (!flags) return nullptr;
+      std::vector<std::string> legacy_flags{};
+      for (Py_ssize_t i = 0; i < PySequence_Fast_GET_SIZE(flags); ++i) {
+        const char *flag{ PyUnicode_AsUTF8(PySequence_Fast_GET_ITEM(flags, i)) };
+        if (!flag) {
+          Py_DECREF(flags);
+          return nullptr;
+        }
+        legacy_flags.push_back(flag);
+      }
+      Py_DECREF(flags);
+      translated = legacy_pipeline(legacy_flags);
+    }
+    std::string error{};
+    if (!translated.text.empty() && !optimize(*state->module, state->tm.get(), translated.text, error)) {
+      PyErr_Format(PyExc_ValueError, "Invalid pipeline [%s]: %s", translated.text.c_str(), error.c_str());
+      return nullptr;
+    }
+    PyObject *skipped{ PyList_New(translated.skipped.size()) };
+    for (size_t i = 0; skipped && i < translated.skipped.size(); ++i)
+      PyList_SET_ITEM(skipped, i, PyUnicode_FromString(translated.skipped[i].c_str()));
+    return skipped;
+  }
+
+  // estimate(per_function=False): {kind: total}, or ({kind: total}, {kind: {function: cost}}).
+  PyObject *module_estimate(Py_module *self, PyObject *args, PyObject *kwargs)
+  {
+    const char *keywords[]{ "per_function", nullptr };
+    int per_function{ 0 };
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|p", const_cast<char **>(keywords), &per_function)) return nullptr;
+    Module_state *state{ checked_state(self) };
+    if (!state) return nullptr;
+    EstimateCostPass::Estimate result{ estimate(*state->module, state->tm.get(), per_function) };
+    PyObject *totals{ PyDict_New() }, *functions{ PyDict_New() };
+    bool ok{ totals && functions };
+    for (auto &[kind, total] : result.totals)
+      ok = ok && set_item(totals, cost_name(kind), PyFloat_FromDouble(total));
+    for (auto &[kind, costs] : result.functions) {
+      PyObject *kind_costs{ PyDict_New() };
+      ok = ok && set_item(functions, cost_name(kind), kind_costs);
+      for (auto &[name, cost] : costs) ok = ok && set_item(kind_costs, name, PyFloat_FromDouble(cost));
+    }
+    if (!ok) {
+      Py_XDECREF(totals);
+      Py_XDECREF(functions);
+      return nullptr;
+    }
+    if (!per_function) {
+      Py_DECREF(functions);
+      return totals;
+    }
+    return Py_BuildValue("(NN)", totals, functions);
+  }
+
+  PyObject *module_frequencies(Py_module *self, PyObject *)
+  {
+    Module_state *state{ checked_state(self) };
+    return state ? tables_dict(frequency_tables(*state->module, state->tm.get())) : nullptr;
+  }
+
+  PyObject *module_costs(Py_module *self, PyObject *)
+  {
+    Module_state *state{ checked_state(self) };
+    return state ? tables_dict(cost_tables(*state->module, state->tm.get())) : nullptr;
+  }
+
+  PyObject *module_copy(Py_module *self, PyObject *)
+  {
+    Module_state *state{ checked_state(self) };
+    if (!state) return nullptr;
+    auto copy{ new Module_state{ state->context, llvm::CloneModule(*state->module), create_target_machine(*state->module) } };
+    return new_py_module(copy);
+  }
+
+  // what_if_inline(function, kind='latency'): the cost of the module, and a list of (callee, cost) with the cost the
+  // module would have with each call of <function> to a defined function inlined, in the order of the calls. <kind> is
+  // a TTI cost kind or one; the costs are those of Incremental_estimator, and the module is left unchanged.
+  PyObject *module_what_if_inline(Py_module *self, PyObject *args, PyObject *kwargs)
+  {
+    const char *keywords[]{ "function", "kind", nullptr };
+    const char *name{ nullptr }, *kind_name{ "latency" };
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s|s", const_cast<char **>(keywords), &name, &kind_name))
+      return nullptr;
+    Module_state *state{ checked_state(self) };
+    if (!state) return nullptr;
+    Cost_option kind{};
+    if (!parse_cost_option(kind_name, kind) || !(is_llvm_cost(kind) || kind == Cost_option::one)) {
+      PyErr_Format(PyExc_ValueError, "Invalid cost kind [%s]: a TTI cost kind or one", kind_name);
+      return nullptr;
+    }
+    llvm::Function *fun{ state->module->getFunction(name) };
+    if (!fun || fun->isDeclaration()) {
+      PyErr_Format(PyExc_KeyError, "No function [%s] with a body", name);
+      return nullptr;
+    }
+    llvm::Optional<llvm::TargetTransformInfo::TargetCostKind> tti_kind{};
+    if (kind != Cost_option::one) tti_kind = cost_opt_to_tti_cost(kind);
+    Incremental_estimator estimator{ *state->module, state->tm.get(), tti_kind };
+
+    // The calls are found in the clone by their position among the instructions.
+    std::vector<std::pair<llvm::CallBase *, size_t>> calls{};
+    size_t position{ 0 };
+    for (llvm::Instruction &instr : llvm::instructions(*fun)) {
+      auto *call{ llvm::dyn_cast<llvm::CallBase>(&instr) };
+      if (call && call->getCalledFunction() && !call->getCalledFunction()->isDeclaration())
+        calls.emplace_back(call, position);
+      ++position;
+    }
+    double cost{ estimator.cost() };
+    PyObject *sites{ PyList_New(calls.size()) };
+    if (!sites) return nullptr;
+    for (size_t i = 0; i < calls.size(); ++i) {
+      auto [call, call_position] = calls[i];
+      double inlined{ estimator.what_if(*fun, [&, call_position = call_position](llvm::Function &clone) {
+        auto instr{ llvm::inst_begin(clone) };
+        std::advance(instr, call_position);
+        llvm::InlineFunctionInfo info{};
+        return llvm::InlineFunction(llvm::cast<llvm::CallBase>(*instr), info).isSuccess();
+      }) };
+      PyObject *site{ Py_BuildValue("(sd)", call->getCalledFunction()->getName().str().c_str(), inlined) };
+      if (!site) {
+        Py_DECREF(sites);
+        return nullptr;
+      }
+      PyList_SET_ITEM(sites, i, site);
+    }
+    return Py_BuildValue("(dN)", cost, sites);
+  }
+
+  PyMethodDef module_methods[]{
+    { "optimize", reinterpret_cast<PyCFunction>(module_optimize), METH_O,
+      "Optimize with a new pass manager pipeline string or a list of legacy flags; returns the skipped flags." },
+    { "estimate", reinterpret_cast<PyCFunction>(module_estimate), METH_VARARGS | METH_KEYWORDS,
+      "Total cost per cost kind; with per_function=True, also the cost of each function." },
+    { "frequencies", reinterpret_cast<PyCFunction>(module_frequencies), METH_NOARGS,
+      "Function and block frequencies and block opcode histograms, as numpy arrays." },
+    { "costs", reinterpret_cast<PyCFunction>(module_costs), METH_NOARGS,
+      "Cost tables of the binary output, as numpy arrays." },
+    { "copy", reinterpret_cast<PyCFunction>(module_copy), METH_NOARGS,
+      "A copy of the module, to optimize differently." },
+    { "what_if_inline", reinterpret_cast<PyCFunction>(module_what_if_inline), METH_VARARGS | METH_KEYWORDS,
+      "Cost of the module, and the cost with each call of a function inlined, estimated incrementally." },
+    { nullptr, nullptr, 0, nullptr },
+  };
+
+  PyObject *py_module_type_object()
+  {
+    static PyTypeObject type{ PyVarObject_HEAD_INIT(nullptr, 0) };
+    if (!type.tp_name) {
+      type.tp_name = "estimate_cost.Module";
+      type.tp_basicsize = sizeof(Py_module);
+      type.tp_flags = Py_TPFLAGS_DEFAULT;
+      type.tp_doc = "An LLVM module, from a file (path) or bitcode/IR bytes (data).";
+      type.tp_new = PyType_GenericNew;
+      type.tp_init = reinterpret_cast<initproc>(module_init);
+      type.tp_dealloc = reinterpret_cast<destructor>(module_dealloc);
+      type.tp_methods = module_methods;
+    }
+    return reinterpret_cast<PyObject *>(&type);
+  }
+
+  /* Module functions.
+  *********************************************************************************************************************/
+  // set_options(options): parse EstimateCostPass (and LLVM) command line options; the ones not given get their
+  // defaults back.
+  PyObject *set_options(PyObject *, PyObject *options)
+  {
+    PyObject *items{ PySequence_Fast(options, "set_options() takes a list of options") };
+    if (!items) return nullptr;
+    std::vector<std::string> args{ "estimate_cost" };
+    for (Py_ssize_t i = 0; i < PySequence_Fast_GET_SIZE(items); ++i) {
+      const char *option{ PyUnicode_AsUTF8(PySequence_Fast_GET_ITEM(items, i)) };
+      if (!option) {
+        Py_DECREF(items);
+        return nullptr;
+      }
+      args.push_back(option);
+    }
+    Py_DECREF(items);
+    std::vector<const char *> argv{};
+    for (const std::string &arg : args) argv.push_back(arg.c_str());
+    llvm::cl::ResetAllOptionOccurrences();
+    std::string error{};
+    llvm::raw_string_ostream error_stream{ error };
+    if (!llvm::cl::ParseCommandLineOptions(argv.size(), argv.data(), "", &error_stream)) {
+      PyErr_SetString(PyExc_ValueError, error_stream.str().c_str());
+      return nullptr;
+    }
+    Py_RETURN_NONE;
+  }
+
+  PyMethodDef functions[]{
+    { "set_options", set_options, METH_O, "Set EstimateCostPass options, e.g. ['-prediction-cost-kind=latency']." },
+    { nullptr, nullptr, 0, nullptr },
+  };
+
+  PyModuleDef definition{ PyModuleDef_HEAD_INIT, "estimate_cost", "EstimateCostPass and the Wu-Larus analyses in process.",
+                          -1, functions };
+} // namespace
+
+PyMODINIT_FUNC PyInit_estimate_cost()
+{
+  import_array();
+  PyObject *type{ py_module_type_object() };
+  if (PyType_Ready(reinterpret_cast<PyTypeObject *>(type)) < 0) return nullptr;
+  PyObject *module{ PyModule_Create(&definition) };
+  if (!module) return nullptr;
+  Py_INCREF(type);
+  if (PyModule_AddObject(module, "Module", type) < 0) {
+    Py_DECREF(type);
+    Py_DECREF(module);
+    return nullptr;
+  }
+  initialize_targets();
+  return module;
+}
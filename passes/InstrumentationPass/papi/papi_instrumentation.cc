@@ -7,6 +7,8 @@
 #include <unordered_map>
 #include <vector>
 
+#include "../../EstimateCostPass/binary_output.hh"
+
 using namespace std;
 
 namespace Papi_instrumentation {
@@ -79,11 +81,46 @@ namespace Papi_instrumentation {
     return pause();
   }
 
+  // Runtime data in the columnar binary format, for output files named *.bin: a blocks table with the function name,
+  // block id, runs, pauses, cycles and average cycles of each block.
+  void finalize_binary()
+  {
+    Binary_output::Table blocks{ "blocks" };
+    vector<string> functions{};
+    vector<uint64_t> ids{}, runs{}, pauses{}, cycles{};
+    vector<double> average{};
+    for (auto &[fun_name, bb_count] : counts) {
+      for (auto &[bb, count] : bb_count) {
+        functions.push_back(fun_name);
+        ids.push_back(bb);
+        runs.push_back(count.executions);
+        pauses.push_back(count.pauses);
+        cycles.push_back(count.cycles);
+        average.push_back(static_cast<double>(count.cycles) / count.executions);
+      }
+    }
+    blocks.rows = ids.size();
+    blocks.add_strings("function", functions);
+    blocks.add("id", ids);
+    blocks.add("runs", runs);
+    blocks.add("pauses", pauses);
+    blocks.add("cycles", cycles);
+    blocks.add("average", average);
+    ofstream output{ output_file, ios::binary };
+    output << Binary_output::serialize({ Binary_output::Kind::runtime_data, { blocks } });
+  }
+
   void finalize()
   {
     if (counting) stop();
 
 //    cout << "Finalizing...";
+    if (Binary_output::is_binary_path(output_file)) {
+      finalize_binary();
+      PAPI_cleanup_eventset(event_set);
+      PAPI_destroy_eventset(&event_set);
+      return;
+    }
     ofstream output{ output_file };
     output << "Runtime_data:\n"
            << "  Instrumentation: PAPI_TOT_CYC\n"
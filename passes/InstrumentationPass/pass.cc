@@ -3,6 +3,8 @@
 #include <llvm/Passes/PassPlugin.h>
 #include <fstream>
 
+#include "../EstimateCostPass/binary_output.hh"
+
 using namespace llvm;
 using namespace std;
 
@@ -29,7 +31,7 @@ cl::opt<std::string> instrumentation_output(
 cl::opt<std::string> yaml_output(
   "yaml-output",
   cl::init("yaml_output.yaml"),
-  cl::desc("YAML output file name (histogram)"));
+  cl::desc("YAML output file name (histogram), written in the columnar binary format if named *.bin"));
 
 // InstrumentationPass.
 //----------------------------------------------------------------------------------------------------------------------
@@ -72,6 +74,13 @@ struct InstrumentationPass : public PassInfoMixin<InstrumentationPass> {
       return PreservedAnalyses::all();
     }
 
+    // Identify blocks by their ordinal in the function: unlike their address, it is stable across runs.
+    block_ids_.clear();
+    for (Function &fun : *module_) {
+      uint64_t id{ 0 };
+      for (BasicBlock &bb : fun) block_ids_[&bb] = id++;
+    }
+
     gen_yaml();
     instrument();
 
@@ -82,6 +91,7 @@ private:
   // Instrumentations.
   void gen_info();
   void gen_yaml();
+  void gen_binary();
   void instrument();
 
   // Helper functions.
@@ -92,6 +102,7 @@ private:
 
   Module *module_;
   GlobalVariable *info_array_;
+  DenseMap<BasicBlock *, uint64_t> block_ids_;
   // Instrumentation functions.
   Function *init_fun_, *finalize_fun_, *start_fun_, *stop_fun_, *resume_fun_, *pause_fun_;
 
@@ -141,6 +152,10 @@ void InstrumentationPass::gen_info()
 
 void InstrumentationPass::gen_yaml()
 {
+  if (Binary_output::is_binary_path(params.yaml_file)) {
+    gen_binary();
+    return;
+  }
   using Block_data = map<unsigned, unsigned long>; // Opcode -> count.
   using Function_data = map<BasicBlock *, Block_data>;
   using Instrumentation_data = map<Function *, Function_data>;
@@ -167,7 +182,7 @@ void InstrumentationPass::gen_yaml()
     yaml << "      BasicBlocks:\n";
     for (const auto &[bb, bdata] : fdata) {
       yaml << "        - BasicBlock:\n";
-      yaml << "            ID: " << reinterpret_cast<uint64_t>(bb) << '\n';
+      yaml << "            ID: " << block_ids_[bb] << '\n';
       yaml << "            OpCodes:\n";
       for (const auto &[opcode, count] : bdata) {
         yaml << "              - " << opcode << ": " << count << '\n';
@@ -177,6 +192,42 @@ void InstrumentationPass::gen_yaml()
   yaml.close();
 }
 
+// The histograms as tables, in module order: functions (name, block_end) and blocks (id, opcode counts, a matrix with one
+// column per opcode). With function granularity, each function has a single block with all of its instructions.
+void InstrumentationPass::gen_binary()
+{
+  constexpr unsigned num_opcodes{ Instruction::OtherOpsEnd };
+  Binary_output::Table functions{ "functions" }, blocks{ "blocks" };
+  vector<string> names{};
+  vector<uint64_t> block_end{}, ids{};
+  vector<uint32_t> opcodes{};
+  for (Function &func : *module_) {
+    if (func.empty()) continue;
+    names.push_back(func.getName().str());
+    for (BasicBlock &bb : func) {
+      if (params.granularity == Granularity::BasicBlock || &bb == &func.front()) {
+        ids.push_back(block_ids_[&bb]);
+        opcodes.resize(opcodes.size() + num_opcodes, 0);
+      }
+      for (Instruction &instr : bb) opcodes[opcodes.size() - num_opcodes + instr.getOpcode()] += 1;
+    }
+    block_end.push_back(ids.size());
+  }
+  functions.rows = names.size();
+  functions.add_strings("name", names);
+  functions.add("block_end", block_end);
+  blocks.rows = ids.size();
+  blocks.add("id", ids);
+  blocks.add("opcodes", opcodes, num_opcodes);
+
+  ofstream output{ params.yaml_file, ios::binary };
+  if (!output.is_open()) {
+    errs() << "Error: Unable to open file [" << params.yaml_file << "] for writing.\n";
+    return;
+  }
+  output << Binary_output::serialize({ Binary_output::Kind::histograms, { functions, blocks } });
+}
+
 // INSTRUMENTATION.
 // * Insert start at the start of function/BB and after function call.
 // * Insert stop at the end of function (at each return), at the end of BBs and before function calls.
@@ -190,7 +241,7 @@ void InstrumentationPass::instrument()
       BasicBlock &first{ fun.front() };
       IRBuilder<> builder{ &*first.getFirstInsertionPt() };
       Value *function_name{ get_str_value(fun.getName().data(), builder) };
-      vector<Value *> start_args{ function_name, builder.getInt64(reinterpret_cast<uint64_t>(&fun.front())) };
+      vector<Value *> start_args{ function_name, builder.getInt64(block_ids_[&fun.front()]) };
 
       // Add pause before each function call, and resume after a series of calls.
       for (BasicBlock &bb : fun) add_pause_and_resume(bb, start_args);
@@ -210,7 +261,7 @@ void InstrumentationPass::instrument()
       for (BasicBlock &bb : fun) {
         IRBuilder<> builder{ &*bb.getFirstInsertionPt() };
         Value *function_name{ get_str_value(fun.getName().data(), builder) };
-        vector<Value *> start_args{ function_name, builder.getInt64(reinterpret_cast<uint64_t>(&bb)) };
+        vector<Value *> start_args{ function_name, builder.getInt64(block_ids_[&bb]) };
 
         // Add pause before each function call, and resume after a series of calls.
         add_pause_and_resume(bb, start_args);
@@ -12,6 +12,8 @@
 #include <llvm/Passes/PassBuilder.h>
 #include <llvm/Passes/PassPlugin.h>
 
+#include <atomic>
+#include <chrono>
 #include <map>
 
 #include "branch_prediction_pass.hh"
@@ -21,6 +23,68 @@
 
 using namespace llvm;
 
+cl::opt<std::string> arg_estimate_tier(
+    "estimate-tier",
+    cl::init("standard"),
+    cl::desc("Estimate fidelity: fast (reduced heuristics, no points-to, sampled cold functions), standard or precise "
+             "(SCEV trip counts, exact recursion, memory costs)"),
+    cl::value_desc("fast|standard|precise"));
+
+Estimate_tier estimate_tier() {
+    if (arg_estimate_tier == "fast") return Estimate_tier::fast;
+    if (arg_estimate_tier == "precise") return Estimate_tier::precise;
+    if (arg_estimate_tier != "standard") {
+        static std::atomic<bool> reported{false};
+        if (!reported.exchange(true))
+            errs() << "Unrecognized estimate tier [" << arg_estimate_tier << "], using standard\n";
+    }
+    return Estimate_tier::standard;
+}
+
+const char *estimate_tier_name(Estimate_tier tier) {
+    switch (tier) {
+    case Estimate_tier::fast: return "fast";
+    case Estimate_tier::standard: return "standard";
+    case Estimate_tier::precise: return "precise";
+    }
+    return "standard";
+}
+
+cl::opt<unsigned long> arg_step_budget(
+    "wu-larus-step-budget",
+    cl::init(0),
+    cl::desc("Blocks Algorithm 2 may visit in a function (and instructions points-to may trace for an indirect call) "
+             "before falling back to loop depth frequencies (0: no limit)"));
+
+cl::opt<double> arg_time_budget(
+    "wu-larus-time-budget",
+    cl::init(0),
+    cl::desc("Seconds Algorithm 3 may spend on a module; the functions analysed after that get loop depth frequencies "
+             "(0: no limit)"),
+    cl::value_desc("seconds"));
+
+// Per thread: the tools analyse modules on several threads at once, each with its own deadline.
+static thread_local bool moduleBudgetActive = false;
+static thread_local std::chrono::steady_clock::time_point moduleDeadline;
+
+unsigned long step_budget() {
+    return arg_step_budget;
+}
+
+void start_module_budget() {
+    moduleBudgetActive = arg_time_budget > 0;
+    moduleDeadline = std::chrono::steady_clock::now() +
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(arg_time_budget));
+}
+
+void stop_module_budget() {
+    moduleBudgetActive = false;
+}
+
+bool module_budget_exhausted() {
+    return moduleBudgetActive && std::chrono::steady_clock::now() >= moduleDeadline;
+}
+
 BranchPredictionPass::Result &BranchPredictionPass::run(llvm::Function &f, llvm::FunctionAnalysisManager &fam)
 {
     // To perform the branch prediction, the following passes are required.
@@ -30,6 +94,7 @@ BranchPredictionPass::Result &BranchPredictionPass::run(llvm::Function &f, llvm:
 
     // Clear previously calculated data.
     Clear();
+    fastTier_ = estimate_tier() == Estimate_tier::fast;
 
     // Build all required information to run the branch prediction pass.
     branchPredictionInfo_ = new BranchPredictionInfo(DT, LI, PDT);
@@ -169,6 +234,8 @@ void BranchPredictionPass::calculateBranchProbabilities(BasicBlock *BB) {
             for (unsigned h = 0; h < branchHeuristicsInfo_->getNumHeuristics(); ++h) {
                 // Retrieve the next heuristic.
                 BranchHeuristics heuristic = branchHeuristicsInfo_->getHeuristic(h);
+                if (fastTier_ && !isFastHeuristic(heuristic))
+                    continue;
 
                 // If the heuristic matched, add the edge probability to it.
                 Prediction pred = branchHeuristicsInfo_->matchHeuristic(heuristic, BB);
@@ -183,6 +250,21 @@ void BranchPredictionPass::calculateBranchProbabilities(BasicBlock *BB) {
     }
 }
 
+/// isFastHeuristic - Heuristics of the fast tier: the loop heuristics and the
+/// opcode one, which look at the branch and the loop info only. The others
+/// search the successors for calls, stores, returns and pointer uses.
+bool BranchPredictionPass::isFastHeuristic(BranchHeuristics heuristic) {
+    switch (heuristic) {
+    case LOOP_BRANCH_HEURISTIC:
+    case LOOP_EXIT_HEURISTIC:
+    case LOOP_HEADER_HEURISTIC:
+    case OPCODE_HEURISTIC:
+        return true;
+    default:
+        return false;
+    }
+}
+
 /// addEdgeProbability - If a heuristic matches, calculates the edge probability
 /// combining previous predictions acquired.
 void BranchPredictionPass::addEdgeProbability(BranchHeuristics heuristic,
@@ -9,6 +9,22 @@
 
 #include "branch_heuristics_info.hh"
 
+// Fidelity of the estimates (-estimate-tier), shared by the Wu-Larus analyses and EstimateCostPass. The fast tier
+// predicts branches with the loop and opcode heuristics only and skips points-to; the precise tier takes loop trip
+// counts from SCEV and solves recursive calls exactly. Standard is the original algorithm.
+enum class Estimate_tier { fast, standard, precise };
+Estimate_tier estimate_tier();
+const char *estimate_tier_name(Estimate_tier tier);
+
+// Compile-time budget of the Wu-Larus analyses. Algorithm 2 gives up on a function after step_budget() blocks visited,
+// or once the time of the module started by Algorithm 3 (-wu-larus-time-budget) is over: the function then gets
+// frequencies from its loop depth (BlockEdgeFrequencyPass::isDegraded). Points-to gives up on an indirect call likewise.
+// The module's time is kept per thread, from start_module_budget() to stop_module_budget() on that thread.
+unsigned long step_budget(); // 0 without limit.
+void start_module_budget();
+void stop_module_budget();
+bool module_budget_exhausted();
+
 struct BranchPredictionPass : public llvm::AnalysisInfoMixin<BranchPredictionPass> {
     using Result = BranchPredictionPass;
     using Edge = std::pair<const llvm::BasicBlock *, const llvm::BasicBlock *>;
@@ -36,8 +52,10 @@ private:
     BranchHeuristicsInfo *branchHeuristicsInfo_;
 
     std::map<Edge, double> edgeProbabilities_;
+    bool fastTier_ = false; // Match the fast heuristics only (isFastHeuristic).
 
     void calculateBranchProbabilities(llvm::BasicBlock *BB);
+    static bool isFastHeuristic(BranchHeuristics heuristic);
     void addEdgeProbability(BranchHeuristics heuristic, const llvm::BasicBlock *root, Prediction pred);
 
     int clear_count_ = 0;
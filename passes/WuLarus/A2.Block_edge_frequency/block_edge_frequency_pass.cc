@@ -5,20 +5,32 @@
 
 #include <llvm/Analysis/LoopInfo.h>
 #include <llvm/Analysis/PostDominators.h>
+#include <llvm/Analysis/ScalarEvolution.h>
 #include <llvm/Pass.h>
 #include <llvm/Passes/PassBuilder.h>
 #include <llvm/Passes/PassPlugin.h>
 
+#include <algorithm>
+#include <cmath>
 #include <map>
+#include <vector>
 
 #include "block_edge_frequency_pass.hh"
 
 using namespace llvm;
 
+static cl::opt<bool> arg_legacy_propagation(
+    "wu-larus-legacy-propagation",
+    cl::init(false),
+    cl::desc("Propagate the block frequencies of each loop over all the blocks its head reaches, as in the original "
+             "Algorithm 2 (quadratic in the number of loops)"));
+
 const double BlockEdgeFrequencyPass::epsilon_ = 0.000001;
 
 BlockEdgeFrequencyPass::Result &BlockEdgeFrequencyPass::run(Function &func, FunctionAnalysisManager &fam) {
     loopInfo_ = &fam.getResult<LoopAnalysis>(func);
+    scalarEvolution_ = estimate_tier() == Estimate_tier::precise && !loopInfo_->empty() ?
+        &fam.getResult<ScalarEvolutionAnalysis>(func) : nullptr;
     branchPredictionPass_ = new BranchPredictionPass(fam.getResult<BranchPredictionPass>(func));
 
     // Clear previously calculated data.
@@ -27,25 +39,39 @@ BlockEdgeFrequencyPass::Result &BlockEdgeFrequencyPass::run(Function &func, Func
     backEdgeProbabilities_.clear();
     edgeFrequencies_.clear();
     blockFrequencies_.clear();
+    steps_ = 0;
+    degraded_ = module_budget_exhausted();
+
+    if (arg_legacy_propagation) {
+        // Find all loop headers of this function.
+        BasicBlock *entry = nullptr;
+        for (auto &BB : func.getBasicBlockList()) {
+            if (entry == nullptr)
+                entry = &BB;
+            // If it is a loop head, add it to the list.
+            if (loopInfo_->isLoopHeader(&BB) && !degraded_)
+                propagateLoop(loopInfo_->getLoopFor(&BB));
+        }
 
-    // Find all loop headers of this function.
-    BasicBlock *entry = nullptr;
-    for (auto &BB : func.getBasicBlockList()) {
-        if (entry == nullptr)
-            entry = &BB;
-        // If it is a loop head, add it to the list.
-        if (loopInfo_->isLoopHeader(&BB))
-            propagateLoop(loopInfo_->getLoopFor(&BB));
+        // Propagate frequencies assuming entry block is a loop head.
+        if (!degraded_)
+            markReachable(entry);
+        if (!degraded_)
+            propagateFreq(entry);
+    } else if (!degraded_) {
+        propagateNest(func);
     }
-
-    // Propagate frequencies assuming entry block is a loop head.
-    markReachable(entry);
-    propagateFreq(entry);
+    if (degraded_)
+        degrade(func);
 
     // Clean up unnecessary information.
     notVisited_.clear();
     loopsVisited_.clear();
     backEdgeProbabilities_.clear();
+    blockIndex_.clear();
+    inRegion_.clear();
+    reached_.clear();
+    processed_.clear();
 
     return *this;
 }
@@ -111,6 +137,8 @@ void BlockEdgeFrequencyPass::markReachable(BasicBlock *root) {
         BasicBlock *BB = stack.pop_back_val();
         if (! notVisited_.insert(BB).second)
             continue;
+        if (!spend())
+            return;
 
         // Put the new successors into the stack.
         Instruction *TI = BB->getTerminator();
@@ -133,12 +161,47 @@ void BlockEdgeFrequencyPass::propagateLoop(const Loop *loop) {
         propagateLoop(inner);
     }
 
+    if (degraded_)
+        return;
+
     // Find the header.
     BasicBlock *head = loop->getHeader();
     // Mark as not visited all blocks reachable from the loop head.
     markReachable(head);
     // Propagate frequencies from the loop head.
-    propagateFreq(head);
+    if (!degraded_)
+        propagateFreq(head);
+    if (scalarEvolution_ && !degraded_)
+        applyTripCount(loop);
+}
+
+/// applyTripCount - Scale the back edge probabilities of a loop whose trip count
+/// SCEV knows, so that its cyclic probability makes the header run that many
+/// times per entry into the loop.
+void BlockEdgeFrequencyPass::applyTripCount(const Loop *loop) {
+    unsigned tripCount = scalarEvolution_->getSmallConstantTripCount(loop);
+    if (tripCount == 0)
+        return;
+
+    BasicBlock *head = loop->getHeader();
+    std::vector<Edge> backEdges;
+    double cyclicProbability = 0.0;
+    for (pred_iterator PI = pred_begin(head), PE = pred_end(head); PI != PE; ++PI) {
+        if (!loop->contains(*PI))
+            continue;
+        Edge edge = std::make_pair(*PI, head);
+        backEdges.push_back(edge);
+        cyclicProbability += getBackEdgeProbabilities(edge);
+    }
+    if (backEdges.empty())
+        return;
+
+    double exact = 1.0 - 1.0 / tripCount;
+    for (Edge &edge : backEdges) {
+        // Back edges the heuristics never take share the probability evenly.
+        backEdgeProbabilities_[edge] = cyclicProbability > 0.0 ?
+            getBackEdgeProbabilities(edge) * exact / cyclicProbability : exact / backEdges.size();
+    }
 }
 
 /// PropagateFreq - Compute basic block and edge frequencies by propagating
@@ -158,6 +221,8 @@ void BlockEdgeFrequencyPass::propagateFreq(BasicBlock *head) {
         // If BB has been visited.
         if (!notVisited_.count(BB))
             continue;
+        if (!spend())
+            return;
 
         // Define the block frequency. If it's a loop head, assume it executes only
         // once.
@@ -184,57 +249,16 @@ void BlockEdgeFrequencyPass::propagateFreq(BasicBlock *head) {
             if (InvalidEdge)
                 continue;
 
-            // Sum the incoming frequencies edges for this block. Updated
-            // the cyclic probability for back edges predecessors.
-            double bfreq = 0.0;
-            double cyclic_probability = 0.0;
-
-            // Verify if BB is a loop head.
-            bool loop_head = loopInfo_->isLoopHeader(BB);
-
-            // Calculate the block frequency and the cyclic_probability in case
-            // of back edges using the sum of their predecessor's edge frequencies.
-            for (pred_iterator PI = pred_begin(BB), PE = pred_end(BB); PI != PE; ++PI) {
-                BasicBlock *pred = *PI;
-
-                Edge edge = std::make_pair(pred, BB);
-                if (info->isBackEdge(edge) && loop_head)
-                    cyclic_probability += getBackEdgeProbabilities(edge);
-                else
-                    bfreq += edgeFrequencies_[edge];
-            }
-
-            // For loops that seems not to terminate, the cyclic probability can be
-            // higher than 1.0. In this case, limit the cyclic probability below 1.0.
-            if (cyclic_probability > (1.0 - epsilon_))
-                cyclic_probability = 1.0 - epsilon_;
-
-            // Calculate the block frequency.
-            blockFrequencies_[BB] = bfreq / (1.0 - cyclic_probability);
+            blockFrequencies_[BB] = incomingFreq(BB);
         }
 
         // Mark the block as visited.
         notVisited_.erase(BB);
 
-        // Calculate the edges frequencies for all successor of this block.
-        Instruction *TI = BB->getTerminator();
-        for (unsigned s = 0; s < TI->getNumSuccessors(); ++s) {
-            BasicBlock *successor = TI->getSuccessor(s);
-            Edge edge = std::make_pair(BB, successor);
-            double prob = branchPredictionPass_->getEdgeProbability(edge);
-
-            // The edge frequency is the probability of this edge times the block
-            // frequency.
-            double efreq = prob * blockFrequencies_[BB];
-            edgeFrequencies_[edge] = efreq;
-
-            // If a successor is the loop head, update back edge probability.
-            if (successor == head)
-                backEdgeProbabilities_[edge] = efreq;
-
-        }
+        propagateEdges(BB, head);
 
         // Propagate frequencies for all successor that are not back edges.
+        Instruction *TI = BB->getTerminator();
         SmallVector<BasicBlock *, 64> backedges;
         for (unsigned s = 0; s < TI->getNumSuccessors(); ++s) {
             BasicBlock *successor = TI->getSuccessor(s);
@@ -251,9 +275,207 @@ void BlockEdgeFrequencyPass::propagateFreq(BasicBlock *head) {
     } while (!stack.empty());
 }
 
+/// spend - Count a block visited by the propagation. Returns false once the
+/// function is out of steps or the module out of time (checked every 1024
+/// steps), leaving the function to degrade().
+bool BlockEdgeFrequencyPass::spend() {
+    ++steps_;
+    if ((step_budget() && steps_ > step_budget()) || (steps_ % 1024 == 0 && module_budget_exhausted()))
+        degraded_ = true;
+    return !degraded_;
+}
+
+/// degrade - Estimate the frequencies from the loop depth alone: each loop
+/// around a block multiplies its frequency by the iterations the loop branch
+/// heuristic predicts. Linear in the function size.
+void BlockEdgeFrequencyPass::degrade(Function &func) {
+    double iterations = 1.0 / (1.0 - BranchHeuristicsInfo::getProbabilityTaken(LOOP_BRANCH_HEURISTIC));
+    edgeFrequencies_.clear();
+    blockFrequencies_.clear();
+    for (auto &BB : func) {
+        double freq = std::pow(iterations, loopInfo_->getLoopDepth(&BB));
+        blockFrequencies_[&BB] = freq;
+        for (BasicBlock *successor : successors(&BB))
+            edgeFrequencies_[std::make_pair(&BB, successor)] =
+                freq * branchPredictionPass_->getEdgeProbability(&BB, successor);
+    }
+}
+
+/// IncomingFreq - Frequency of a block that is not the head of the current
+/// propagation: the sum of its incoming edge frequencies, divided by one minus
+/// the cyclic probability of its back edges if it is a loop head.
+double BlockEdgeFrequencyPass::incomingFreq(BasicBlock *BB) {
+    const BranchPredictionInfo *info = branchPredictionPass_->getInfo();
+
+    // Sum the incoming frequencies edges for this block. Updated
+    // the cyclic probability for back edges predecessors.
+    double bfreq = 0.0;
+    double cyclic_probability = 0.0;
+
+    // Verify if BB is a loop head.
+    bool loop_head = loopInfo_->isLoopHeader(BB);
+
+    // Calculate the block frequency and the cyclic_probability in case
+    // of back edges using the sum of their predecessor's edge frequencies.
+    for (pred_iterator PI = pred_begin(BB), PE = pred_end(BB); PI != PE; ++PI) {
+        BasicBlock *pred = *PI;
+
+        Edge edge = std::make_pair(pred, BB);
+        if (info->isBackEdge(edge) && loop_head)
+            cyclic_probability += getBackEdgeProbabilities(edge);
+        else
+            bfreq += edgeFrequencies_[edge];
+    }
+
+    // For loops that seems not to terminate, the cyclic probability can be
+    // higher than 1.0. In this case, limit the cyclic probability below 1.0.
+    if (cyclic_probability > (1.0 - epsilon_))
+        cyclic_probability = 1.0 - epsilon_;
+
+    // Calculate the block frequency.
+    return bfreq / (1.0 - cyclic_probability);
+}
+
+/// PropagateEdges - Calculate the frequencies of the edges leaving a block,
+/// and the back edge probabilities of those reaching the head.
+void BlockEdgeFrequencyPass::propagateEdges(BasicBlock *BB, BasicBlock *head) {
+    // Calculate the edges frequencies for all successor of this block.
+    Instruction *TI = BB->getTerminator();
+    for (unsigned s = 0; s < TI->getNumSuccessors(); ++s) {
+        BasicBlock *successor = TI->getSuccessor(s);
+        Edge edge = std::make_pair(BB, successor);
+        double prob = branchPredictionPass_->getEdgeProbability(edge);
+
+        // The edge frequency is the probability of this edge times the block
+        // frequency.
+        double efreq = prob * blockFrequencies_[BB];
+        edgeFrequencies_[edge] = efreq;
+
+        // If a successor is the loop head, update back edge probability.
+        if (successor == head)
+            backEdgeProbabilities_[edge] = efreq;
+    }
+}
+
+/// PropagateNest - Propagate frequencies in linear time (times the loop
+/// depth): each loop over its own blocks only, inner loops first, then the
+/// function from its entry. All of them take their blocks in one reverse
+/// postorder of the edges that are not back edges, which puts every block
+/// after its predecessors. The blocks outside a loop that its head reaches,
+/// which propagateLoop also visits, only get frequencies that the enclosing
+/// loops overwrite: the results are the same on reducible control flow.
+void BlockEdgeFrequencyPass::propagateNest(Function &func) {
+    const BranchPredictionInfo *info = branchPredictionPass_->getInfo();
+
+    // Depth-first search from the entry, then from the loop heads it doesn't
+    // reach (dead code), numbering the blocks in the order they are found.
+    std::vector<BasicBlock *> order;
+    std::vector<std::pair<BasicBlock *, unsigned>> stack;
+    auto search = [&](BasicBlock *root) {
+        blockIndex_.insert(std::make_pair(root, blockIndex_.size()));
+        stack.push_back(std::make_pair(root, 0));
+        while (!stack.empty()) {
+            BasicBlock *BB = stack.back().first;
+            Instruction *TI = BB->getTerminator();
+            unsigned s = stack.back().second++;
+            if (s == TI->getNumSuccessors()) {
+                order.push_back(BB);
+                stack.pop_back();
+                continue;
+            }
+            BasicBlock *successor = TI->getSuccessor(s);
+            if (info->isBackEdge(std::make_pair(BB, successor)))
+                continue;
+            if (blockIndex_.insert(std::make_pair(successor, blockIndex_.size())).second)
+                stack.push_back(std::make_pair(successor, 0));
+        }
+    };
+    search(&func.getEntryBlock());
+    size_t reachable = order.size();
+    for (Loop *loop : loopInfo_->getLoopsInPreorder())
+        if (!blockIndex_.count(loop->getHeader()))
+            search(loop->getHeader());
+    std::reverse(order.begin(), order.end());
+
+    inRegion_.resize(blockIndex_.size());
+    reached_.resize(blockIndex_.size());
+    processed_.resize(blockIndex_.size());
+
+    // The blocks of each loop, in that order.
+    DenseMap<const Loop *, std::vector<BasicBlock *>> loopBlocks;
+    for (BasicBlock *BB : order)
+        for (Loop *loop = loopInfo_->getLoopFor(BB); loop; loop = loop->getParentLoop())
+            loopBlocks[loop].push_back(BB);
+
+    // Inner loops before the loops around them.
+    SmallVector<Loop *, 8> loops = loopInfo_->getLoopsInPreorder();
+    for (auto LI = loops.rbegin(), LE = loops.rend(); LI != LE && !degraded_; ++LI) {
+        propagateRegion((*LI)->getHeader(), loopBlocks[*LI]);
+        if (scalarEvolution_ && !degraded_)
+            applyTripCount(*LI);
+    }
+
+    // Propagate frequencies assuming entry block is a loop head.
+    if (!degraded_)
+        propagateRegion(&func.getEntryBlock(), ArrayRef<BasicBlock *>(order).take_back(reachable));
+}
+
+/// PropagateRegion - Propagate frequencies from head over blocks, in an order
+/// where each block comes after its predecessors but for back edges. Like
+/// propagateFreq, a block waiting for a predecessor of the region that is
+/// never processed (irreducible control flow) is left with frequency 1.
+void BlockEdgeFrequencyPass::propagateRegion(BasicBlock *head, ArrayRef<BasicBlock *> blocks) {
+    const BranchPredictionInfo *info = branchPredictionPass_->getInfo();
+
+    for (BasicBlock *BB : blocks)
+        inRegion_.set(blockIndex_[BB]);
+    reached_.set(blockIndex_[head]);
+
+    for (BasicBlock *BB : blocks) {
+        unsigned index = blockIndex_[BB];
+        if (!reached_.test(index))
+            continue;
+        if (!spend())
+            break;
+
+        blockFrequencies_[BB] = 1.0;
+        if (BB != head) {
+            bool ready = true;
+            for (pred_iterator PI = pred_begin(BB), PE = pred_end(BB); PI != PE && ready; ++PI) {
+                auto pred = blockIndex_.find(*PI);
+                ready = pred == blockIndex_.end() || !inRegion_.test(pred->second) ||
+                    processed_.test(pred->second) || info->isBackEdge(std::make_pair(*PI, BB));
+            }
+            if (!ready)
+                continue;
+            blockFrequencies_[BB] = incomingFreq(BB);
+        }
+        processed_.set(index);
+
+        propagateEdges(BB, head);
+        // Successors through edges that are not back edges are numbered.
+        for (BasicBlock *successor : successors(BB)) {
+            if (info->isBackEdge(std::make_pair(BB, successor)))
+                continue;
+            unsigned successorIndex = blockIndex_[successor];
+            if (inRegion_.test(successorIndex))
+                reached_.set(successorIndex);
+        }
+    }
+
+    // Reset the bits for the next region.
+    for (BasicBlock *BB : blocks) {
+        unsigned index = blockIndex_[BB];
+        inRegion_.reset(index);
+        reached_.reset(index);
+        processed_.reset(index);
+    }
+}
+
 void BlockEdgeFrequencyPass::Clear()
 {
     loopInfo_ = nullptr;
+    scalarEvolution_ = nullptr;
     branchPredictionPass_ = nullptr;
 }
 
@@ -5,8 +5,16 @@
 
 #pragma once
 
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/BitVector.h>
+#include <llvm/ADT/DenseMap.h>
+
 #include "../A1.Branch_prediction/branch_prediction_pass.hh"
 
+namespace llvm {
+    class ScalarEvolution;
+}
+
 struct BlockEdgeFrequencyPass : public llvm::AnalysisInfoMixin<BlockEdgeFrequencyPass> {
     using Result = BlockEdgeFrequencyPass;
     using Edge = std::pair<const llvm::BasicBlock *, const llvm::BasicBlock *>;
@@ -19,6 +27,8 @@ struct BlockEdgeFrequencyPass : public llvm::AnalysisInfoMixin<BlockEdgeFrequenc
     double getBackEdgeProbabilities(Edge &edge);
 
     void updateBlockFrequency(const llvm::BasicBlock *BB, double freq);
+    // The frequencies come from the loop depth: the function was out of budget.
+    bool isDegraded() const { return degraded_; }
     ~BlockEdgeFrequencyPass() { Clear(); }
     void Clear();
 
@@ -31,15 +41,29 @@ private:
     static const double epsilon_;
 
     llvm::LoopInfo *loopInfo_;
+    llvm::ScalarEvolution *scalarEvolution_ = nullptr; // Precise tier only.
     BranchPredictionPass *branchPredictionPass_;
 
+    // Legacy propagation (-wu-larus-legacy-propagation) only.
     std::set<const llvm::BasicBlock *> notVisited_;
     std::set<const llvm::Loop *> loopsVisited_;
+    // Loop nest propagation only: blocks by their index in blockIndex_.
+    llvm::DenseMap<const llvm::BasicBlock *, unsigned> blockIndex_;
+    llvm::BitVector inRegion_, reached_, processed_;
     std::map<Edge, double> backEdgeProbabilities_;
     std::map<Edge, double> edgeFrequencies_;
     std::map<const llvm::BasicBlock *, double> blockFrequencies_;
+    unsigned long steps_ = 0;
+    bool degraded_ = false;
 
     void markReachable(llvm::BasicBlock *root);
     void propagateLoop(const llvm::Loop *loop);
+    void applyTripCount(const llvm::Loop *loop);
     void propagateFreq(llvm::BasicBlock *head);
+    void propagateNest(llvm::Function &func);
+    void propagateRegion(llvm::BasicBlock *head, llvm::ArrayRef<llvm::BasicBlock *> blocks);
+    double incomingFreq(llvm::BasicBlock *BB);
+    void propagateEdges(llvm::BasicBlock *BB, llvm::BasicBlock *head);
+    bool spend();
+    void degrade(llvm::Function &func);
 };
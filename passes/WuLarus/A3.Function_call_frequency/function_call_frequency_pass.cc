@@ -18,6 +18,7 @@
 #include <llvm/Passes/PassBuilder.h>
 #include <llvm/Passes/PassPlugin.h>
 
+#include <cmath>
 #include <map>
 #include <set>
 #include <sstream>
@@ -68,9 +69,8 @@ FunctionCallFrequencyPass::Result &FunctionCallFrequencyPass::run(Module &module
   //CallGraph cg {module};
   //cg.print(errs());
   FunctionAnalysisManager &fam = mam.getResult<FunctionAnalysisManagerModuleProxy>(module).getManager();
-  Function *entry_func = module.getFunction("main");
-  Points2_analysis *p2{ nullptr };
-  int p2_count{ 0 };
+  entry_func_ = module.getFunction("main");
+  start_module_budget();
 
 //  debs << module;
 //  for (Function &foo : module)
@@ -86,54 +86,69 @@ FunctionCallFrequencyPass::Result &FunctionCallFrequencyPass::run(Module &module
   {// Step.1.
     for (Function &func : module) {
       visited_functions_[&func] = false;
-      set<Function *> reachable_nodes = {}; // Graph nodes (functions) reachable by func.
-      for (BasicBlock &bb : func) {
-        for (Instruction &instr : bb) {
-          if (auto *call = dyn_cast<CallInst>(&instr)) {// Find call instructions.
-            // Can't directly determine the called function, use points-to analysis.
-            if (!call->getCalledFunction() && use_points2) {
-              if (!p2) p2 = new Points2_analysis{ *this };
-              auto traced_functions{ p2->run(call) };
-              outs() << "Traced " << ++p2_count << " functions\n";
-              for (auto &traced : traced_functions) {
-                Edge edge = make_pair(&func, traced.first);
-                lfreqs_[edge] = lfreqs_[edge] + // Add block's frequency to edge.
-                  traced.second;
-                reachable_nodes.insert(traced.first);
-              }
-            } else {
-              Edge edge = make_pair(&func, call->getCalledFunction());
-              lfreqs_[edge] = lfreqs_[edge] + // Add block's frequency to edge.
-                getBlockEdgeFrequency(&func)->getBlockFrequency(&bb);
-              reachable_nodes.insert(call->getCalledFunction());
-            }
+      collect_calls(func);
+    }
+  }
+  propagate();
+  stop_module_budget();
+  return *this;
+}
+
+// Local call frequencies of the calls in <func> (lfreq), the call graph edges from <func>.
+void FunctionCallFrequencyPass::collect_calls(Function &func) {
+  set<Function *> reachable_nodes = {}; // Graph nodes (functions) reachable by func.
+  for (BasicBlock &bb : func) {
+    for (Instruction &instr : bb) {
+      if (auto *call = dyn_cast<CallInst>(&instr)) {// Find call instructions.
+        // Can't directly determine the called function, use points-to analysis.
+        if (!call->getCalledFunction() && use_points2 && estimate_tier() != Estimate_tier::fast) {
+          if (!points2_) points2_ = new Points2_analysis{ *this };
+          auto traced_functions{ points2_->run(call) };
+          if (points2_->truncated()) ++points2_truncated_;
+          outs() << "Traced " << ++points2_count_ << " functions\n";
+          for (auto &traced : traced_functions) {
+            Edge edge = make_pair(&func, traced.first);
+            lfreqs_[edge] = lfreqs_[edge] + // Add block's frequency to edge.
+              traced.second;
+            reachable_nodes.insert(traced.first);
           }
+        } else {
+          Edge edge = make_pair(&func, call->getCalledFunction());
+          lfreqs_[edge] = lfreqs_[edge] + // Add block's frequency to edge.
+            getBlockEdgeFrequency(&func)->getBlockFrequency(&bb);
+          reachable_nodes.insert(call->getCalledFunction());
         }
       }
-      reachable_functions_[&func] = reachable_nodes;
     }
-    back_edge_prob_ = lfreqs_;
   }
-  {// Step.2.
-    vector<Function *> dfs_functions = {};
-    set<Function *> loop_heads = {};
+  reachable_functions_[&func] = reachable_nodes;
+}
 
-    {// Build a list of functions reached from entry_func.
+// Steps 2 to 4, from the local call frequencies.
+void FunctionCallFrequencyPass::propagate() {
+  back_edge_prob_ = lfreqs_;
+  gfreqs_.clear();
+  cfreqs_.clear();
+  back_edges_.clear();
+  dfs_functions_.clear();
+  loop_heads_.clear();
+  {// Step.2.
+    {// Build a list of functions reached from entry_func_.
       vector<Function *> visited_stack = {}; // Detect recursion.
-      dfs_functions.push_back(entry_func); // Start dfs from entry function.
+      dfs_functions_.push_back(entry_func_); // Start dfs from entry function.
       std::function<void(Function *)> dfs;
       dfs = [&](Function *foo) -> void {
         visited_stack.push_back(foo);
         for (Function *calledFunction : reachable_functions_[foo]) {
-          auto found = find(dfs_functions.begin(), dfs_functions.end(), calledFunction);
-          if (found == dfs_functions.end()) {
-            dfs_functions.push_back(calledFunction);
+          auto found = find(dfs_functions_.begin(), dfs_functions_.end(), calledFunction);
+          if (found == dfs_functions_.end()) {
+            dfs_functions_.push_back(calledFunction);
             dfs(calledFunction);
           } else {// Check if it is a loop.
             for (auto f = visited_stack.rbegin(); f != visited_stack.rend(); ++f) {
               if (*f == calledFunction) {
                 //errs() << "DETECTED LOOP: " << foo->getName() << " calls " << f[0]->getName() << "\n";
-                loop_heads.insert(*f);
+                loop_heads_.insert(*f);
                 back_edges_.insert(make_pair(foo, *f));
               }
             }
@@ -141,13 +156,18 @@ FunctionCallFrequencyPass::Result &FunctionCallFrequencyPass::run(Module &module
         }
         visited_stack.pop_back();
       };
-      dfs(dfs_functions.front());
+      dfs(dfs_functions_.front());
     }
 
-    // Foreach function f in reverse depth-first order do.
-    for (auto f = dfs_functions.rbegin(); f != dfs_functions.rend(); ++f) {
-      auto it = loop_heads.find(*f);
-      if (it != loop_heads.end()) {
+    // Foreach function f in reverse depth-first order do. Out of time, the back edges keep their local frequencies.
+    recursion_degraded_ = false;
+    for (auto f = dfs_functions_.rbegin(); f != dfs_functions_.rend(); ++f) {
+      if (module_budget_exhausted()) {
+        recursion_degraded_ = true;
+        break;
+      }
+      auto it = loop_heads_.find(*f);
+      if (it != loop_heads_.end()) {
         Function *loop = *it;
         auto &reachable = reachable_functions_[loop]; // Nodes reachable from f.
         // Mark nodes reachable from f as not visited (false), and all others as visited (true).
@@ -161,15 +181,15 @@ FunctionCallFrequencyPass::Result &FunctionCallFrequencyPass::run(Module &module
     }
   }
   {// Step.3.
-    auto &reachable = reachable_functions_[entry_func];
+    auto &reachable = reachable_functions_[entry_func_];
     for (auto jt = visited_functions_.begin(); jt != visited_functions_.end(); ++jt) {
 //      jt->second = !(reachable.find(jt->first) != reachable.end());
       jt->second = false;
     }
-    visited_functions_[entry_func] = false;
+    visited_functions_[entry_func_] = false;
   }
   {// Step.4.
-    propagate_call_freq(entry_func, entry_func, true);
+    propagate_call_freq(entry_func_, entry_func_, true);
     // TODO: update gfreq.
   }
   // Sum incoming cfreqs for functions not propagated to.
@@ -184,7 +204,194 @@ FunctionCallFrequencyPass::Result &FunctionCallFrequencyPass::run(Module &module
   //     }
   //   }
   // }
-  return *this;
+  if (estimate_tier() == Estimate_tier::precise && !module_budget_exhausted()) solve_recursion();
+}
+
+/* Incremental update.
+  After a change to a few functions, only they get Algorithm 2 again. When their callees are the same, the call graph
+  and its back edges are too, and the invocation frequencies change only in the functions they reach (the region):
+  step 4 runs again from the region's entries, the functions called from outside it by a function already propagated
+  to. Recursion in the region makes steps 2 to 4 run on the whole call graph instead: the back edge probabilities of
+  step 2 depend on the frequencies left by the loop heads before them. So does a function of the region that step 4
+  doesn't reach, whose frequency is what step 2 left.
+***********************************************************************************************************************/
+void FunctionCallFrequencyPass::update(Module &module, FunctionAnalysisManager &fam, const set<Function *> &changed) {
+  start_module_budget();
+  set<Function *> present = {};
+  for (Function &func : module) present.insert(&func);
+  bool restructured = module.getFunction("main") != entry_func_;
+  entry_func_ = module.getFunction("main");
+
+  auto drop_calls = [&](Function *func) {
+    for (auto edge = lfreqs_.lower_bound(make_pair(func, nullptr)); edge != lfreqs_.end() && edge->first.first == func;)
+      edge = lfreqs_.erase(edge);
+  };
+  {// Functions erased from the module.
+    vector<Function *> erased = {};
+    for (auto &[func, _] : reachable_functions_)
+      if (func && !present.count(func)) erased.push_back(func);
+    for (Function *func : erased) {
+      delete getBlockEdgeFrequency(func);
+      function_block_edge_frequency_.erase(func);
+      reachable_functions_.erase(func);
+      visited_functions_.erase(func);
+      drop_calls(func);
+      restructured = true;
+    }
+  }
+  {// Changed functions: steps 0 and 1.
+    for (Function *func : changed) {
+      if (!present.count(func)) continue;
+      auto known = reachable_functions_.find(func);
+      set<Function *> callees = {};
+      if (known == reachable_functions_.end()) {
+        restructured = true;
+        visited_functions_[func] = false;
+      } else {
+        callees = known->second;
+      }
+      delete getBlockEdgeFrequency(func);
+      function_block_edge_frequency_.erase(func);
+      if (!func->empty() || func->isMaterializable())
+        function_block_edge_frequency_[func] = new BlockEdgeFrequencyPass(fam.getResult<BlockEdgeFrequencyPass>(*func));
+      drop_calls(func);
+      collect_calls(*func);
+      if (reachable_functions_[func] != callees) restructured = true;
+    }
+  }
+
+  set<Function *> region = {};
+  std::function<void(Function *)> reach = [&](Function *func) {
+    if (!region.insert(func).second) return;
+    for (Function *callee : reachable_functions_[func]) reach(callee);
+  };
+  for (Function *func : changed)
+    if (present.count(func)) reach(func);
+  for (Function *func : region)
+    if (loop_heads_.count(func) || !visited_functions_[func]) restructured = true;
+  if (restructured) {
+    propagate();
+    stop_module_budget();
+    return;
+  }
+
+  {// Step 4 on the region.
+    map<Function *, bool> entries = {};
+    for (auto &[caller, callees] : reachable_functions_)
+      if (!region.count(caller) && visited_functions_[caller])
+        for (Function *callee : callees)
+          if (region.count(callee)) entries[callee] = true;
+    for (Function *func : region) {
+      visited_functions_[func] = false;
+      cfreqs_.erase(func);
+      for (Function *callee : reachable_functions_[func]) {
+        Edge edge = make_pair(func, callee);
+        back_edge_prob_[edge] = lfreqs_[edge];
+        gfreqs_.erase(edge);
+      }
+    }
+    for (Function *func : dfs_functions_)
+      if (region.count(func) && (func == entry_func_ || entries[func])) propagate_call_freq(func, entry_func_, true);
+  }
+  if (estimate_tier() == Estimate_tier::precise && !module_budget_exhausted()) solve_recursion();
+  stop_module_budget();
+}
+
+/* Recursion solver (precise tier).
+  The invocation frequencies are the solution of cfreq(f) = [f is main] + sum over the callers p of lfreq(p->f) *
+  cfreq(p). Steps 2 to 4 approximate it around recursive calls; this solves it exactly, one strongly connected component
+  of the call graph at a time, callers first: Gaussian elimination on the component, with what flows in from outside.
+  Components whose calls never stop (no positive solution), or too large to solve, keep the frequencies of step 4.
+***********************************************************************************************************************/
+void FunctionCallFrequencyPass::solve_recursion() {
+  const size_t max_component = 256;
+  if (!entry_func_) return;
+
+  map<Function *, vector<Function *>> callers = {};
+  for (auto &[caller, callees] : reachable_functions_)
+    for (Function *callee : callees)
+      if (caller && callee) callers[callee].push_back(caller);
+
+  // Tarjan's algorithm: components are completed callees first.
+  vector<vector<Function *>> components = {};
+  map<Function *, unsigned> index = {}, low = {};
+  set<Function *> on_stack = {};
+  vector<Function *> stack = {};
+  std::function<void(Function *)> connect = [&](Function *f) {
+    unsigned next = index.size();
+    index[f] = next;
+    low[f] = next;
+    stack.push_back(f);
+    on_stack.insert(f);
+    for (Function *callee : reachable_functions_[f]) {
+      if (!callee) continue;
+      if (!index.count(callee)) {
+        connect(callee);
+        low[f] = min(low[f], low[callee]);
+      } else if (on_stack.count(callee)) {
+        low[f] = min(low[f], index[callee]);
+      }
+    }
+    if (low[f] != index[f]) return;
+    vector<Function *> component = {};
+    Function *member = nullptr;
+    do {
+      member = stack.back();
+      stack.pop_back();
+      on_stack.erase(member);
+      component.push_back(member);
+    } while (member != f);
+    components.push_back(component);
+  };
+  connect(entry_func_);
+
+  map<Function *, double> solved = {};
+  for (auto component = components.rbegin(); component != components.rend(); ++component) {
+    size_t n = component->size();
+    map<Function *, size_t> position = {};
+    for (size_t i = 0; i < n; ++i) position[(*component)[i]] = i;
+    // (I - L^T) x = inflow, as an augmented matrix.
+    vector<vector<double>> a(n, vector<double>(n + 1, 0.0));
+    for (size_t i = 0; i < n; ++i) {
+      Function *f = (*component)[i];
+      a[i][i] = 1.0;
+      a[i][n] = f == entry_func_ ? 1.0 : 0.0;
+      for (Function *caller : callers[f]) {
+        double lfreq = get_local_call_frequency(make_pair(caller, f));
+        auto inside = position.find(caller);
+        if (inside != position.end()) a[i][inside->second] -= lfreq;
+        else if (solved.count(caller)) a[i][n] += lfreq * solved[caller];
+      }
+    }
+    bool solvable = n <= max_component;
+    for (size_t col = 0; solvable && col < n; ++col) {
+      size_t pivot = col;
+      for (size_t row = col + 1; row < n; ++row)
+        if (fabs(a[row][col]) > fabs(a[pivot][col])) pivot = row;
+      if (fabs(a[pivot][col]) < 1e-12) {
+        solvable = false;
+        break;
+      }
+      swap(a[col], a[pivot]);
+      for (size_t row = 0; row < n; ++row) {
+        if (row == col || a[row][col] == 0.0) continue;
+        double factor = a[row][col] / a[col][col];
+        for (size_t k = col; k <= n; ++k) a[row][k] -= factor * a[col][k];
+      }
+    }
+    for (size_t i = 0; solvable && i < n; ++i)
+      if (a[i][n] / a[i][i] < 0) solvable = false;
+    for (size_t i = 0; i < n; ++i) {
+      Function *f = (*component)[i];
+      solved[f] = solvable ? a[i][n] / a[i][i] : get_invocation_frequency(f);
+    }
+  }
+
+  for (auto &[f, freq] : solved) {
+    cfreqs_[f] = freq;
+    for (Function *callee : reachable_functions_[f])
+      gfreqs_[make_pair(f, callee)] = get_local_call_frequency(make_pair(f, callee)) * freq;
+  }
 }
 
 void FunctionCallFrequencyPass::propagate_call_freq(Function *f, Function *head, bool is_final) {
@@ -255,6 +462,14 @@ double FunctionCallFrequencyPass::get_global_block_frequency(llvm::BasicBlock *b
 }
 
 
+vector<Function *> FunctionCallFrequencyPass::degraded_functions()
+{
+  vector<Function *> degraded = {};
+  for (auto &[func, a2_analysis] : function_block_edge_frequency_)
+    if (a2_analysis->isDegraded()) degraded.push_back(func);
+  return degraded;
+}
+
 BlockEdgeFrequencyPass *FunctionCallFrequencyPass::getBlockEdgeFrequency(Function *func)
 {
   auto found = function_block_edge_frequency_.find(func);
@@ -8,11 +8,16 @@
 #include "../A1.Branch_prediction/branch_prediction_pass.hh"
 #include "../A2.Block_edge_frequency/block_edge_frequency_pass.hh"
 
+struct Points2_analysis;
+
 struct FunctionCallFrequencyPass : public llvm::AnalysisInfoMixin<FunctionCallFrequencyPass> {
   using Result = FunctionCallFrequencyPass;
   typedef std::pair<const llvm::Function*, const llvm::Function*> Edge;
 
   Result &run(llvm::Module &, llvm::ModuleAnalysisManager &mam);
+  // Bring the result up to date after <changed> were modified or added to the module, their analyses invalidated in
+  // <fam>. Erased functions are dropped; the functions neither known nor in <changed> are left out.
+  void update(llvm::Module &, llvm::FunctionAnalysisManager &fam, const std::set<llvm::Function *> &changed);
 //    BranchPredictionPass *getBranchPrediction(llvm::Function *);
   double get_local_block_frequency(llvm::BasicBlock *);
   double get_local_edge_frequency(llvm::BasicBlock *, llvm::BasicBlock *);
@@ -20,11 +25,19 @@ struct FunctionCallFrequencyPass : public llvm::AnalysisInfoMixin<FunctionCallFr
   double get_local_call_frequency(Edge edge);
   double get_global_call_frequency(Edge edge);
   double get_invocation_frequency(llvm::Function *node);
+  // Out of budget (see step_budget()): the functions given loop depth frequencies, the indirect calls points-to gave
+  // up on, and whether the back edges of recursive calls kept their local call frequencies (step 2 skipped).
+  std::vector<llvm::Function *> degraded_functions();
+  int points2_truncated() const { return points2_truncated_; }
+  bool recursion_degraded() const { return recursion_degraded_; }
 
 private:
   static llvm::AnalysisKey Key;
   friend struct llvm::AnalysisInfoMixin<FunctionCallFrequencyPass>;
 
+  void collect_calls(llvm::Function &);
+  void propagate();
+  void solve_recursion();
   void propagate_call_freq(llvm::Function *f, llvm::Function *head, bool is_final);
 
   // The result of Block and Edge Frequencies (Algorithm 2) for each function.
@@ -36,4 +49,11 @@ private:
   std::map<llvm::Function *, bool> visited_functions_;
   std::map<Edge, double> back_edge_prob_, lfreqs_, gfreqs_;
   std::map<llvm::Function *, double> cfreqs_; // Call frequency of each function.
+  llvm::Function *entry_func_ = nullptr;
+  std::vector<llvm::Function *> dfs_functions_; // Reached from entry_func_, in depth-first order.
+  std::set<llvm::Function *> loop_heads_; // Targets of the back edges (recursion).
+  Points2_analysis *points2_ = nullptr;
+  int points2_count_ = 0;
+  int points2_truncated_ = 0;
+  bool recursion_degraded_ = false;
 };
@@ -120,6 +120,8 @@ struct Points2_analysis {
 
   // Run the analysis for a virtual call.
   Result run(CallInst *call);
+  // The last run gave up, out of budget: its result is empty.
+  bool truncated() const { return truncated_; }
 
 private:
   // Helper functions.
@@ -142,6 +144,8 @@ private:
 //  map<Instruction *, Bfreqs> bfreqs_;
   FunctionCallFrequencyPass &pass_; // We need local block and edge frequency info.
   CallInst *call_; // The indirect call instruction whose pointer operand we are mapping to actual functions.
+  unsigned long steps_ = 0; // Instructions traced in this run.
+  bool truncated_ = false;
 };
 
 // Points-to analysis:
@@ -161,9 +165,12 @@ Points2_analysis::Result Points2_analysis::run(CallInst *call)
        << "\n************************************************************\n";
 //  Trace_data data{ dyn_cast<Instruction>(call->getCalledOperand()) };
   Trace_data data{ call };
+  steps_ = 0;
+  truncated_ = false;
   trace_main(data, Trace_dir::regular);
   debs << "Final trace data:\n" << data;
   Result result;
+  if (truncated_) return result;
   data.sum_trace(result);
   return result;
 }
@@ -191,6 +198,11 @@ void Points2_analysis::trace_main(Trace_data &data, Instruction_data idata)
   debs << "\nTracing [" << print(data.ref()) << "]\n";
   debs << "************************************************************\n";
   while (data.has_instructions()) {
+    ++steps_;
+    if (truncated_ || (step_budget() && steps_ > step_budget()) || (steps_ % 1024 == 0 && module_budget_exhausted())) {
+      truncated_ = true;
+      return;
+    }
     auto [instr, idata]{ data.get_instr() };
     BasicBlock  *instr_bb{ instr->getParent() };
 
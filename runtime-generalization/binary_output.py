@@ -0,0 +1,148 @@
+#!/usr/bin/python3
+
+# Reader for the columnar binary output of EstimateCostPass (-binary-output), InstrumentationPass (-yaml-output with a
+# .bin extension) and the PAPI runtime (instrumentation output with a .bin extension). The layout is documented in
+# passes/EstimateCostPass/binary_output.hh. Uncompressed columns are numpy views of the memory-mapped file.
+#
+#   tables = binary_output.load('freqs.bin')
+#   tables['blocks']['opcodes']   # blocks x opcodes matrix.
+#
+# As a script, converts a binary file back to the YAML the tools used to write: %(prog)s FILE [--output FILE]
+
+import argparse
+import mmap
+import struct
+import sys
+import zlib
+
+import numpy as np
+
+MAGIC = b'RTEB'
+VERSION = 1
+KINDS = {1: 'frequencies', 2: 'costs', 3: 'histograms', 4: 'runtime_data', 5: 'file_costs'}
+DTYPES = {0: np.dtype('<u4'), 1: np.dtype('<u8'), 2: np.dtype('<f8'), 3: np.dtype('u1')}
+
+
+def load(path):
+    """Return (kind, {table: {column: array}}), strings columns decoded to lists of str."""
+    with open(path, 'rb') as file:
+        data = mmap.mmap(file.fileno(), 0, access=mmap.ACCESS_READ)
+    if data[:4] != MAGIC:
+        raise ValueError(f'{path} is not a binary output file')
+    version, kind, num_tables = struct.unpack_from('<3I', data, 4)
+    if version != VERSION:
+        raise ValueError(f'{path}: unsupported version {version}')
+    pos = 16
+    tables = {}
+    for _ in range(num_tables):
+        name = data[pos:pos + 16].rstrip(b'\0').decode()
+        rows, num_columns, _ = struct.unpack_from('<Q2I', data, pos + 16)
+        pos += 32
+        columns = {}
+        for _ in range(num_columns):
+            column = data[pos:pos + 16].rstrip(b'\0').decode()
+            type_id, compression, _, width, stored, raw = struct.unpack_from('<2BHI2Q', data, pos + 16)
+            pos += 40
+            if compression == 0:
+                values = np.frombuffer(data, dtype=DTYPES[type_id], count=raw // DTYPES[type_id].itemsize, offset=pos)
+            else:
+                values = np.frombuffer(zlib.decompress(data[pos:pos + stored]), dtype=DTYPES[type_id])
+            if width > 1:
+                values = values.reshape(-1, width)
+            columns[column] = values
+            pos += stored + (-(pos + stored) % 8)
+        for column in [c for c in columns if c + '_data' in columns]: # Strings.
+            ends, text = columns.pop(column).tolist(), columns.pop(column + '_data').tobytes()
+            starts = [0] + ends[:-1]
+            columns[column] = [text[s:e].decode() for s, e in zip(starts, ends)]
+        columns['rows'] = rows
+        tables[name] = columns
+    return KINDS.get(kind, kind), tables
+
+
+def opcode_items(counts):
+    return [(opcode, int(count)) for opcode, count in enumerate(counts) if count]
+
+
+def to_yaml(kind, tables, out):
+    """Write <tables> as the YAML the tools write for <kind>."""
+    if kind == 'frequencies':
+        functions, blocks = tables['functions'], tables['blocks']
+        out.write(f'Module:\n  Name: {tables["module"]["name"][0]}\n  Functions:\n')
+        begin = 0
+        for row, name in enumerate(functions['name']):
+            out.write(f'    - Function:\n        Name: {name}\n        Freq: {functions["freq"][row]:e}\n'
+                      '        BasicBlocks:\n')
+            end = int(functions['block_end'][row])
+            for block in range(begin, end):
+                out.write(f'          - BasicBlock:\n              Freq: {blocks["freq"][block]:e}\n'
+                          '              Histogram:\n')
+                for opcode, count in opcode_items(blocks['opcodes'][block]):
+                    out.write(f'                - {opcode}: {count}\n')
+            begin = end
+    elif kind == 'costs':
+        out.write('Cost_options:\n')
+        for name, total in zip(tables['options']['name'], tables['options']['total']):
+            out.write(f'- Option:\n    Name: {name}\n    Total cost: {total:e}\n')
+        if tables['components']['rows']:
+            out.write('Cost_components:\n')
+            for name, total in zip(tables['components']['name'], tables['components']['total']):
+                out.write(f'- Component:\n    Name: {name}\n    Total cost: {total:e}\n')
+        targets = tables.get('targets', {'rows': 0})
+        if targets['rows']:
+            out.write('Targets:\n')
+            previous = None
+            for cpu, name, total in zip(targets['cpu'], targets['option'], targets['total']):
+                if cpu != previous:
+                    out.write(f'- Target:\n    CPU: {cpu}\n    Cost_options:\n')
+                    previous = cpu
+                out.write(f'    - Option:\n        Name: {name}\n        Total cost: {total:e}\n')
+    elif kind == 'histograms':
+        functions, blocks = tables['functions'], tables['blocks']
+        out.write('Instrumentation_data:\n')
+        begin = 0
+        for row, name in enumerate(functions['name']):
+            out.write(f'  - Function:\n      Name: {name}\n      BasicBlocks:\n')
+            end = int(functions['block_end'][row])
+            for block in range(begin, end):
+                out.write(f'        - BasicBlock:\n            ID: {blocks["id"][block]}\n            OpCodes:\n')
+                for opcode, count in opcode_items(blocks['opcodes'][block]):
+                    out.write(f'              - {opcode}: {count}\n')
+            begin = end
+    elif kind == 'runtime_data':
+        blocks = tables['blocks']
+        out.write('Runtime_data:\n  Instrumentation: PAPI_TOT_CYC\n  Functions:\n')
+        previous = None
+        for row, function in enumerate(blocks['function']):
+            if function != previous:
+                out.write(f'    - Function:\n        Name: {function}\n        BasicBlocks:\n')
+                previous = function
+            out.write(f'          - BasicBlock:\n              ID: {blocks["id"][row]}\n'
+                      f'              Runs: {blocks["runs"][row]}\n              Pauses: {blocks["pauses"][row]}\n'
+                      f'              Cycles: {blocks["cycles"][row]}\n              Average: {blocks["average"][row]}\n')
+    elif kind == 'file_costs':
+        files, names = tables['files'], tables['options']['name']
+        costs = np.reshape(files['costs'], (len(files['name']), len(names))) # Width 1 columns aren't reshaped.
+        out.write('Files:\n')
+        for row, name in enumerate(files['name']):
+            out.write(f'- File:\n    Name: {name}\n    Status: {files["status"][row]}\n'
+                      f'    Functions: {files["functions"][row]}\n    Seconds: {files["seconds"][row]}\n')
+            if files['status'][row] == 'ok':
+                out.write('    Cost_options:\n')
+                for option, total in zip(names, costs[row]):
+                    out.write(f'    - Option:\n        Name: {option}\n        Total cost: {total:e}\n')
+    else:
+        raise ValueError(f'unknown kind {kind}')
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Convert a binary output file to YAML.')
+    parser.add_argument('input')
+    parser.add_argument('--output', dest='output')
+    args = parser.parse_args()
+    kind, tables = load(args.input)
+    if args.output:
+        with open(args.output, 'w') as file:
+            to_yaml(kind, tables, file)
+    else:
+        to_yaml(kind, tables, sys.stdout)
@@ -0,0 +1,69 @@
+#!/usr/bin/python3
+
+# Expected errors of the estimate tiers (-estimate-tier): runs estimate-cost (passes/EstimateCostPass/tools) on a
+# calibration corpus with each tier and writes, for the fast and standard tiers and each cost kind, the relative error
+# of the module totals against the precise tier. The table is read back with -tier-errors, which reports the errors
+# of the current tier with each estimate.
+#
+#   %(prog)s --estimate-cost build/estimate-cost --output tier_errors.csv -- corpus/ -prediction-cost-kind=latency
+
+import argparse
+import csv
+import os
+import subprocess
+import sys
+import tempfile
+
+TIERS = ['fast', 'standard', 'precise']
+
+
+def run_tier(estimate_cost, tier, arguments):
+    with tempfile.TemporaryDirectory() as directory:
+        output = os.path.join(directory, 'costs.csv')
+        # Files that fail are reported by estimate-cost and left out.
+        subprocess.run([estimate_cost, f'-estimate-tier={tier}', '-o', output] + arguments)
+        with open(output, newline='') as file:
+            rows = [row for row in csv.DictReader(file) if row['status'] == 'ok']
+    kinds = [kind for kind in rows[0] if kind not in ('file', 'status', 'functions', 'seconds')] if rows else []
+    return {row['file']: {kind: float(row[kind]) for kind in kinds} for row in rows}
+
+
+def percentile(values, fraction):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(fraction * len(values)))]
+
+
+def calibrate(estimate_cost, arguments):
+    costs = {tier: run_tier(estimate_cost, tier, arguments) for tier in TIERS}
+    rows = []
+    for tier in TIERS[:-1]:
+        errors = {}
+        for path, reference in costs['precise'].items():
+            if path not in costs[tier]:
+                continue
+            for kind, expected in reference.items():
+                if kind not in costs[tier][path]:
+                    continue
+                estimated = costs[tier][path][kind]
+                if expected != 0:
+                    errors.setdefault(kind, []).append(abs(estimated - expected) / abs(expected))
+                elif estimated == 0:
+                    errors.setdefault(kind, []).append(0.0)
+        for kind, values in errors.items():
+            rows.append([tier, kind.lower(), len(values), sum(values) / len(values), percentile(values, 0.9),
+                         max(values)])
+    return rows
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Calibrate the expected errors of the estimate tiers.')
+    parser.add_argument('--estimate-cost', default='estimate-cost')
+    parser.add_argument('--output', default='-')
+    parser.add_argument('arguments', nargs='+', help='inputs and options of estimate-cost')
+    args = parser.parse_args()
+    output = sys.stdout if args.output == '-' else open(args.output, 'w', newline='')
+    writer = csv.writer(output, lineterminator='\n')
+    writer.writerow(['tier', 'cost_kind', 'files', 'mean_error', 'p90_error', 'max_error'])
+    writer.writerows(calibrate(args.estimate_cost, args.arguments))
+    if output is not sys.stdout:
+        output.close()
@@ -0,0 +1,93 @@
+#!/usr/bin/python3
+
+# Client of estimate-daemon (passes/EstimateCostPass/tools/estimate_daemon.cc, which documents the protocol).
+#
+#   with Estimate_client('/tmp/estimate.sock') as client:
+#       totals, functions = client.estimate(path='module.bc', per_function=True)
+#       totals['Latency'], functions['Latency']['main']
+#
+# As a script, prints the totals of the modules given: %(prog)s --socket PATH [--per-function] MODULE...
+
+import argparse
+import os
+import socket
+import struct
+
+PATH_PAYLOAD = 1
+PER_FUNCTION = 2
+
+
+class Estimate_error(Exception):
+    pass
+
+
+class Estimate_client:
+    def __init__(self, path):
+        self.socket = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self.socket.connect(path)
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    def close(self):
+        self.socket.close()
+
+    def estimate(self, module=None, path=None, per_function=False):
+        """Costs of <module> (bitcode or IR bytes), or of the module at <path> as the daemon sees it.
+        Returns ({kind: total}, {kind: {function: cost}}), the second empty without <per_function>."""
+        if (module is None) == (path is None):
+            raise ValueError('give either module or path')
+        payload = os.fsencode(path) if path is not None else bytes(module)
+        flags = (PATH_PAYLOAD if path is not None else 0) | (PER_FUNCTION if per_function else 0)
+        self.socket.sendall(struct.pack('<IQ', flags, len(payload)) + payload)
+        status, = self._unpack('<I')
+        if status:
+            size, = self._unpack('<Q')
+            raise Estimate_error(self._read(size).decode())
+        totals, functions = {}, {}
+        kinds, = self._unpack('<I')
+        for _ in range(kinds):
+            kind = self._string()
+            totals[kind], count = self._unpack('<dI')
+            if count:
+                functions[kind] = {}
+            for _ in range(count):
+                name = self._string()
+                functions[kind][name], = self._unpack('<d')
+        return totals, functions
+
+    def _read(self, size):
+        data = bytearray()
+        while len(data) < size:
+            chunk = self.socket.recv(size - len(data))
+            if not chunk:
+                raise Estimate_error('connection closed by the daemon')
+            data += chunk
+        return bytes(data)
+
+    def _unpack(self, fmt):
+        return struct.unpack(fmt, self._read(struct.calcsize(fmt)))
+
+    def _string(self):
+        size, = self._unpack('<I')
+        return self._read(size).decode()
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Query estimate-daemon.')
+    parser.add_argument('--socket', required=True)
+    parser.add_argument('--per-function', action='store_true')
+    parser.add_argument('modules', nargs='+')
+    args = parser.parse_args()
+    with Estimate_client(args.socket) as client:
+        for path in args.modules:
+            with open(path, 'rb') as file:
+                totals, functions = client.estimate(module=file.read(), per_function=args.per_function)
+            print(path)
+            for kind, total in totals.items():
+                print(f'  {kind}: {total:e}')
+                for name, cost in functions.get(kind, {}).items():
+                    print(f'    {name}: {cost:e}')
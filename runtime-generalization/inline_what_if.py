@@ -0,0 +1,48 @@
+#!/usr/bin/python3
+
+# Cost of inlining each call site: for the functions of a module (or the ones given), the estimated cost the module
+# would have with each call to a defined function inlined, from the estimate_cost Python module
+# (passes/EstimateCostPass/tools/python_bindings.cc) and its incremental what-if estimates. Prints a CSV line per call
+# site: function,site,callee,cost,inlined_cost,delta_percent.
+#
+#   PYTHONPATH=build %(prog)s [--kind latency] [--function main] [--check] module.ll
+#
+# With --check, every estimate is made twice and the module's cost compared before and after: the what-if estimates
+# must leave the module as it was.
+
+import argparse
+import sys
+
+import estimate_cost
+
+
+def what_if(module, functions, kind):
+    rows = []
+    for function in functions:
+        cost, sites = module.what_if_inline(function, kind=kind)
+        for site, (callee, inlined) in enumerate(sites):
+            rows.append((function, site, callee, cost, inlined))
+    return rows
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Estimate the cost of inlining each call site of a module.')
+    parser.add_argument('--kind', default='latency', help='TTI cost kind, or one')
+    parser.add_argument('--function', action='append', help='function whose call sites are estimated (default: all)')
+    parser.add_argument('--check', action='store_true', help='check that the estimates leave the module unchanged')
+    parser.add_argument('module')
+    args = parser.parse_args()
+
+    module = estimate_cost.Module(args.module)
+    estimate_cost.set_options([f'-prediction-cost-kind={args.kind}'])
+    before = module.estimate()
+    functions = args.function or [name for name in module.costs()['functions']['name']]
+    rows = what_if(module, functions, args.kind)
+    print('function,site,callee,cost,inlined_cost,delta_percent')
+    for function, site, callee, cost, inlined in rows:
+        delta = 100 * (inlined - cost) / cost if cost else 0
+        print(f'{function},{site},{callee},{cost:e},{inlined:e},{delta:.3f}')
+    if args.check:
+        if what_if(module, functions, args.kind) != rows or module.estimate() != before:
+            sys.exit('Error: The what-if estimates changed the module')
+        print(f'Checked {len(rows)} call sites', file=sys.stderr)
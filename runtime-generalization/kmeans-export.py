@@ -0,0 +1,43 @@
+#!/usr/bin/python3
+
+import argparse
+import csv
+import os
+import struct
+
+import numpy as np
+from joblib import load
+
+def init_argparse() -> argparse.ArgumentParser:
+    parser = argparse.ArgumentParser(
+        usage="%(prog)s --kmeans-dir VAL --output VAL",
+        description="Export the kmeans.py model for the EstimateCostPass kmeans cost kind."
+    )
+    parser.add_argument('--kmeans-dir', dest='kmeans_dir', required=True, help='Directory with the trained models.')
+    parser.add_argument('--output', dest='output', required=True, help='Binary model file to write.')
+    return parser
+
+args = init_argparse().parse_args()
+
+kmeans = load(os.path.join(args.kmeans_dir, 'kmeans_model.joblib'))
+pca = load(os.path.join(args.kmeans_dir, 'pca_model.joblib'))
+cluster_avg_cost = {}
+with open(os.path.join(args.kmeans_dir, 'average_cycles_per_cluster.csv'), mode='r') as csv_file:
+    for row in csv.DictReader(csv_file):
+        cluster_avg_cost[int(row['cluster'])] = float(row['cycles'])
+
+# pca.transform(x) = (x - mean) @ components.T, divided by sqrt(explained_variance) when whitening.
+components = np.array(pca.components_, dtype='<f8')
+if pca.whiten:
+    components = components / np.sqrt(pca.explained_variance_)[:, np.newaxis]
+mean = np.array(pca.mean_, dtype='<f8')
+centroids = np.array(kmeans.cluster_centers_, dtype='<f8')
+cycles = np.array([cluster_avg_cost.get(i, 0) for i in range(len(centroids))], dtype='<f8')
+
+# Layout read by passes/EstimateCostPass/kmeans_cost.cc.
+with open(args.output, 'wb') as file:
+    file.write(b'KMNS')
+    file.write(struct.pack('<4I', 1, len(mean), len(components), len(centroids)))
+    for array in (mean, components, centroids, cycles):
+        file.write(np.ascontiguousarray(array).tobytes())
+print(f'Exported {len(centroids)} clusters over {len(components)} components to {args.output}')